@@ -4,7 +4,7 @@
 #include "Types.h"
 #include "Buttons.h"
 #include "libretroplug/MessageBus.h"
-#include "platform/Logger.h"
+#include "util/EventLog.h"
 
 const double CONSECUTIVE_PRESS_DELAY = 50;
 const double MODIFIER_PRESS_DELAY = 100;
@@ -16,16 +16,6 @@ enum ButtonPressType {
 	Release
 };
 
-static std::string buttonPressString(ButtonPressType type) {
-	switch (type) {
-	case ButtonPressType::Press: return "Press";
-	case ButtonPressType::Hold: return "Hold";
-	case ButtonPressType::Release: return "Release";
-	}
-
-	return "";
-}
-
 struct ButtonPress {
 	ButtonType button;
 	ButtonPressType type;
@@ -81,12 +71,12 @@ public:
 					press.active = true;
 
 					ButtonEvent ev = { press.button, press.type != ButtonPressType::Release };
-					bus->buttons.writeValue(ev);
+					bus->queuedButtons.writeValue(ev);
 
 					press.complete = press.type != ButtonPressType::Press;
 					_state[press.button] = ev.down;
 
-					consoleLogLine("Button " + buttonPressString(press.type) + ": " + ButtonTypes::toString(press.button));
+					EVENT_INFO(ButtonPressed, press.type, press.button);
 				} else {
 					press.startTime -= delta;
 				}
@@ -94,11 +84,11 @@ public:
 				// Button has been pressed and is awaiting release.  Only ButtonPressType::Press
 				// events will end up here
 				if (press.duration < delta) {
-					bus->buttons.writeValue(ButtonEvent{ press.button, false });
+					bus->queuedButtons.writeValue(ButtonEvent{ press.button, false });
 					press.complete = true;
 					_state[press.button] = false;
 
-					consoleLogLine("Button Release: " + ButtonTypes::toString(press.button));
+					EVENT_INFO(ButtonReleased, press.button);
 				} else {
 					press.duration -= delta;
 				}
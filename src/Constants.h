@@ -1,3 +1,23 @@
 #pragma once
 
-const int MAX_INSTANCES = 4;
\ No newline at end of file
+// The video atlas and the buffers used by the audio thread are allocated up
+// front for this many instances
+const int MAX_INSTANCES = 16;
+
+// Audio buffers are sized for blocks of at least this many frames, in case the
+// host doesn't report its block size before processing starts
+const int MIN_BLOCK_SIZE = 1024;
+
+// Unlinked instances have the last stage of their audio output rendered together
+// once there are at least this many of them.  It's a small part of the time spent
+// on each instance, so it only pays off for larger groups.
+const int APU_BATCH_MIN_INSTANCES = 8;
+
+// 4194304 Hz / 70224 cycles per frame
+const double GAMEBOY_FRAME_RATE = 59.7275;
+
+const int VIDEO_WIDTH = 160;
+const int VIDEO_HEIGHT = 144;
+const int VIDEO_PIXEL_COUNT = VIDEO_WIDTH * VIDEO_HEIGHT;
+const int VIDEO_FRAME_SIZE = VIDEO_PIXEL_COUNT * 4;
+const int VIDEO_PALETTE_SIZE = 64;
\ No newline at end of file
@@ -3,12 +3,13 @@
 #include "IControls.h"
 #include "src/ui/EmulatorView.h"
 #include "src/ui/RetroPlugRoot.h"
+#include "util/EventLog.h"
 #include "util/Serializer.h"
 
 RetroPlugInstrument::RetroPlugInstrument(const InstanceInfo& info)
 	: Plugin(info, MakeConfig(0, 0)) {
-	// FIXME: Choose a more realistic size for this based on GetBlockSize()
-	_sampleScratch = new float[1024 * 1024];
+	// Resized in OnReset once the host's block size is known
+	_sampleScratch.resize(MIN_BLOCK_SIZE * 2);
 
 #if IPLUG_EDITOR
 	mMakeGraphicsFunc = [&]() {
@@ -32,57 +33,63 @@ RetroPlugInstrument::RetroPlugInstrument(const InstanceInfo& info)
 #endif
 }
 
-RetroPlugInstrument::~RetroPlugInstrument() {
-	delete[] _sampleScratch;
-}
-
 #if IPLUG_DSP
 void RetroPlugInstrument::ProcessBlock(sample** inputs, sample** outputs, int frameCount) {
+	EVENT_THREAD_NAME("Audio");
+	EVENT_SCOPE(ProcessBlock, frameCount);
+
+	LoadTimer blockTimer;
+	double midiTime = _midiTime;
+	_midiTime = 0;
+
     for (size_t j = 0; j < MaxNChannels(ERoute::kOutput); j++) {
 		for (size_t i = 0; i < frameCount; i++) {
 			outputs[j][i] = 0;
 		}
 	}
 
-	if (frameCount == 0 || !_plug.getPlug(0) || !_plug.getPlug(0)->active()) {
+	// Every instance in the list stays alive until the block is done.  Instances
+	// boot independently, so the first one may still be loading while the others
+	// are running.
+	InstanceScope instances = _plug.audioInstances();
+	if (frameCount == 0 || instances->empty()) {
 		return;
 	}
 
+	// The time available to produce this block
+	double budget = frameCount / GetSampleRate();
+	QualityLevel quality = _plug.governor().level();
+	_blockFrames = frameCount;
+
 	bool transportChanged = false;
 	if (_transportRunning != mTimeInfo.mTransportIsRunning) {
 		_transportRunning = mTimeInfo.mTransportIsRunning;
 		transportChanged = true;
-		consoleLogLine("Transport running: " + std::to_string(_transportRunning));
+		EVENT_INFO(TransportChanged, _transportRunning);
 	}
 
-	// Keeping the shared pointer here makes sure that the reference count
-	// is at least 1 while we work with it
-	SameBoyPlugPtr plugPtrs[MAX_INSTANCES];
-
-	SameBoyPlug* plugs[MAX_INSTANCES] = { nullptr };
-	SameBoyPlug* linkedPlugs[MAX_INSTANCES] = { nullptr };
-
-	size_t totalPlugCount = 0;
-	size_t plugCount = 0;
-	size_t linkedPlugCount = 0;
+	// These have room for MAX_INSTANCES (see OnReset), so nothing here allocates
+	_activePlugs.clear();
+	_unlinkedPlugs.clear();
+	_linkedPlugs.clear();
+	_batchedPlugs.clear();
 
 	int sampleCount = frameCount * 2;
 
-	for (size_t i = 0; i < MAX_INSTANCES; i++) {
-		SameBoyPlugPtr plugPtr = _plug.plugs()[i];
-		if (plugPtr && plugPtr->active()) {
-			SameBoyPlug* plug = plugPtr.get();
-			plugPtrs[i] = plugPtr;
-			plugs[i] = plug;
+	for (size_t i = 0; i < instances->size(); i++) {
+		SameBoyPlug* plug = (*instances)[i].get();
+		if (plug->active()) {
+			bool linked = plug->gameLink();
+			_activePlugs.push_back({ plug, i, linked });
+			_instanceTimes[i] = 0;
+			plug->setQuality(quality);
 
-			if (!plug->gameLink()) {
-				plugs[plugCount++] = plug;
+			if (!linked) {
+				_unlinkedPlugs.push_back({ plug, i, false });
 			} else {
-				linkedPlugs[linkedPlugCount++] = plug;
+				_linkedPlugs.push_back(plug);
 			}
 
-			totalPlugCount++;
-
 			if (transportChanged) {
 				HandleTransportChange(plug, _transportRunning);
 			}
@@ -98,41 +105,131 @@ void RetroPlugInstrument::ProcessBlock(sample** inputs, sample** outputs, int fr
 		}
 	}
 
-	for (size_t i = 0; i < plugCount; i++) {
-		plugs[i]->update(frameCount);
+	// Linked instances are finished as they go, along with the rest of updateMultiple
+	bool batchAudio = _unlinkedPlugs.size() >= (size_t)APU_BATCH_MIN_INSTANCES;
+	for (const ActivePlug& active : _activePlugs) {
+		bool batched = batchAudio && !active.linked;
+		active.plug->setBatchedAudio(batched);
+		if (batched) {
+			_batchedPlugs.push_back(active.plug);
+		}
+	}
+
+	LoadTimer emulateTimer;
+
+	if (quality == QualityLevel::Minimal && _workers.running() && _unlinkedPlugs.size() > 1) {
+		EVENT_SCOPE(EmulateParallel, _unlinkedPlugs.size());
+		_workers.run(_unlinkedPlugs.size(), EmulateUnlinked, this);
+	} else {
+		for (size_t i = 0; i < _unlinkedPlugs.size(); i++) {
+			EmulateUnlinked(this, i);
+		}
 	}
 
-	if (linkedPlugCount > 0) {
-		linkedPlugs[0]->updateMultiple(linkedPlugs, linkedPlugCount, frameCount);
+	// Linked instances run in lock step, so each is charged an equal share
+	double linkedShare = 0;
+	if (!_linkedPlugs.empty()) {
+		EVENT_SCOPE(EmulateLinked, _linkedPlugs.size());
+		LoadTimer timer;
+		_linkedPlugs[0]->updateMultiple(_linkedPlugs.data(), _linkedPlugs.size(), frameCount);
+		linkedShare = timer.elapsed() / _linkedPlugs.size();
+	}
+
+	if (!_batchedPlugs.empty()) {
+		EVENT_SCOPE(RenderBatchedAudio, _batchedPlugs.size());
+		LoadTimer timer;
+		_batchedPlugs[0]->renderBatchedAudio(_batchedPlugs.data(), _batchedPlugs.size(), frameCount);
+
+		double batchShare = timer.elapsed() / _batchedPlugs.size();
+		for (const ActivePlug& active : _unlinkedPlugs) {
+			_instanceTimes[active.index] += batchShare;
+		}
 	}
 
+	double emulateTime = emulateTimer.elapsed();
+	LoadTimer mixTimer;
+
 	int chanMultipler = 0;
 	if (NOutChansConnected() == 8 && _plug.audioRouting() != AudioChannelRouting::StereoMixDown) {
 		chanMultipler = 2;
 	}
 
-	for (size_t i = 0; i < totalPlugCount; i++) {
-		SameBoyPlug* plug = plugPtrs[i].get();
+	size_t outputCount = MaxNChannels(ERoute::kOutput);
+
+	for (const ActivePlug& active : _activePlugs) {
+		LoadTimer timer;
+		SameBoyPlug* plug = active.plug;
 		MessageBus* bus = plug->messageBus();
 
+		// Instances without outputs of their own are mixed in to the first pair
+		size_t channel = active.index * chanMultipler;
+		if (channel + 1 >= outputCount) {
+			channel = 0;
+		}
+
 		size_t available = bus->audio.readAvailable();
-		if (available == sampleCount) {
-			memset(_sampleScratch, 0, sampleCount * sizeof(float));
-			size_t readAmount = bus->audio.read(_sampleScratch, sampleCount);
+		if (available == sampleCount && sampleCount <= _sampleScratch.size()) {
+			memset(_sampleScratch.data(), 0, sampleCount * sizeof(float));
+			size_t readAmount = bus->audio.read(_sampleScratch.data(), sampleCount);
 			if (readAmount == sampleCount) {
 				for (size_t j = 0; j < frameCount; j++) {
-					outputs[i * chanMultipler][j] += _sampleScratch[j * 2];
-					outputs[i * chanMultipler + 1][j] += _sampleScratch[j * 2 + 1];
+					outputs[channel][j] += _sampleScratch[j * 2];
+					outputs[channel + 1][j] += _sampleScratch[j * 2 + 1];
 				}
 			}
 		}
 
 		plug->lock().unlock();
+
+		double instanceTime = (active.linked ? linkedShare : _instanceTimes[active.index]) + timer.elapsed();
+		plug->loadMeter().add(instanceTime, budget);
 	}
+
+	DspLoad& load = _plug.dspLoad();
+	load.midi.add(midiTime, budget);
+	load.emulate.add(emulateTime, budget);
+	load.mix.add(mixTimer.elapsed(), budget);
+	load.total.add(blockTimer.elapsed() + midiTime, budget);
+
+	QualityGovernor& governor = _plug.governor();
+	if (governor.update(load.total, budget)) {
+		EVENT_INFO(QualityChanged, (int64_t)governor.level(), (int64_t)(load.total.stats().average * 100));
+	}
+}
+
+void RetroPlugInstrument::EmulateUnlinked(void* context, size_t idx) {
+	RetroPlugInstrument* self = (RetroPlugInstrument*)context;
+	const ActivePlug& active = self->_unlinkedPlugs[idx];
+
+	EVENT_SCOPE(EmulateInstance, active.index);
+	LoadTimer timer;
+	active.plug->update(self->_blockFrames);
+	self->_instanceTimes[active.index] = timer.elapsed();
 }
 
 void RetroPlugInstrument::OnIdle() {
+	_plug.collectInstances();
+
+	// ROM changes are noticed on a watcher thread, but reloaded here as the ROM,
+	// kits and save path are all used by the UI without locking
+	for (const SameBoyPlugPtr& plug : *_plug.instances()) {
+		if (plug->active() && !plug->booting() && plug->romChanged()) {
+			auto start = std::chrono::steady_clock::now();
+			int banks = plug->reloadRom();
+
+			if (banks > 0) {
+				auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+				EVENT_INFO(RomReloaded, banks, (int64_t)elapsed.count());
+			}
+		}
+	}
 
+	// Threads can't be started from the audio thread.  Half the cores are left
+	// for the host and the UI, and the audio thread is a worker itself.
+	if (_plug.governor().level() == QualityLevel::Minimal && !_workers.running()) {
+		size_t threadCount = std::max(std::thread::hardware_concurrency() / 2, 2u) - 1;
+		_workers.start(std::min(threadCount, (size_t)MAX_INSTANCES - 1), GetBlockSize() / GetSampleRate());
+	}
 }
 
 bool RetroPlugInstrument::SerializeState(IByteChunk& chunk) const {
@@ -183,7 +280,7 @@ void RetroPlugInstrument::GenerateMidiClock(SameBoyPlug* plug, int frameCount, b
 void RetroPlugInstrument::HandleTransportChange(SameBoyPlug* plug, bool running) {
 	if (plug->lsdj().autoPlay) {
 		_buttonQueue.press(ButtonTypes::Start);
-		consoleLogLine("Pressing start");
+		EVENT_INFO(StartPressed);
 	}
 
 	if (!_transportRunning && plug->lsdj().found && plug->lsdj().lastRow != -1) {
@@ -225,15 +322,17 @@ void RetroPlugInstrument::ProcessSync(SameBoyPlug* plug, int sampleCount, int te
 void RetroPlugInstrument::ProcessMidiMsg(const IMidiMsg& msg) {
 	TRACE;
 
-	auto plugs = _plug.plugs();
-	size_t count = _plug.instanceCount();
+	LoadTimer timer;
+	InstanceScope instances = _plug.audioInstances();
+	const InstanceList& plugs = *instances;
+	size_t count = plugs.size();
 
 	switch (_plug.midiRouting()) {
 	case MidiChannelRouting::SendToAll: {
 		for (size_t i = 0; i < count; i++) {
-			SameBoyPlugPtr plug = plugs[i];
-			if (plug && plug->active()) {
-				ProcessInstanceMidiMessage(plug.get(), msg, msg.Channel());
+			SameBoyPlug* plug = plugs[i].get();
+			if (plug->active()) {
+				ProcessInstanceMidiMessage(plug, msg, msg.Channel());
 			}
 		}
 
@@ -241,9 +340,9 @@ void RetroPlugInstrument::ProcessMidiMsg(const IMidiMsg& msg) {
 	}
 	case MidiChannelRouting::OneChannelPerInstance: {
 		if (msg.Channel() < count) {
-			SameBoyPlugPtr plug = plugs[msg.Channel()];
-			if (plug && plug->active()) {
-				ProcessInstanceMidiMessage(plug.get(), msg, 0);
+			SameBoyPlug* plug = plugs[msg.Channel()].get();
+			if (plug->active()) {
+				ProcessInstanceMidiMessage(plug, msg, 0);
 			}
 		}
 
@@ -251,15 +350,17 @@ void RetroPlugInstrument::ProcessMidiMsg(const IMidiMsg& msg) {
 	}
 	case MidiChannelRouting::FourChannelsPerInstance: {
 		if (msg.Channel() < count * 4) {
-			SameBoyPlugPtr plug = plugs[msg.Channel() / 4];
-			if (plug && plug->active()) {
-				ProcessInstanceMidiMessage(plug.get(), msg, msg.Channel() % 4);
+			SameBoyPlug* plug = plugs[msg.Channel() / 4].get();
+			if (plug->active()) {
+				ProcessInstanceMidiMessage(plug, msg, msg.Channel() % 4);
 			}
 		}
 
 		break;
 	}
 	}
+
+	_midiTime += timer.elapsed();
 }
 
 unsigned char reverse(unsigned char b) {
@@ -411,5 +512,14 @@ void RetroPlugInstrument::ChangeLsdjInstrument(SameBoyPlug * plug, int instrumen
 
 void RetroPlugInstrument::OnReset() {
 	_plug.setSampleRate(GetSampleRate());
+
+	size_t blockSize = std::max(GetBlockSize(), MIN_BLOCK_SIZE);
+	_plug.setBlockSize(blockSize);
+	_sampleScratch.resize(blockSize * 2);
+
+	_activePlugs.reserve(MAX_INSTANCES);
+	_unlinkedPlugs.reserve(MAX_INSTANCES);
+	_linkedPlugs.reserve(MAX_INSTANCES);
+	_batchedPlugs.reserve(MAX_INSTANCES);
 }
 #endif
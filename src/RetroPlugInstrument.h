@@ -3,14 +3,33 @@
 #include "IPlug_include_in_plug_hdr.h"
 #include "plugs/RetroPlug.h"
 #include "ButtonQueue.h"
+#include "util/AudioWorkers.h"
+#include "util/EventLog.h"
+#include "util/ThreadPool.h"
 
 using namespace iplug;
 using namespace igraphics;
 
+// Keeps the process wide services running while any plugin instance exists
+struct SharedServices {
+	SharedServices() {
+		EventLog::retain();
+		ThreadPool::retain();
+	}
+
+	~SharedServices() {
+		ThreadPool::release();
+		EventLog::release();
+	}
+};
+
 class RetroPlugInstrument : public Plugin {
+private:
+	// Declared first, so everything that uses the services is gone before they stop
+	SharedServices _services;
+
 public:
 	RetroPlugInstrument(const InstanceInfo& info);
-	~RetroPlugInstrument();
 
 #if IPLUG_DSP
 public:
@@ -32,12 +51,38 @@ private:
 	void ChangeLsdjKeyboardOctave(SameBoyPlug* plug, int octave, int offset);
 	void ChangeLsdjInstrument(SameBoyPlug* plug, int instrument, int offset);
 
+	// An AudioWorkers task, emulates _unlinkedPlugs[idx]
+	static void EmulateUnlinked(void* context, size_t idx);
+
 	inline double FramesToMs(int frameCount) const { return frameCount / (GetSampleRate() / 1000); }
 
+	struct ActivePlug {
+		SameBoyPlug* plug;
+		size_t index;
+		bool linked;
+	};
+
 	RetroPlug _plug;
-	float* _sampleScratch;
+	std::vector<float> _sampleScratch;
+
+	// Scratch for ProcessBlock
+	std::vector<ActivePlug> _activePlugs;
+	std::vector<ActivePlug> _unlinkedPlugs;
+	std::vector<SameBoyPlug*> _linkedPlugs;
+	std::vector<SameBoyPlug*> _batchedPlugs;
+
+	// Seconds spent on each instance during the current block, by index
+	std::array<double, MAX_INSTANCES> _instanceTimes = {};
+
+	// Seconds spent routing MIDI since the last block.  Hosts deliver MIDI for a
+	// block before processing it, so this is added to the block that follows.
+	double _midiTime = 0;
+	size_t _blockFrames = 0;
 	bool _transportRunning = false;
 
+	// Started once the quality governor first asks for parallel emulation
+	AudioWorkers _workers;
+
 	ButtonQueue _buttonQueue;
 #endif
 };
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include "Constants.h"
+
 struct ButtonEvent {
 	size_t id;
 	bool down;
@@ -9,3 +13,14 @@ struct LinkEvent {
 	size_t offset;
 	unsigned char byte;
 };
+
+// A single frame, either as RGBA8 pixels ready to be uploaded to a texture, or
+// as palette indices that are resolved on the GPU
+struct VideoFrame {
+	bool indexed;
+	uint32_t pixels[VIDEO_PIXEL_COUNT];
+	uint8_t indices[VIDEO_PIXEL_COUNT];
+	uint32_t palette[VIDEO_PALETTE_SIZE];
+	uint64_t sequence;	// Incremented every time a frame is published
+	double timestamp;	// Time the frame was published, from getTimeMs()
+};
@@ -1,25 +1,28 @@
 #pragma once
 
 #include "RingBuffer.h"
+#include "TripleBuffer.h"
 #include "Types.h"
 #include <string>
 
 class MessageBus {
 public:
-	// Inputs
+	// Inputs.  The rings only support one writer each, so buttons pressed in the
+	// UI and those queued up by the audio thread (see ButtonQueue) are kept apart.
 	RingBuffer<ButtonEvent> buttons;
+	RingBuffer<ButtonEvent> queuedButtons;
 	RingBuffer<LinkEvent> link;
 
-	// Outputs
+	// Outputs.  Written and read by the audio thread.
 	RingBuffer<float> audio;
-	RingBuffer<char> video;
+	TripleBuffer<VideoFrame> video;
 
 	MessageBus() {}
 
-	MessageBus(size_t inputBufferSize, size_t audioBufferSize, size_t videoBufferSize) :
+	MessageBus(size_t inputBufferSize, size_t audioBufferSize) :
 		buttons(inputBufferSize), 
+		queuedButtons(inputBufferSize),
 		link(inputBufferSize), 
-		audio(audioBufferSize), 
-		video(videoBufferSize)
+		audio(audioBufferSize)
 	{}
 };
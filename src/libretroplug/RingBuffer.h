@@ -1,86 +1,144 @@
 #pragma once
 
-#include "PaRingBuffer.h"
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <memory>
+#include <string.h>
+#include <type_traits>
 
 inline bool isPowerOfTwo(size_t in) {
 	return (in & (in - 1)) == 0;
 }
 
+inline size_t nextPowerOfTwo(size_t in) {
+	size_t out = 1;
+	while (out < in) {
+		out <<= 1;
+	}
+
+	return out;
+}
+
+const size_t CACHE_LINE_SIZE = 64;
+
+// Lock free single producer/single consumer ring.  The producer and consumer each
+// own an index, and keep a copy of the other side's that is only refreshed when
+// the copy says the ring is full (or empty), so most calls don't touch the other
+// side's cache line at all.  Values are copied with memcpy.
 template <typename T>
-class RingBuffer
-{
+class RingBuffer {
+	static_assert(std::is_trivially_copyable_v<T>, "RingBuffer values are copied with memcpy");
+
 private:
-	T* mp_data;
-	PaUtilRingBuffer m_buffer;
+	// Set by init(), read only after that
+	std::unique_ptr<T[]> _data;
+	size_t _size = 0;
 
-public:
-	RingBuffer(): mp_data(nullptr) {}
-	RingBuffer(size_t size) {
-		init(size);
-	}
+	// The indices are kept apart with padding rather than alignas, so anything
+	// holding a ring can still be allocated with a plain new on older macOS
+	char _padding0[CACHE_LINE_SIZE];
 
-	~RingBuffer() {
-		if (mp_data) {
-			delete[] mp_data;
-		}
-	}
+	// Producer side
+	std::atomic<size_t> _write = 0;
+	size_t _readCache = 0;
 
-	T* data() {
-		return mp_data;
-	}
+	char _padding1[CACHE_LINE_SIZE];
+
+	// Consumer side
+	std::atomic<size_t> _read = 0;
+	size_t _writeCache = 0;
+
+	char _padding2[CACHE_LINE_SIZE];
+
+public:
+	RingBuffer() {}
+	RingBuffer(size_t size) { init(size); }
+
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
 
+	// Anything in the ring is discarded.  Neither side may be using it.
 	void init(size_t size) {
 		assert(isPowerOfTwo(size));
-		mp_data = new T[size];
-		PaUtil_InitializeRingBuffer(&m_buffer, sizeof(T), size, mp_data);
+		_data = std::make_unique<T[]>(size);
+		_size = size;
+		_write = 0;
+		_read = 0;
+		_readCache = 0;
+		_writeCache = 0;
 	}
 
-	void advanceWrite(size_t count) {
-		PaUtil_AdvanceRingBufferWriteIndex(&m_buffer, count);
-	}
+	size_t size() const { return _size; }
 
-	void advanceRead(size_t count) {
-		PaUtil_AdvanceRingBufferReadIndex(&m_buffer, count);
-	}
+	// Producer side
 
 	size_t writeAvailable() {
-		return PaUtil_GetRingBufferWriteAvailable(&m_buffer);
+		_readCache = _read.load(std::memory_order_acquire);
+		return _size - (_write.load(std::memory_order_relaxed) - _readCache);
 	}
 
-	size_t readAvailable() {
-		return PaUtil_GetRingBufferReadAvailable(&m_buffer);
+	// Writes all of the values or none of them
+	bool write(const T* values, size_t count) {
+		size_t write = _write.load(std::memory_order_relaxed);
+		if (_size - (write - _readCache) < count) {
+			_readCache = _read.load(std::memory_order_acquire);
+			if (_size - (write - _readCache) < count) {
+				return false;
+			}
+		}
+
+		copyIn(write, values, count);
+		_write.store(write + count, std::memory_order_release);
+		return true;
 	}
 
-	void clear() {
-		PaUtil_FlushRingBuffer(&m_buffer);
+	bool writeValue(const T& value) {
+		return write(&value, 1);
 	}
 
-	bool writeValue(const T& v) {
-		return PaUtil_WriteRingBuffer(&m_buffer, &v, 1) == 1;
+	// Consumer side
+
+	size_t readAvailable() {
+		_writeCache = _write.load(std::memory_order_acquire);
+		return _writeCache - _read.load(std::memory_order_relaxed);
 	}
 
-	bool write(const T* v, size_t count) {
-		return PaUtil_WriteRingBuffer(&m_buffer, v, count) == 1;
+	// Reads up to count values, returning how many were read
+	size_t read(T* values, size_t count) {
+		size_t read = _read.load(std::memory_order_relaxed);
+		if (_writeCache - read < count) {
+			_writeCache = _write.load(std::memory_order_acquire);
+			count = std::min(count, _writeCache - read);
+		}
+
+		copyOut(values, read, count);
+		_read.store(read + count, std::memory_order_release);
+		return count;
 	}
 
-	bool readValue(T& v) {
-		PaUtil_ReadRingBuffer(&m_buffer, &v, 1);
-		return true;
+	bool readValue(T& value) {
+		return read(&value, 1) == 1;
 	}
 
 	T readValue() {
-		T ret; readValue(ret);
+		T ret = {}; readValue(ret);
 		return ret;
 	}
 
-	size_t read(T* v) {
-		return PaUtil_ReadRingBuffer(&m_buffer, v, readAvailable());
+private:
+	// Copies in at most two pieces, either side of the end of the ring
+	void copyIn(size_t index, const T* values, size_t count) {
+		size_t offset = index & (_size - 1);
+		size_t first = std::min(count, _size - offset);
+		memcpy(_data.get() + offset, values, first * sizeof(T));
+		memcpy(_data.get(), values + first, (count - first) * sizeof(T));
 	}
 
-	size_t read(T* v, size_t count) {
-		size_t available = readAvailable();
-		if (available < count) count = available;
-		return PaUtil_ReadRingBuffer(&m_buffer, v, count);
+	void copyOut(T* values, size_t index, size_t count) {
+		size_t offset = index & (_size - 1);
+		size_t first = std::min(count, _size - offset);
+		memcpy(values, _data.get() + offset, first * sizeof(T));
+		memcpy(values + first, _data.get(), (count - first) * sizeof(T));
 	}
 };
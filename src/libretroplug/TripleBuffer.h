@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// Lock free single producer/single consumer triple buffer.  The producer always
+// has a buffer to write in to, and the consumer always reads the most recently
+// published buffer.  Intermediate buffers that are never consumed are dropped.
+template <typename T>
+class TripleBuffer {
+private:
+	static const uint8_t INDEX_MASK = 0x03;
+	static const uint8_t DIRTY_BIT = 0x04;
+
+	T _buffers[3];
+
+	// Index of the buffer that sits between the producer and consumer, plus a
+	// flag that is set when it contains data the consumer hasn't seen yet.
+	std::atomic<uint8_t> _middle = 0;
+
+	uint8_t _back = 1;
+	uint8_t _front = 2;
+
+public:
+	TripleBuffer() {}
+
+	// Producer side
+
+	T& writeBuffer() {
+		return _buffers[_back];
+	}
+
+	void publish() {
+		_back = _middle.exchange(_back | DIRTY_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	// Consumer side
+
+	bool consume() {
+		if ((_middle.load(std::memory_order_relaxed) & DIRTY_BIT) == 0) {
+			return false;
+		}
+
+		_front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+
+	const T& readBuffer() const {
+		return _buffers[_front];
+	}
+};
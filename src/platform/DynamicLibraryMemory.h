@@ -2,6 +2,7 @@
 
 #include <windows.h>
 #include <string>
+#include <vector>
 #include <assert.h>
 //#include "error.h"
 #include "resource.h"
@@ -27,6 +28,7 @@ static HINSTANCE GetHInstance()
 class DynamicLibraryMemory {
 private:
 	HMEMORYMODULE _handle = nullptr;
+	std::vector<std::string> _missing;
 
 public:
 	DynamicLibraryMemory() {}
@@ -52,9 +54,9 @@ public:
 
 	template <typename T>
 	T get(const std::string& name) {
-		T ptr = (T)MemoryGetProcAddress(_handle, (LPCSTR)name.c_str());
+		T ptr = _handle ? (T)MemoryGetProcAddress(_handle, (LPCSTR)name.c_str()) : nullptr;
 		if (!ptr) {
-			//ErrorExit((LPTSTR)TEXT("DLL"));
+			_missing.push_back(name);
 		}
 
 		return ptr;
@@ -65,6 +67,9 @@ public:
 		target = get<T>(name);
 	}
 
+	// Everything get() failed to find, which is everything if the library didn't load
+	const std::vector<std::string>& missing() const { return _missing; }
+
 	void close() {
 		if (_handle) {
 			MemoryFreeLibrary(_handle);
@@ -2,10 +2,18 @@
 
 #include <string>
 #include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "plugs/SameBoyPlug.h"
 #include "util/xstring.h"
 #include "util/fs.h"
+#include "util/LoadMeter.h"
+#include "util/QualityGovernor.h"
+#include "util/Rcu.h"
+#include "util/ThreadPool.h"
 #include "Constants.h"
 
 enum class InstanceLayout {
@@ -31,9 +39,18 @@ enum class MidiChannelRouting {
 	OneChannelPerInstance
 };
 
+// Instances in the order they're shown, routed and saved.  A published list is
+// never modified - adding or removing an instance publishes a new copy, so the
+// audio thread can keep using the list it loaded for the rest of a block.
+using InstanceList = std::vector<SameBoyPlugPtr>;
+using InstanceListPtr = std::shared_ptr<const InstanceList>;
+using InstanceScope = Rcu<InstanceList>::ReadScope;
+
 class RetroPlug {
 private:
-	SameBoyPlugPtr _plugs[MAX_INSTANCES];
+	// Lists (and the instances only they hold) are always freed off the audio
+	// thread, by collectInstances() or the next change to the list
+	Rcu<InstanceList> _instances { std::make_shared<const InstanceList>() };
 	tstring _projectPath;
 	InstanceLayout _layout = InstanceLayout::Auto;
 	SaveStateType _saveType = SaveStateType::Sram;
@@ -42,9 +59,22 @@ private:
 	std::atomic<MidiChannelRouting> _midiRouting = MidiChannelRouting::SendToAll;
 
 	double _sampleRate = 48000;
+	size_t _blockSize = MIN_BLOCK_SIZE;
+
+	DspLoad _dspLoad;
+	QualityGovernor _governor;
+
+	// Cores can be replaced from more than one thread
+	std::mutex _linkLock;
+
+	mutable std::mutex _bootLock;
+	mutable std::condition_variable _bootDone;
+	size_t _bootsPending = 0;
+	std::atomic<bool> _bootsFinished = false;
+
 public:
 	RetroPlug() {}
-	~RetroPlug() {}
+	~RetroPlug() { waitForBoots(); }
 
 	InstanceLayout layout() const { return _layout; }
 
@@ -58,15 +88,30 @@ public:
 
 	void setMidiRouting(MidiChannelRouting mode) { _midiRouting = mode; }
 
+	// Written by the audio thread every block
+	DspLoad& dspLoad() { return _dspLoad; }
+
+	const DspLoad& dspLoad() const { return _dspLoad; }
+
+	QualityGovernor& governor() { return _governor; }
+
+	const QualityGovernor& governor() const { return _governor; }
+
+	// Clears the block meters and those of every instance
+	void resetDspLoad() {
+		_dspLoad.reset();
+		for (const SameBoyPlugPtr& plug : *instances()) {
+			plug->loadMeter().reset();
+		}
+	}
+
 	SaveStateType saveType() const { return _saveType; }
 
 	void setSaveType(SaveStateType type) { _saveType = type; }
 
 	void clear() {
 		_projectPath.clear();
-		for (size_t i = 0; i < MAX_INSTANCES; i++) {
-			_plugs[i] = nullptr;
-		}
+		_instances.publish(std::make_shared<const InstanceList>());
 	}
 
 	const tstring& projectPath() const {
@@ -77,54 +122,115 @@ public:
 		_projectPath = path;
 	}
 
+	// Returns null if there are already MAX_INSTANCES instances
 	SameBoyPlugPtr addInstance(EmulatorType emulatorType) {
 		SameBoyPlugPtr plug = std::make_shared<SameBoyPlug>();
 		plug->setSampleRate(_sampleRate);
-
-		for (size_t i = 0; i < MAX_INSTANCES; i++) {
-			if (!_plugs[i]) {
-				_plugs[i] = plug;
-				break;
+		plug->setBlockSize(_blockSize);
+		plug->setCoreReplacedHandler([this]() { updateLinkTargets(); });
+
+		bool added = false;
+		_instances.update([&](InstanceList& instances) {
+			if (instances.size() < MAX_INSTANCES) {
+				instances.push_back(plug);
+				added = true;
 			}
-		}
+		});
 
-		return plug;
+		return added ? plug : nullptr;
 	}
 
-	void removeInstance(size_t idx) {
-		for (size_t i = idx; i < MAX_INSTANCES - 1; i++) {
-			_plugs[i] = _plugs[i + 1];
+	// Runs init() for the instance on the shared thread pool, so restoring a
+	// project doesn't hold up the host.  The instance reports booting() until it's
+	// done.  Boots start in the order they are queued.
+	void bootInstance(SameBoyPlugPtr plug, const tstring& romPath, GameboyModel model) {
+		plug->setRomPath(romPath);
+		plug->setBooting(true);
+
+		{
+			std::scoped_lock lock(_bootLock);
+			_bootsPending++;
 		}
 
-		_plugs[MAX_INSTANCES - 1] = nullptr;
+		ThreadPool::shared().enqueue([this, plug, romPath, model]() {
+			if (fs::exists(romPath)) {
+				plug->init(romPath, model, true);
+			}
+
+			plug->setBooting(false);
+
+			// Nothing may touch this once the lock is released, the destructor
+			// could be waiting on it
+			std::scoped_lock lock(_bootLock);
+			if (--_bootsPending == 0) {
+				_bootsFinished = true;
+				_bootDone.notify_all();
+			}
+		});
 	}
 
-	size_t instanceCount() const {
-		for (size_t i = 0; i < MAX_INSTANCES; i++) {
-			if (!_plugs[i]) {
-				return i;
+	// Returns true once after the last queued boot has finished
+	bool takeBootsFinished() {
+		return _bootsFinished.exchange(false);
+	}
+
+	void waitForBoots() const {
+		std::unique_lock lock(_bootLock);
+		_bootDone.wait(lock, [this]() { return _bootsPending == 0; });
+	}
+
+	// Instances after the removed one move down a place
+	void removeInstance(size_t idx) {
+		_instances.update([idx](InstanceList& instances) {
+			if (idx < instances.size()) {
+				instances.erase(instances.begin() + idx);
 			}
-		}
+		});
+	}
+
+	size_t instanceCount() const {
+		return instances()->size();
+	}
+
+	// Safe to call from any thread but the audio thread, which uses
+	// audioInstances() instead
+	InstanceListPtr instances() const {
+		return _instances.get();
+	}
+
+	// The list as the audio thread sees it, without touching any reference counts.
+	// Everything in it stays alive until the scope is left.
+	InstanceScope audioInstances() const {
+		return InstanceScope(_instances);
+	}
 
-		return 4;
+	// Frees lists (and instances) that the audio thread has finished with
+	void collectInstances() {
+		_instances.collect();
 	}
 
 	void getLinkTargets(std::vector<SameBoyPlugPtr>& targets, SameBoyPlugPtr ignore) {
-		for (size_t i = 0; i < MAX_INSTANCES; i++) {
-			if (_plugs[i] && _plugs[i] != ignore && _plugs[i]->active() && _plugs[i]->gameLink()) {
-				targets.push_back(_plugs[i]);
+		for (const SameBoyPlugPtr& plug : *instances()) {
+			if (plug != ignore && plug->active() && plug->gameLink()) {
+				targets.push_back(plug);
 			}
 		}
 	}
 
+	// Rebuilds the targets of every running instance, so none are left pointing at
+	// a core that has been replaced.  Can be called from any thread but the audio
+	// thread.
 	void updateLinkTargets() {
-		size_t count = instanceCount();
+		std::scoped_lock lock(_linkLock);
+
 		std::vector<SameBoyPlugPtr> targets;
-		for (size_t i = 0; i < count; i++) {
-			auto target = _plugs[i];
-			if (target->active() && target->gameLink()) {
+		for (const SameBoyPlugPtr& target : *instances()) {
+			if (target->active()) {
 				targets.clear();
-				getLinkTargets(targets, target);
+				if (target->gameLink()) {
+					getLinkTargets(targets, target);
+				}
+
 				target->setLinkTargets(targets);
 			}
 		}
@@ -133,23 +239,23 @@ public:
 	void setSampleRate(double sampleRate) {
 		_sampleRate = sampleRate;
 
-		for (size_t i = 0; i < MAX_INSTANCES; i++) {
-			SameBoyPlugPtr plugPtr = _plugs[i];
-			if (plugPtr) {
-				plugPtr->setSampleRate(sampleRate);
-			}
+		for (const SameBoyPlugPtr& plug : *instances()) {
+			plug->setSampleRate(sampleRate);
 		}
 	}
 
-	SameBoyPlugPtr getPlug(size_t idx) {
-		return _plugs[idx];
-	}
+	// Must not be called while the audio thread is processing
+	void setBlockSize(size_t frames) {
+		_blockSize = frames;
 
-	SameBoyPlugPtr* plugs() {
-		return _plugs;
+		for (const SameBoyPlugPtr& plug : *instances()) {
+			plug->setBlockSize(frames);
+		}
 	}
 
-	const SameBoyPlugPtr* plugs() const {
-		return _plugs;
+	// Returns null if there is no instance at idx
+	SameBoyPlugPtr getPlug(size_t idx) const {
+		InstanceListPtr current = instances();
+		return idx < current->size() ? (*current)[idx] : nullptr;
 	}
 };
@@ -19,13 +19,14 @@
 #endif
 
 #include "resource.h"
+#include "util/BootStateCache.h"
 #include "util/File.h"
+#include "util/RomWatcher.h"
+#include "util/Timing.h"
 #include "lsdj/rom.h"
 #include "lsdj/kit.h"
 #include "lsdj/sample.h"
 
-const int FRAME_SIZE = 160 * 144 * 4;
-
 int getGameboyModel(GameboyModel model) {
 	switch (model) {
 	case GameboyModel::DmgB: return 0x002;
@@ -38,31 +39,57 @@ int getGameboyModel(GameboyModel model) {
 }
 
 SameBoyPlug::SameBoyPlug() {
-	// FIXME: Choose some better sizes here...
-	_bus.audio.init(1024 * 1024);
-	_bus.video.init(1024 * 1024);
+	setBlockSize(MIN_BLOCK_SIZE);
 	_bus.buttons.init(64);
+	_bus.queuedButtons.init(64);
 	_bus.link.init(64);
+
+	_linkedInstances.reserve(MAX_INSTANCES);
+}
+
+SameBoyPlug::~SameBoyPlug() {
+	shutdown();
+}
+
+void SameBoyPlug::setWatchRom(bool watch) {
+	_watchRom = watch;
+	_romWatcher = nullptr;
+
+	if (watch && !_romPath.empty()) {
+		_romWatcher = std::make_unique<RomWatcher>(_romPath);
+	}
+}
+
+bool SameBoyPlug::romChanged() {
+	return _romWatcher && _romWatcher->takeChanged();
 }
 
 void SameBoyPlug::init(const tstring& romPath, GameboyModel model, bool fastBoot) {
 	_romPath = romPath;
 	_model = model;
 
-	_romData.clear();
-	if (!readFile(romPath, _romData)) {
-		return;
+	if (_watchRom && (!_romWatcher || _romWatcher->path() != romPath)) {
+		setWatchRom(true);
 	}
 
-	if (fastBoot) {
-		_resetSamples = (int)(_sampleRate / 2);
+	RomImagePtr rom = RomCache::shared().load(romPath);
+	if (!rom) {
+		return;
 	}
 
-	void* instance = SAMEBOY_SYMBOLS(sameboy_init)(this, (const char*)_romData.data(), _romData.size(), getGameboyModel(model), fastBoot);
+	// The core reads the shared image in place, so it's kept alive for as long as
+	// the instance is
+	void* instance = SAMEBOY_SYMBOLS(sameboy_init)(this, (const char*)rom->data.data(), rom->data.size(), getGameboyModel(model), fastBoot, true);
 	if (!instance) {
 		return;
 	}
 
+	// Audio is only muted while the boot ROM plays, which it doesn't if a state
+	// from after it finished can be used instead
+	if (fastBoot) {
+		_resetSamples = skipBootRom(instance, rom->hash, model) ? 0 : (int)(_sampleRate / 2);
+	}
+
 	const char* name = SAMEBOY_SYMBOLS(sameboy_get_rom_name)(instance);
 	for (int i = 0; i < 16; i++) {
 		if (name[i] == 0) {
@@ -109,7 +136,7 @@ void SameBoyPlug::init(const tstring& romPath, GameboyModel model, bool fastBoot
 			SAMEBOY_SYMBOLS(sameboy_load_state)(instance, (const char*)_saveData.data(), _saveData.size());
 			break;
 		case SaveStateType::Sram:
-			SAMEBOY_SYMBOLS(sameboy_load_battery)(instance, (const char*)saveData.data(), saveData.size());
+			SAMEBOY_SYMBOLS(sameboy_load_battery)(instance, (const char*)_saveData.data(), _saveData.size());
 			break;
 		}
 
@@ -123,19 +150,95 @@ void SameBoyPlug::init(const tstring& romPath, GameboyModel model, bool fastBoot
 	if (_lsdj.found) {
 		_lsdj.version = _romName.substr(5, 6);
 		_lsdj.saveData = saveData;
-		_lsdj.loadRom(_romData);
+		_lsdj.loadRom(rom->data);
+	}
+
+	// Kits from a project are patched in before anything can hear the instance
+	std::vector<std::byte> romData;
+	if (_hasPendingKits) {
+		if (_lsdj.found) {
+			_lsdj.kitData = std::move(_pendingKits);
+			if (!_lsdj.kitsMatch(rom->data)) {
+				romData = rom->data;
+				_lsdj.patchKits(romData);
+				SAMEBOY_SYMBOLS(sameboy_update_rom)(instance, (const char*)romData.data(), romData.size());
+			}
+		}
+
+		_pendingKits.clear();
+		_hasPendingKits = false;
 	}
 
 	SAMEBOY_SYMBOLS(sameboy_set_sample_rate)(instance, _sampleRate);
+	SAMEBOY_SYMBOLS(sameboy_set_block_size)(instance, _blockSize);
+
+	// The audio thread holds the lock while it runs the instance, so the old one
+	// (and the ROM it reads from) can safely go once it has been swapped out
+	void* oldInstance = nullptr;
+	RomImagePtr oldRom;
+	{
+		std::scoped_lock lock(_lock);
+		oldInstance = _instance;
+		oldRom = std::move(_rom);
+		_instance = instance;
+		_rom = rom;
+		_romData = std::move(romData);
+		_highpassDisabled = false;
+		_batchedAudio = false;
+	}
+
+	// Linked instances may still be sending serial data to the old core, so they
+	// have to be pointed at the new one before it's freed
+	if (_coreReplaced) {
+		_coreReplaced();
+	}
+
+	if (oldInstance) {
+		SAMEBOY_SYMBOLS(sameboy_free)(oldInstance);
+	}
+}
+
+bool SameBoyPlug::skipBootRom(void* instance, uint64_t romHash, GameboyModel model) {
+	int modelId = getGameboyModel(model);
+	BootStatePtr state = BootStateCache::shared().find(romHash, modelId);
+	if (state) {
+		SAMEBOY_SYMBOLS(sameboy_load_boot_state)(instance, (const char*)state->data(), state->size());
+		return true;
+	}
+
+	if (!SAMEBOY_SYMBOLS(sameboy_run_boot_rom)(instance)) {
+		return false;
+	}
+
+	std::vector<std::byte> captured(SAMEBOY_SYMBOLS(sameboy_save_state_size)(instance));
+	SAMEBOY_SYMBOLS(sameboy_save_state)(instance, (char*)captured.data(), captured.size());
+	BootStateCache::shared().insert(romHash, modelId, std::move(captured));
+
+	return true;
+}
 
-	_instance = instance;
+void SameBoyPlug::resetInstance(bool fast) {
+	int modelId = getGameboyModel(_model);
+	SAMEBOY_SYMBOLS(sameboy_reset)(_instance, modelId, fast);
+
+	// Only a state that's already cached is used here.  Running the boot ROM
+	// would hold the lock (and the audio thread) for too long.
+	if (fast && _rom) {
+		BootStatePtr state = BootStateCache::shared().find(_rom->hash, modelId);
+		if (state) {
+			SAMEBOY_SYMBOLS(sameboy_load_boot_state)(_instance, (const char*)state->data(), state->size());
+			_resetSamples = 0;
+			return;
+		}
+	}
+
+	_resetSamples = (int)(_sampleRate / 2);
 }
 
 void SameBoyPlug::reset(GameboyModel model, bool fast) {
 	_model = model;
-	_resetSamples = (int)(_sampleRate / 2);
 	std::scoped_lock lock(_lock);
-	SAMEBOY_SYMBOLS(sameboy_reset)(_instance, getGameboyModel(model), fast);
+	resetInstance(fast);
 }
 
 void SameBoyPlug::setSampleRate(double sampleRate) {
@@ -147,6 +250,28 @@ void SameBoyPlug::setSampleRate(double sampleRate) {
 	}
 }
 
+void SameBoyPlug::setBlockSize(size_t frames) {
+	frames = std::max(frames, (size_t)MIN_BLOCK_SIZE);
+	if (frames == _blockSize) {
+		return;
+	}
+
+	// Audio is written and read within the same block, so there's never more than
+	// one block of stereo frames in the buffer.  Keeping it that small means the
+	// audio thread cycles through a few KB of memory rather than megabytes.
+	std::scoped_lock lock(_lock);
+	_blockSize = frames;
+	_bus.audio.init(nextPowerOfTwo(frames * 2 * 2));
+
+	// The core can return up to twice the frames it was asked for
+	_audioScratch.resize(frames * 2 * 2);
+	_floatScratch.resize(frames * 2 * 2);
+
+	if (_instance) {
+		SAMEBOY_SYMBOLS(sameboy_set_block_size)(_instance, frames);
+	}
+}
+
 size_t SameBoyPlug::saveStateSize() {
 	return SAMEBOY_SYMBOLS(sameboy_save_state_size)(_instance);
 }
@@ -186,6 +311,24 @@ bool SameBoyPlug::saveBattery(std::byte* data, size_t size) {
 	return SAMEBOY_SYMBOLS(sameboy_save_battery)(_instance, (char*)data, size);
 }
 
+bool SameBoyPlug::readBattery(size_t offset, std::byte* data, size_t size) {
+	std::scoped_lock lock(_lock);
+	return SAMEBOY_SYMBOLS(sameboy_read_battery)(_instance, offset, (char*)data, size) == size;
+}
+
+bool SameBoyPlug::writeBattery(size_t offset, const std::byte* data, size_t size, bool reset) {
+	std::scoped_lock lock(_lock);
+	if (SAMEBOY_SYMBOLS(sameboy_write_battery)(_instance, offset, (const char*)data, size) != size) {
+		return false;
+	}
+
+	if (reset) {
+		resetInstance(true);
+	}
+
+	return true;
+}
+
 bool SameBoyPlug::loadBattery(const tstring& path, bool reset) {
 	std::vector<std::byte> data;
 	if (!readFile(path, data)) {
@@ -206,8 +349,7 @@ bool SameBoyPlug::loadBattery(const std::byte* data, size_t size, bool reset) {
 		SAMEBOY_SYMBOLS(sameboy_load_battery)(_instance, (char*)data, size);
 
 		if (reset) {
-			_resetSamples = (int)(_sampleRate / 2);
-			SAMEBOY_SYMBOLS(sameboy_reset)(_instance, getGameboyModel(_model), true);
+			resetInstance(true);
 		}
 	} else {
 		_saveData.resize(size);
@@ -228,8 +370,7 @@ bool SameBoyPlug::clearBattery(bool reset) {
 	_savePath = T("");
 
 	if (reset) {
-		_resetSamples = (int)(_sampleRate / 2);
-		SAMEBOY_SYMBOLS(sameboy_reset)(_instance, getGameboyModel(_model), true);
+		resetInstance(true);
 	}
 
 	return true;
@@ -265,17 +406,25 @@ void SameBoyPlug::loadState(const std::byte* source, size_t size) {
 
 void SameBoyPlug::setSetting(const std::string& name, int value) {
 	std::scoped_lock lock(_lock);
+	if (name == "High-pass Filter") {
+		// Applied when the quality governor gives the filter back
+		_highpassMode = value;
+		if (_highpassDisabled) {
+			return;
+		}
+	}
+
 	SAMEBOY_SYMBOLS(sameboy_set_setting)(_instance, name.c_str(), value);
 }
 
 void SameBoyPlug::setLinkTargets(std::vector<SameBoyPlugPtr> linkTargets) {
-	void* instances[MAX_INSTANCES];
+	std::vector<void*> instances(linkTargets.size());
 	for (size_t i = 0; i < linkTargets.size(); i++) {
 		instances[i] = linkTargets[i]->instance();
 	}
 
 	std::scoped_lock lock(_lock);
-	SAMEBOY_SYMBOLS(sameboy_set_link_targets)(_instance, instances, linkTargets.size());
+	SAMEBOY_SYMBOLS(sameboy_set_link_targets)(_instance, instances.data(), instances.size());
 }
 
 void SameBoyPlug::sendKeyboardByte(int offset, char byte) {
@@ -295,19 +444,44 @@ void SameBoyPlug::sendMidiBytes(int offset, const char* bytes, size_t count) {
 
 // This is called from the audio thread
 void SameBoyPlug::update(size_t audioFrames) {
+	applyQuality();
 	updateButtons();
 	SAMEBOY_SYMBOLS(sameboy_update)(_instance, audioFrames);
-	updateAV(audioFrames);
+
+	if (!_batchedAudio) {
+		updateAV(audioFrames);
+	}
 }
 
 void SameBoyPlug::updateMultiple(SameBoyPlug** plugs, size_t plugCount, size_t audioFrames) {
-	void* instances[MAX_INSTANCES];
+	_linkedInstances.clear();
 	for (size_t i = 0; i < plugCount; i++) {
-		instances[i] = plugs[i]->instance();
+		_linkedInstances.push_back(plugs[i]->instance());
+		plugs[i]->applyQuality();
 		plugs[i]->updateButtons();
 	}
 
-	SAMEBOY_SYMBOLS(sameboy_update_multiple)(instances, plugCount, audioFrames);
+	SAMEBOY_SYMBOLS(sameboy_update_multiple)(_linkedInstances.data(), plugCount, audioFrames);
+
+	for (size_t i = 0; i < plugCount; i++) {
+		plugs[i]->updateAV(audioFrames);
+	}
+}
+
+void SameBoyPlug::setBatchedAudio(bool batched) {
+	if (batched != _batchedAudio) {
+		_batchedAudio = batched;
+		SAMEBOY_SYMBOLS(sameboy_set_audio_capture)(_instance, batched);
+	}
+}
+
+void SameBoyPlug::renderBatchedAudio(SameBoyPlug** plugs, size_t plugCount, size_t audioFrames) {
+	_linkedInstances.clear();
+	for (size_t i = 0; i < plugCount; i++) {
+		_linkedInstances.push_back(plugs[i]->instance());
+	}
+
+	SAMEBOY_SYMBOLS(sameboy_render_captured_audio)(_linkedInstances.data(), plugCount);
 
 	for (size_t i = 0; i < plugCount; i++) {
 		plugs[i]->updateAV(audioFrames);
@@ -321,37 +495,171 @@ void SameBoyPlug::disableRendering(bool disable) {
 
 void SameBoyPlug::updateRom() {
 	std::scoped_lock lock(_lock);
-	SAMEBOY_SYMBOLS(sameboy_update_rom)(_instance, (const char*)_romData.data(), _romData.size());
+	const std::vector<std::byte>& data = rom();
+	SAMEBOY_SYMBOLS(sameboy_update_rom)(_instance, (const char*)data.data(), data.size());
+}
+
+int SameBoyPlug::reloadRom() {
+	// Files with the same contents load as the same image, so a save that didn't
+	// change anything stops here
+	RomImagePtr rom = RomCache::shared().load(_romPath);
+	if (!rom) {
+		return -1;
+	}
+
+	if (rom == _rom) {
+		return 0;
+	}
+
+	const std::vector<std::byte>& data = rom->data;
+
+	if (!_rom || data.size() != _rom->data.size()) {
+		// init() puts back any kits this instance had patched in
+		if (_lsdj.found && !_romData.empty()) {
+			setPendingKits(_lsdj.kitData);
+		}
+
+		std::vector<std::byte> state;
+		saveState(state);
+		init(_romPath, _model, true);
+		loadState(state);
+		disableRendering(false);
+
+		return (int)((data.size() + BANK_SIZE - 1) / BANK_SIZE);
+	}
+
+	// Compared with the file as it was last loaded rather than with rom(), so kits
+	// patched in to this instance don't count as changes
+	RomImagePtr previous = _rom;
+	std::vector<int> banks;
+	for (size_t offset = 0; offset < data.size(); offset += BANK_SIZE) {
+		size_t size = std::min((size_t)BANK_SIZE, data.size() - offset);
+		if (memcmp(previous->data.data() + offset, data.data() + offset, size) != 0) {
+			banks.push_back((int)(offset / BANK_SIZE));
+		}
+	}
+
+	// Kits from the new file are only picked up if this instance hadn't patched in
+	// kits of its own.  Those are kept, and put back over the new image.
+	std::vector<std::byte> romData;
+	std::vector<int> kitBanks;
+	if (_lsdj.found) {
+		if (_romData.empty()) {
+			_lsdj.loadRom(data);
+		} else if (!_lsdj.kitsMatch(data)) {
+			romData = data;
+			kitBanks = _lsdj.patchKits(romData);
+		}
+	}
+
+	{
+		std::scoped_lock lock(_lock);
+		for (int bank : banks) {
+			size_t offset = (size_t)bank * BANK_SIZE;
+			size_t size = std::min((size_t)BANK_SIZE, data.size() - offset);
+			SAMEBOY_SYMBOLS(sameboy_patch_rom)(_instance, offset, (const char*)data.data() + offset, size);
+		}
+
+		for (int bank : kitBanks) {
+			size_t offset = (size_t)bank * BANK_SIZE;
+			SAMEBOY_SYMBOLS(sameboy_patch_rom)(_instance, offset, (const char*)romData.data() + offset, BANK_SIZE);
+		}
+
+		_rom = rom;
+		_romData = std::move(romData);
+	}
+
+	return (int)banks.size();
+}
+
+void SameBoyPlug::updateRomBanks(const std::vector<int>& banks) {
+	if (banks.empty()) {
+		return;
+	}
+
+	std::scoped_lock lock(_lock);
+	const std::vector<std::byte>& data = rom();
+	for (int bank : banks) {
+		size_t offset = (size_t)bank * BANK_SIZE;
+		if (offset + BANK_SIZE <= data.size()) {
+			SAMEBOY_SYMBOLS(sameboy_patch_rom)(_instance, offset, (const char*)data.data() + offset, BANK_SIZE);
+		}
+	}
+}
+
+void SameBoyPlug::applyQuality() {
+	bool disableHighpass = _quality == QualityLevel::Minimal;
+	if (disableHighpass != _highpassDisabled) {
+		_highpassDisabled = disableHighpass;
+		SAMEBOY_SYMBOLS(sameboy_set_setting)(_instance, "High-pass Filter", disableHighpass ? 0 : _highpassMode.load());
+	}
+}
+
+int SameBoyPlug::frameInterval() const {
+	switch (_quality) {
+	case QualityLevel::Reduced: return 2;
+	case QualityLevel::Minimal: return 4;
+	default: return 1;
+	}
 }
 
 void SameBoyPlug::updateButtons() {
-	while (_bus.buttons.readAvailable()) {
-		auto ev = _bus.buttons.readValue();
+	ButtonEvent ev;
+	while (_bus.buttons.readValue(ev)) {
+		SAMEBOY_SYMBOLS(sameboy_set_button)(_instance, ev.id, ev.down);
+	}
+
+	while (_bus.queuedButtons.readValue(ev)) {
 		SAMEBOY_SYMBOLS(sameboy_set_button)(_instance, ev.id, ev.down);
 	}
 }
 
 void SameBoyPlug::updateAV(int audioFrames) {
-	int16_t audio[1024 * 4]; // FIXME: Choose a realistic size for this...
-	char video[FRAME_SIZE];
-
+	int16_t* audio = _audioScratch.data();
 	int sampleCount = audioFrames * 2;
 
 	SAMEBOY_SYMBOLS(sameboy_fetch_audio)(_instance, audio);
-	size_t videoAvailable = SAMEBOY_SYMBOLS(sameboy_fetch_video)(_instance, (uint32_t*)video);
 
-	if (videoAvailable > 0 && _bus.video.writeAvailable() >= FRAME_SIZE) {
-		_bus.video.write(video, FRAME_SIZE);
+	// The core writes the finished frame directly in to the back buffer, which is
+	// then handed over to the UI without any further copies.  Nothing is copied if
+	// there is no view to display it, or if the frame hasn't changed.
+	// Below full quality frames are thinned out by not fetching them at all.  The
+	// first frame the core finishes once one is due is sent.
+	_videoElapsed += audioFrames;
+	bool frameDue = _videoElapsed >= (frameInterval() - 1) * _sampleRate / GAMEBOY_FRAME_RATE;
+
+	if (_viewAttached.load(std::memory_order_relaxed) && (frameDue || _videoRefresh.load(std::memory_order_relaxed))) {
+		bool force = _videoRefresh.load(std::memory_order_relaxed);
+		if (force) {
+			_videoRefresh = false;
+		}
+
+		VideoFrame& frame = _bus.video.writeBuffer();
+		int fetched = -1;
+		if (_indexedVideo.load(std::memory_order_relaxed)) {
+			fetched = SAMEBOY_SYMBOLS(sameboy_fetch_indexed_video)(_instance, frame.indices, frame.palette, force);
+			frame.indexed = true;
+		}
+
+		if (fetched == -1) {
+			fetched = (int)SAMEBOY_SYMBOLS(sameboy_fetch_video)(_instance, frame.pixels, force);
+			frame.indexed = false;
+		}
+
+		if (fetched > 0) {
+			_videoElapsed = 0;
+			frame.sequence = ++_frameSequence;
+			frame.timestamp = getTimeMs();
+			_bus.video.publish();
+		}
 	}
 
 	if (_resetSamples <= 0) {
 		// Convert to float
-		float inputFloat[1024 * 4]; // FIXME: Choose a realistic size for this...
+		float* inputFloat = _floatScratch.data();
 		ma_pcm_s16_to_f32(inputFloat, audio, sampleCount, ma_dither_mode_triangle);
 
-		if (_bus.audio.writeAvailable() >= sampleCount) {
-			_bus.audio.write(inputFloat, sampleCount);
-		}
+		_bus.audio.write(inputFloat, sampleCount);
 	} else {
 		_resetSamples -= audioFrames;
 	}
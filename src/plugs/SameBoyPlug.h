@@ -2,9 +2,13 @@
 
 #include "libretroplug/MessageBus.h"
 #include "roms/Lsdj.h"
+#include "util/LoadMeter.h"
+#include "util/QualityGovernor.h"
+#include "util/RomCache.h"
 #include "util/xstring.h"
 #include <mutex>
 #include <atomic>
+#include <functional>
 #include <vector>
 
 enum class GameboyModel {
@@ -23,12 +27,16 @@ enum class SaveStateType {
 	State	
 };
 
+class RomWatcher;
+
 class SameBoyPlug;
 using SameBoyPlugPtr = std::shared_ptr<SameBoyPlug>;
 
 class SameBoyPlug {
 private:
-	void* _instance = nullptr;
+	// Read by the audio thread without taking the lock, to skip instances that
+	// aren't running yet
+	std::atomic<void*> _instance = nullptr;
 
 	tstring _romPath;
 	tstring _savePath;
@@ -39,30 +47,91 @@ private:
 	std::mutex _lock;
 	std::atomic<bool> _midiSync = false;
 	std::atomic<bool> _gameLink = false;
+	std::atomic<bool> _viewAttached = false;
+	std::atomic<bool> _videoRefresh = false;
+	std::atomic<bool> _indexedVideo = false;
+	std::atomic<bool> _booting = false;
 	std::atomic<int> _resetSamples = 0;
+	uint64_t _frameSequence = 0;
 
 	Lsdj _lsdj;
 	GameboyModel _model = GameboyModel::Auto;
 
 	double _sampleRate = 48000;
+	size_t _blockSize = 0;
+
+	// Scratch for updateAV, sized by setBlockSize to what the core can return
+	std::vector<int16_t> _audioScratch;
+	std::vector<float> _floatScratch;
 
+	// The ROM is shared with every other instance that has the same file loaded,
+	// until this instance needs to patch it
+	RomImagePtr _rom;
 	std::vector<std::byte> _romData;
+
 	std::vector<std::byte> _saveData;
 	SaveStateType _saveType = SaveStateType::Sram;
 
+	// Kits restored from a project, applied by the next call to init()
+	std::vector<NamedHashedDataPtr> _pendingKits;
+	bool _hasPendingKits = false;
+
 	bool _watchRom = false;
+	std::unique_ptr<RomWatcher> _romWatcher;
+
+	// Called by init() after a new core is swapped in, before the old one is freed
+	std::function<void()> _coreReplaced;
+
+	// Scratch for updateMultiple and renderBatchedAudio, which run on the audio thread
+	std::vector<void*> _linkedInstances;
+
+	LoadMeter _loadMeter;
+
+	// Set by the audio thread, see setQuality()
+	QualityLevel _quality = QualityLevel::Full;
+	double _videoElapsed = 0;
+	bool _highpassDisabled = false;
+	std::atomic<int> _highpassMode = 1;
+
+	// Set by the audio thread, see setBatchedAudio()
+	bool _batchedAudio = false;
 
 public:
 	SameBoyPlug();
-	~SameBoyPlug() { shutdown(); }
+	~SameBoyPlug();
 
-	bool watchRom() const { return false; }
+	bool watchRom() const { return _watchRom; }
 
-	void setWatchRom(bool watch) { _watchRom = watch; }
+	// Watches the ROM file for changes while enabled, following the instance to
+	// whichever ROM init() loads.  Changes are applied by calling reloadRom() once
+	// romChanged() returns true.
+	void setWatchRom(bool watch);
+
+	// True once after the watched ROM has changed on disk
+	bool romChanged();
 
 	Lsdj& lsdj() { return _lsdj; }
 
-	std::vector<std::byte>& romData() { return _romData; }
+	// Time spent emulating and mixing this instance, written by the audio thread
+	LoadMeter& loadMeter() { return _loadMeter; }
+
+	const LoadMeter& loadMeter() const { return _loadMeter; }
+
+	// The ROM as this instance currently sees it
+	const std::vector<std::byte>& rom() const {
+		static const std::vector<std::byte> empty;
+		return !_romData.empty() ? _romData : (_rom ? _rom->data : empty);
+	}
+
+	// A copy of the ROM owned by this instance, for patching.  Call updateRom()
+	// to send any changes to the core.
+	std::vector<std::byte>& romData() {
+		if (_romData.empty() && _rom) {
+			_romData = _rom->data;
+		}
+
+		return _romData;
+	}
 
 	void setRomPath(const tstring& path) { _romPath = path; }
 
@@ -78,12 +147,50 @@ public:
 
 	void setGameLink(bool enabled) { _gameLink = enabled; }
 
+	// Other instances hold raw pointers to the core they're linked to, so whoever
+	// manages the links has to know when it's replaced
+	void setCoreReplacedHandler(std::function<void()> handler) { _coreReplaced = std::move(handler); }
+
+	bool viewAttached() const { return _viewAttached.load(); }
+
+	// Video frames are only fetched from the core while a view is attached.  When
+	// a view attaches, the next frame is sent even if it hasn't changed.
+	void setViewAttached(bool attached) {
+		if (attached) {
+			_videoRefresh = true;
+		}
+
+		_viewAttached = attached;
+	}
+
+	// Requests frames as palette indices rather than RGBA8.  Frames that can't be
+	// represented that way (the palette changed mid frame) are still sent as RGBA8.
+	void setIndexedVideo(bool indexed) {
+		if (_indexedVideo.exchange(indexed) != indexed) {
+			_videoRefresh = true;
+		}
+	}
+
 	void init(const tstring& romPath, GameboyModel model, bool fastBoot);
 
 	void reset(GameboyModel model, bool fast);
 
 	bool active() const { return _instance != nullptr; }
 
+	// True while init() is running on a background thread.  Nothing but the
+	// thread doing the boot may touch the instance until this is cleared.
+	bool booting() const { return _booting.load(); }
+
+	void setBooting(bool booting) { _booting = booting; }
+
+	// Replaces the kits in the ROM the next time init() is called.  Like state set
+	// with loadState() before init(), they are in place before the audio thread
+	// sees the new instance.
+	void setPendingKits(std::vector<NamedHashedDataPtr> kits) {
+		_pendingKits = std::move(kits);
+		_hasPendingKits = true;
+	}
+
 	const std::string& romName() const { return _romName; }
 
 	const tstring& romPath() const { return _romPath; }
@@ -92,6 +199,9 @@ public:
 
 	void setSampleRate(double sampleRate);
 
+	// Sizes the audio buffer to hold two blocks of this many frames
+	void setBlockSize(size_t frames);
+
 	void sendKeyboardByte(int offset, char byte);
 
 	void sendSerialByte(int offset, char byte, size_t bitCount = 8);
@@ -108,6 +218,13 @@ public:
 
 	bool saveBattery(std::byte* data, size_t size);
 
+	// Reads part of the SRAM, which is a lot cheaper than saving all of it
+	bool readBattery(size_t offset, std::byte* data, size_t size);
+
+	// Writes part of the SRAM.  Resetting happens under the same lock, so the game
+	// never runs with the SRAM half written.
+	bool writeBattery(size_t offset, const std::byte* data, size_t size, bool reset);
+
 	bool loadBattery(const tstring& path, bool reset);
 
 	bool loadBattery(const std::vector<std::byte>& data, bool reset);
@@ -136,6 +253,20 @@ public:
 
 	void updateMultiple(SameBoyPlug** plugs, size_t plugCount, size_t audioFrames);
 
+	// Audio thread only, takes effect on the next update.  Below full quality,
+	// fewer frames are sent to the UI and the high-pass filter is disabled (see
+	// QualityLevel).
+	void setQuality(QualityLevel level) { _quality = level; }
+
+	// Audio thread only, with the lock held.  While batched, update() leaves the
+	// last stage of audio output to renderBatchedAudio(), which finishes a group of
+	// instances together.
+	void setBatchedAudio(bool batched);
+
+	// Audio thread only.  Finishes the audio of batched instances once they have
+	// all been updated, and passes it on along with their video.
+	void renderBatchedAudio(SameBoyPlug** plugs, size_t plugCount, size_t audioFrames);
+
 	void shutdown();
 
 	void* instance() { return _instance; }
@@ -148,7 +279,32 @@ public:
 
 	void updateRom();
 
+	// Loads the ROM file again while the instance keeps running.  Only the banks
+	// that differ are copied in to the core, between audio blocks, so RAM, SRAM and
+	// the rest of the emulated state carry on as they were.  A ROM that changed size
+	// gets a new instance with the old one's state loaded in to it.  Returns the
+	// number of banks that changed, 0 if the file's contents are the same, and -1
+	// if it couldn't be read.
+	int reloadRom();
+
+	// Sends only the given banks of romData() to the core.  Patching happens
+	// between audio blocks, so the rest of the ROM stays mapped and playing.
+	void updateRomBanks(const std::vector<int>& banks);
+
 private:
+	// Moves a freshly created core past its boot ROM, from a cached state if
+	// there is one.  Returns false if the boot ROM has to play in real time.
+	bool skipBootRom(void* instance, uint64_t romHash, GameboyModel model);
+
+	// Resets the core, restoring a cached boot state for fast resets.  The lock
+	// must be held.
+	void resetInstance(bool fast);
+
+	void applyQuality();
+
+	// Send at most one frame to the UI in this many
+	int frameInterval() const;
+
 	void updateButtons();
 
 	void updateAV(int audioFrames);
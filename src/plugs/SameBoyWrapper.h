@@ -1,14 +1,18 @@
 #pragma once
 
 #include "platform/DynamicLibraryMemory.h"
+#include "platform/Logger.h"
 
 #define SAMEBOY_SYMBOLS(symb) getSymbols().symb
 
 struct SameboyPlugSymbols {
-	void*(*sameboy_init)(void* user_data, const char* romData, size_t romSize, int model, bool fast_boot);
+	void*(*sameboy_init)(void* user_data, const char* romData, size_t romSize, int model, bool fast_boot, bool share_rom);
 	void(*sameboy_update_rom)(void* state, const char* rom_data, size_t rom_size);
+	void(*sameboy_patch_rom)(void* state, size_t offset, const char* data, size_t data_size);
 	void(*sameboy_free)(void* state);
 	void(*sameboy_reset)(void* state, int model, bool fast_boot);
+	bool(*sameboy_run_boot_rom)(void* state);
+	void(*sameboy_load_boot_state)(void* state, const char* source, size_t size);
 
 	void(*sameboy_update)(void* state, size_t requiredAudioFrames);
 	void(*sameboy_update_multiple)(void** states, size_t stateCount, size_t requiredAudioFrames);
@@ -25,17 +29,31 @@ struct SameboyPlugSymbols {
 	size_t(*sameboy_battery_size)(void* state);
 	void(*sameboy_load_battery)(void* state, const char* source, size_t size);
 	size_t(*sameboy_save_battery)(void* state, char* target, size_t size);
+	size_t(*sameboy_read_battery)(void* state, size_t offset, char* target, size_t size);
+	size_t(*sameboy_write_battery)(void* state, size_t offset, const char* source, size_t size);
 
 	size_t(*sameboy_save_state_size)(void* state);
 	void(*sameboy_load_state)(void* state, const char* source, size_t size);
 	void(*sameboy_save_state)(void* state, char* target, size_t size);
 
+	void(*sameboy_set_audio_capture)(void* state, bool enabled);
+	void(*sameboy_render_captured_audio)(void** states, size_t count);
+
+	void(*sameboy_set_block_size)(void* state, size_t frames);
 	size_t(*sameboy_fetch_audio)(void* state, int16_t* audio);
-	size_t(*sameboy_fetch_video)(void* state, uint32_t* video);
+	size_t(*sameboy_fetch_video)(void* state, uint32_t* video, bool force);
+	int(*sameboy_fetch_indexed_video)(void* state, uint8_t* indices, uint32_t* palette, bool force);
 
 	const char*(*sameboy_get_rom_name)(void* state);
 };
 
+// Stands in for sameboy_init when the core can't be used, so no instance is ever
+// created and nothing else gets called
+template <typename... Args>
+static void* sameboy_init_unavailable(Args...) {
+	return nullptr;
+}
+
 static SameboyPlugSymbols& getSymbols() {
 	static DynamicLibraryMemory instance;
 	static SameboyPlugSymbols _symbols = { nullptr };
@@ -51,6 +69,7 @@ static SameboyPlugSymbols& getSymbols() {
 	instance.get("sameboy_update_multiple", _symbols.sameboy_update_multiple);
 	instance.get("sameboy_fetch_audio", _symbols.sameboy_fetch_audio);
 	instance.get("sameboy_fetch_video", _symbols.sameboy_fetch_video);
+	instance.get("sameboy_fetch_indexed_video", _symbols.sameboy_fetch_indexed_video);
 	instance.get("sameboy_set_sample_rate", _symbols.sameboy_set_sample_rate);
 	instance.get("sameboy_send_serial_byte", _symbols.sameboy_send_serial_byte);
 	instance.get("sameboy_set_midi_bytes", _symbols.sameboy_set_midi_bytes);
@@ -62,11 +81,36 @@ static SameboyPlugSymbols& getSymbols() {
 	instance.get("sameboy_load_state", _symbols.sameboy_load_state);
 	instance.get("sameboy_battery_size", _symbols.sameboy_battery_size);
 	instance.get("sameboy_save_battery", _symbols.sameboy_save_battery);
+	instance.get("sameboy_read_battery", _symbols.sameboy_read_battery);
+	instance.get("sameboy_write_battery", _symbols.sameboy_write_battery);
 	instance.get("sameboy_load_battery", _symbols.sameboy_load_battery);
 	instance.get("sameboy_get_rom_name", _symbols.sameboy_get_rom_name);
 	instance.get("sameboy_set_setting", _symbols.sameboy_set_setting);
 	instance.get("sameboy_set_link_targets", _symbols.sameboy_set_link_targets);
 	instance.get("sameboy_update_rom", _symbols.sameboy_update_rom);
+	instance.get("sameboy_patch_rom", _symbols.sameboy_patch_rom);
+	instance.get("sameboy_run_boot_rom", _symbols.sameboy_run_boot_rom);
+	instance.get("sameboy_load_boot_state", _symbols.sameboy_load_boot_state);
+	instance.get("sameboy_set_audio_capture", _symbols.sameboy_set_audio_capture);
+	instance.get("sameboy_render_captured_audio", _symbols.sameboy_render_captured_audio);
+	instance.get("sameboy_set_block_size", _symbols.sameboy_set_block_size);
+
+	// The core is embedded as a prebuilt DLL, which has to be rebuilt (see
+	// retroplug/build.sh) whenever libretro.h changes.  An old one would have the
+	// host call through null pointers, so refuse to run it.
+	if (!instance.missing().empty()) {
+		std::string message = "The embedded SameBoy core is out of date.  Missing:\n";
+		for (const std::string& name : instance.missing()) {
+			message += name + "\n";
+		}
+
+		consoleLogLine(message);
+		MessageBoxA(NULL, message.c_str(), "RetroPlug", MB_OK | MB_ICONERROR);
+		assert(false);
+
+		_symbols = { nullptr };
+		_symbols.sameboy_init = sameboy_init_unavailable;
+	}
 
 	return _symbols;
 }
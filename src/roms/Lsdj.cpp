@@ -1,20 +1,60 @@
 #include "Lsdj.h"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <set>
+#include <string.h>
 #include "util/File.h"
 #include "lsdj/rom.h"
 #include "lsdj/kit.h"
 #include "util/crc32.h"
+#include "util/ThreadPool.h"
+#include "liblsdj/compression.h"
 
 const int LSDJ_SAV_SIZE = 131072; // FIXME: This is probably in liblsdj somewhere
 
-std::string projectName(lsdj_project_t* project) {
-	char name[9];
-	std::fill_n(name, 9, '\0');
-	lsdj_project_get_name(project, name, sizeof(name));
-	return std::string(name);
+// Offsets in to the header block
+const size_t SAV_VERSIONS_OFFSET = 0x100;
+const size_t SAV_INIT_OFFSET = 0x13E;
+const size_t SAV_ACTIVE_PROJECT_OFFSET = 0x140;
+const size_t SAV_ALLOCATION_TABLE_OFFSET = 0x141;
+const int SAV_PROJECT_COUNT = 32;
+
+std::string headerProjectName(const std::vector<std::byte>& header, int idx) {
+	const char* name = (const char*)header.data() + idx * LSDJ_PROJECT_NAME_LENGTH;
+	size_t length = 0;
+	while (length < LSDJ_PROJECT_NAME_LENGTH && name[length] != '\0') {
+		length++;
+	}
+
+	return std::string(name, length);
+}
+
+unsigned char headerProjectVersion(const std::vector<std::byte>& header, int idx) {
+	return (unsigned char)header[SAV_VERSIONS_OFFSET + idx];
+}
+
+// True if a project has the same name, version and blocks in both headers
+bool headerProjectMatches(const std::vector<std::byte>& a, const std::vector<std::byte>& b, int idx) {
+	if (headerProjectName(a, idx) != headerProjectName(b, idx) || headerProjectVersion(a, idx) != headerProjectVersion(b, idx)) {
+		return false;
+	}
+
+	for (size_t i = 0; i < BLOCK_COUNT; ++i) {
+		bool inA = (int)a[SAV_ALLOCATION_TABLE_OFFSET + i] == idx;
+		bool inB = (int)b[SAV_ALLOCATION_TABLE_OFFSET + i] == idx;
+		if (inA != inB) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Kit banks without a kit in them are all zeros apart from the first two bytes
+bool bankIsCleared(const char* bank) {
+	return bank[0] == -1 && bank[1] == -1 && std::all_of(bank + 2, bank + BANK_SIZE, [](char c) { return c == 0; });
 }
 
 int nextProjectIndex(lsdj_sav_t* sav, int startIdx) {
@@ -49,287 +89,517 @@ void Lsdj::loadRom(const std::vector<std::byte>& romData) {
 	}
 }
 
-bool importSong(lsdj_sav_t* sav, int idx, std::vector<std::byte>& source, std::string& errorStr) {
+void serializeSong(const lsdj_project_t* project, std::vector<std::byte>& target) {
+	target.resize(LSDSNG_MAX_SIZE);
+
 	lsdj_error_t* error = nullptr;
-	lsdj_project_t* project = lsdj_project_read_lsdsng_from_memory((const unsigned char*)source.data(), source.size(), &error);
-	if (error != nullptr) {
-		errorStr = lsdj_error_get_c_str(error);
-		consoleLogLine(errorStr);
+	size_t size = lsdj_project_write_lsdsng_to_memory(project, (unsigned char*)target.data(), target.size(), &error);
+	if (error) {
+		consoleLogLine(lsdj_error_get_c_str(error));
+		lsdj_error_free(error);
+		target.resize(0);
+	} else {
+		target.resize(size);
+	}
+}
+
+void serializeSong(const std::string& name, unsigned char version, const std::vector<unsigned char>& songData, std::vector<std::byte>& target) {
+	lsdj_error_t* error = nullptr;
+	lsdj_song_t* song = lsdj_song_read_from_memory(songData.data(), songData.size(), &error);
+	if (error) {
+		consoleLogLine(lsdj_error_get_c_str(error));
+		lsdj_error_free(error);
+		lsdj_song_free(song);
+		return;
+	}
+
+	lsdj_project_t* project = lsdj_project_new(&error);
+	if (error) {
+		consoleLogLine(lsdj_error_get_c_str(error));
+		lsdj_error_free(error);
+		lsdj_song_free(song);
+		return;
+	}
+
+	lsdj_project_set_name(project, name.c_str(), name.size());
+	lsdj_project_set_version(project, version);
+	lsdj_project_set_song(project, song);
+
+	serializeSong(project, target);
+
+	// Projects don't own their song
+	lsdj_project_free(project);
+	lsdj_song_free(song);
+}
+
+// Decompresses a project straight out of a .sav, using the allocation table in
+// its header
+bool decompressSavProject(const std::byte* sav, size_t size, int idx, std::vector<unsigned char>& target, std::string& errorStr) {
+	const std::byte* header = sav + LSDJ_SAV_HEADER_OFFSET;
+
+	// Projects start in the first block allocated to them
+	int firstBlock = -1;
+	for (size_t i = 0; i < BLOCK_COUNT; ++i) {
+		if ((int)header[SAV_ALLOCATION_TABLE_OFFSET + i] == idx) {
+			firstBlock = (int)i;
+			break;
+		}
+	}
+
+	if (firstBlock == -1) {
 		return false;
 	}
 
-	lsdj_sav_set_project(sav, idx, project, &error);
-	if (error != nullptr) {
+	target.assign(LSDJ_SONG_DECOMPRESSED_SIZE, 0);
+
+	lsdj_error_t* error = nullptr;
+	lsdj_decompress_span(
+		(const unsigned char*)sav,
+		size,
+		LSDJ_SAV_HEADER_OFFSET + (firstBlock + 1) * BLOCK_SIZE,
+		LSDJ_SAV_HEADER_OFFSET + BLOCK_SIZE,
+		BLOCK_SIZE,
+		target.data(),
+		&error
+	);
+
+	if (error) {
 		errorStr = lsdj_error_get_c_str(error);
-		consoleLogLine("Project " + projectName(project) + ": " + errorStr);
-		lsdj_project_free(project);
+		lsdj_error_free(error);
+		target.clear();
 		return false;
 	}
 
 	return true;
 }
 
-void serializeSong(const lsdj_project_t* project, std::vector<std::byte>& target) {
-	target.resize(LSDSNG_MAX_SIZE);
+bool decodeLsdsng(const std::vector<std::byte>& source, LsdjDecodedSong& target, std::string& errorStr) {
+	const size_t dataOffset = LSDJ_PROJECT_NAME_LENGTH + 1;
+	if (source.size() <= dataOffset) {
+		errorStr = "file is too small";
+		return false;
+	}
+
+	target.name = headerProjectName(source, 0);
+	target.version = (unsigned char)source[LSDJ_PROJECT_NAME_LENGTH];
+	target.data.assign(LSDJ_SONG_DECOMPRESSED_SIZE, 0);
 
 	lsdj_error_t* error = nullptr;
-	size_t size = lsdj_project_write_lsdsng_to_memory(project, (unsigned char*)target.data(), target.size(), &error);
+	lsdj_decompress_span((const unsigned char*)source.data(), source.size(), dataOffset, -1, BLOCK_SIZE, target.data.data(), &error);
 	if (error) {
-		consoleLogLine(lsdj_error_get_c_str(error));
-		target.resize(0);
-	} else {
-		target.resize(size);
+		errorStr = lsdj_error_get_c_str(error);
+		lsdj_error_free(error);
+		return false;
 	}
+
+	return true;
+}
+
+bool decodeSav(const std::vector<std::byte>& source, std::vector<LsdjDecodedSong>& target, std::string& errorStr) {
+	if (source.size() < LSDJ_SAV_SIZE) {
+		errorStr = "file is too small";
+		return false;
+	}
+
+	std::vector<std::byte> header(source.begin() + LSDJ_SAV_HEADER_OFFSET, source.begin() + LSDJ_SAV_HEADER_OFFSET + LSDJ_SAV_HEADER_SIZE);
+	if (header[SAV_INIT_OFFSET] != (std::byte)'j' || header[SAV_INIT_OFFSET + 1] != (std::byte)'k') {
+		errorStr = "not an LSDj save";
+		return false;
+	}
+
+	for (int i = 0; i < SAV_PROJECT_COUNT; ++i) {
+		LsdjDecodedSong song;
+		std::string projectError;
+		if (decompressSavProject(source.data(), source.size(), i, song.data, projectError)) {
+			song.name = headerProjectName(header, i);
+			song.version = headerProjectVersion(header, i);
+			target.push_back(std::move(song));
+		} else if (!projectError.empty()) {
+			errorStr += "project " + std::to_string(i) + ": " + projectError + "\n";
+		}
+	}
+
+	return errorStr.empty();
+}
+
+// Songs belonging to the projects of a sav aren't freed with it
+void freeSav(lsdj_sav_t* sav) {
+	for (unsigned int i = 0; i < lsdj_sav_get_project_count(sav); ++i) {
+		lsdj_song_free(lsdj_project_get_song(lsdj_sav_get_project(sav, i)));
+	}
+
+	lsdj_sav_free(sav);
+}
+
+LsdjSongImport::LsdjSongImport(const std::vector<tstring>& paths): _paths(paths) {
+	_songs.resize(paths.size());
+	_errors.resize(paths.size());
+}
+
+std::shared_ptr<LsdjSongImport> LsdjSongImport::start(const std::vector<tstring>& paths) {
+	auto job = std::make_shared<LsdjSongImport>(paths);
+
+	// The job is kept alive by the queue, in case whoever started it goes away
+	// before it finishes
+	for (size_t i = 0; i < paths.size(); ++i) {
+		ThreadPool::shared().enqueue([job, i]() { job->decode(i); });
+	}
+
+	return job;
+}
+
+void LsdjSongImport::run() {
+	ThreadPool::shared().parallelFor(_paths.size(), [this](size_t idx) { decode(idx); });
+}
+
+void LsdjSongImport::decode(size_t idx) {
+	const tstring& path = _paths[idx];
+	std::vector<std::byte> fileData;
+	std::string error;
+
+	try {
+		if (!readFile(path, fileData)) {
+			error = "could not read file";
+		} else if (getExt(path) == T(".lsdsng")) {
+			LsdjDecodedSong song;
+			if (decodeLsdsng(fileData, song, error)) {
+				_songs[idx].push_back(std::move(song));
+			}
+		} else {
+			decodeSav(fileData, _songs[idx], error);
+		}
+	} catch (const std::exception& e) {
+		// Nothing can be allowed to escape a pool thread
+		error = e.what();
+	}
+
+	if (!error.empty()) {
+		_errors[idx] = ws2s(path) + ": " + error;
+	}
+
+	_completed++;
+}
+
+void LsdjSongImport::collect(std::vector<LsdjDecodedSong>& songs, std::string& errors) {
+	for (size_t i = 0; i < _paths.size(); ++i) {
+		for (LsdjDecodedSong& song : _songs[i]) {
+			songs.push_back(std::move(song));
+		}
+
+		if (!_errors[i].empty()) {
+			consoleLogLine(_errors[i]);
+			errors += _errors[i] + "\n";
+		}
+	}
+
+	_songs.clear();
 }
 
 std::vector<int> Lsdj::importSongs(const std::vector<tstring>& paths, std::string& errorStr) {
+	LsdjSongImport job(paths);
+	job.run();
+
+	std::vector<LsdjDecodedSong> songs;
+	job.collect(songs, errorStr);
+	return importSongs(songs, errorStr);
+}
+
+std::vector<int> Lsdj::importSongs(const std::vector<LsdjDecodedSong>& songs, std::string& errorStr) {
+	if (songs.empty()) {
+		return {};
+	}
+
 	lsdj_error_t* error = nullptr;
 	lsdj_sav_t* sav = lsdj_sav_read_from_memory((const unsigned char*)saveData.data(), saveData.size(), &error);
 	if (sav == nullptr) {
 		if (error) {
-			errorStr = lsdj_error_get_c_str(error);
+			errorStr += std::string(lsdj_error_get_c_str(error)) + "\n";
 			consoleLogLine(errorStr);
+			lsdj_error_free(error);
 		}
 
 		return {};
 	}
 
+	// Everything has already been decompressed, so all that's left is handing
+	// the songs to the sav and compressing it once at the end
 	std::vector<int> ids;
 	int index = nextProjectIndex(sav, 0);
 
-	std::vector<std::byte> fileData;
-	for (auto& path : paths) {
-		fileData.clear();
-
-		if (readFile(path, fileData)) {
-			tstring ext = getExt(path);
-			if (ext == T(".lsdsng")) {
-				if (importSong(sav, index, fileData, errorStr)) {
-					ids.push_back(index);
-					index = nextProjectIndex(sav, index);
-				}
-			} else {
-				lsdj_sav_t* other = lsdj_sav_read_from_memory((const unsigned char*)fileData.data(), fileData.size(), &error);
-				if (other == nullptr) {
-					if (error) {
-						errorStr += std::string(lsdj_error_get_c_str(error)) + "\n";
-						consoleLogLine(errorStr);
-					}
+	for (const LsdjDecodedSong& decoded : songs) {
+		if (index == -1) {
+			errorStr += "No free projects left for " + decoded.name + "\n";
+			consoleLogLine("No free projects left for " + decoded.name);
+			break;
+		}
 
-					continue;
-				}
+		lsdj_song_t* song = lsdj_song_read_from_memory(decoded.data.data(), decoded.data.size(), &error);
+		if (error) {
+			errorStr += decoded.name + ": " + lsdj_error_get_c_str(error) + "\n";
+			consoleLogLine(decoded.name + ": " + lsdj_error_get_c_str(error));
+			lsdj_error_free(error);
+			lsdj_song_free(song);
+			error = nullptr;
+			continue;
+		}
 
-				std::vector<std::byte> songData;
-				size_t count = lsdj_sav_get_project_count(other);
-				for (size_t i = 0; i < count; ++i) {
-					lsdj_project_t* project = lsdj_sav_get_project(other, i);
-					lsdj_song_t* song = lsdj_project_get_song(project);
-					if (song) {
-						serializeSong(project, songData);
-						if (importSong(sav, index, songData, errorStr)) {
-							ids.push_back(index);
-							index = nextProjectIndex(sav, index);
-						}
-					}
-				}
+		lsdj_project_t* project = lsdj_project_new(&error);
+		if (error) {
+			errorStr += std::string(lsdj_error_get_c_str(error)) + "\n";
+			lsdj_error_free(error);
+			lsdj_song_free(song);
+			break;
+		}
 
-				lsdj_sav_free(other);
-			}
+		lsdj_project_set_name(project, decoded.name.c_str(), decoded.name.size());
+		lsdj_project_set_version(project, decoded.version);
+		lsdj_project_set_song(project, song);
+
+		// The slot is left free for the next song if this one can't be placed
+		lsdj_sav_set_project(sav, index, project, &error);
+		if (error) {
+			errorStr += decoded.name + ": " + lsdj_error_get_c_str(error) + "\n";
+			consoleLogLine(decoded.name + ": " + lsdj_error_get_c_str(error));
+			lsdj_error_free(error);
+			lsdj_song_free(song);
+			lsdj_project_free(project);
+			error = nullptr;
+			continue;
 		}
+
+		ids.push_back(index);
+		index = nextProjectIndex(sav, index);
 	}
 
 	lsdj_sav_write_to_memory(sav, (unsigned char*)saveData.data(), saveData.size(), &error);
+	freeSav(sav);
+
 	if (error != nullptr) {
 		errorStr += std::string(lsdj_error_get_c_str(error)) + "\n";
 		consoleLogLine(errorStr);
-		lsdj_sav_free(sav);
+		lsdj_error_free(error);
 		return {};
 	}
 
-	lsdj_sav_free(sav);
+	syncSongIndex();
 	return ids;
 }
 
 void Lsdj::loadSong(int idx) {
-	if (saveData.size() == 0) {
+	if (saveData.size() < LSDJ_SAV_SIZE) {
 		return;
 	}
 
-	lsdj_error_t* error = nullptr;
-	lsdj_sav_t* sav = lsdj_sav_read_from_memory((const unsigned char*)saveData.data(), saveData.size(), &error);
-	if (sav == nullptr) {
-		if (error) {
-			consoleLogLine(lsdj_error_get_c_str(error));
-		}
+	syncSongIndex();
 
-		return;
+	std::vector<std::byte> patch;
+	if (songLoadPatch(idx, patch)) {
+		memcpy(saveData.data(), patch.data(), patch.size());
+		syncSongIndex();
 	}
+}
 
-	lsdj_sav_set_working_memory_song_from_project(sav, idx, &error);
-	if (error) {
-		consoleLogLine(lsdj_error_get_c_str(error));
-		lsdj_sav_free(sav);
-		return;
+bool Lsdj::songLoadPatch(int idx, std::vector<std::byte>& target) {
+	if (idx < 0 || idx >= SAV_PROJECT_COUNT || _savHeader.size() != LSDJ_SAV_HEADER_SIZE) {
+		return false;
 	}
 
-	saveData.resize(LSDJ_SAV_SIZE);
-	lsdj_sav_write_to_memory(sav, (unsigned char*)saveData.data(), saveData.size(), &error);
-	if (error) {
-		consoleLogLine(lsdj_error_get_c_str(error));
+	std::vector<unsigned char> song;
+	if (!readProject(idx, song)) {
+		return false;
 	}
 
-	lsdj_sav_free(sav);
+	// Same as copying the project in to working memory and making it active,
+	// which is all LSDj does when loading a song
+	target.resize(LSDJ_SAV_HEADER_OFFSET + SAV_ACTIVE_PROJECT_OFFSET + 1);
+	memcpy(target.data(), song.data(), LSDJ_SONG_DECOMPRESSED_SIZE);
+	memcpy(target.data() + LSDJ_SAV_HEADER_OFFSET, _savHeader.data(), SAV_ACTIVE_PROJECT_OFFSET);
+	target.back() = (std::byte)idx;
+
+	return true;
 }
 
 void Lsdj::exportSong(int idx, std::vector<std::byte>& target) {
-	if (saveData.size() == 0) {
+	if (saveData.size() < LSDJ_SAV_SIZE) {
 		return;
 	}
 
-	lsdj_error_t* error = nullptr;
-	lsdj_sav_t* sav = lsdj_sav_read_from_memory((const unsigned char*)saveData.data(), saveData.size(), &error);
-	if (sav == nullptr) {
-		if (error) {
-			consoleLogLine(lsdj_error_get_c_str(error));
-		}
+	syncSongIndex();
+	serializeProject(idx, target);
+}
 
+void Lsdj::exportSongs(std::vector<NamedData>& target) {
+	if (saveData.size() < LSDJ_SAV_SIZE) {
 		return;
 	}
 
-	lsdj_project_t* project;	
-	if (idx == -1) {
-		project = lsdj_project_new_from_working_memory_song(sav, &error);
-		if (error) {
-			consoleLogLine(lsdj_error_get_c_str(error));
-			lsdj_sav_free(sav);
+	syncSongIndex();
+
+	// Decompressing goes through the project cache so happens here, compressing
+	// the songs again is independent per song and is spread over the pool
+	std::vector<LsdjDecodedSong> songs;
+	std::vector<NamedData> serialized;
+	for (const LsdjSongName& song : _songIndex) {
+		LsdjDecodedSong decoded;
+		if (!readProjectData(song.projectId, decoded)) {
+			continue;
 		}
-	} else {
-		project = lsdj_sav_get_project(sav, idx);
+
+		NamedData data;
+		data.name = decoded.name + (song.projectId == -1 ? ".WM." : ".") + std::to_string(decoded.version);
+		serialized.push_back(std::move(data));
+		songs.push_back(std::move(decoded));
 	}
 
-	serializeSong(project, target);
+	ThreadPool::shared().parallelFor(songs.size(), [&](size_t idx) {
+		serializeSong(songs[idx].name, songs[idx].version, songs[idx].data, serialized[idx].data);
+	});
 
-	lsdj_sav_free(sav);
+	for (NamedData& data : serialized) {
+		if (!data.data.empty()) {
+			target.push_back(std::move(data));
+		}
+	}
 }
 
-void Lsdj::exportSongs(std::vector<NamedData>& target) {
-	if (saveData.size() == 0) {
+void Lsdj::deleteSong(int idx) {
+	if (saveData.size() < LSDJ_SAV_SIZE || idx < 0 || idx >= SAV_PROJECT_COUNT) {
 		return;
 	}
 
-	lsdj_error_t* error = nullptr;
-	lsdj_sav_t* sav = lsdj_sav_read_from_memory((const unsigned char*)saveData.data(), saveData.size(), &error);
-	if (sav == nullptr) {
-		if (error) {
-			consoleLogLine(lsdj_error_get_c_str(error));
+	// Freeing the blocks and clearing the name is all it takes, there's no need
+	// to recompress the other projects
+	std::byte* header = saveData.data() + LSDJ_SAV_HEADER_OFFSET;
+	for (size_t i = 0; i < BLOCK_COUNT; ++i) {
+		if ((int)header[SAV_ALLOCATION_TABLE_OFFSET + i] == idx) {
+			header[SAV_ALLOCATION_TABLE_OFFSET + i] = (std::byte)0xFF;
 		}
-
-		return;
 	}
 
-	lsdj_project_t* project = lsdj_project_new_from_working_memory_song(sav, &error);
-	if (error) {
-		consoleLogLine(lsdj_error_get_c_str(error));
-		lsdj_sav_free(sav);
-		return;
-	};
+	memset(header + idx * LSDJ_PROJECT_NAME_LENGTH, 0, LSDJ_PROJECT_NAME_LENGTH);
+	header[SAV_VERSIONS_OFFSET + idx] = (std::byte)0;
 
-	char name[9];
-	std::fill_n(name, 9, '\0');
-	lsdj_project_get_name(project, name, sizeof(name));
-	unsigned char version = lsdj_project_get_version(project);
+	syncSongIndex();
+}
 
-	target.push_back(NamedData());
-	target.back().name = std::string(name) + ".WM." + std::to_string(version);
-	serializeSong(project, target.back().data);
+void Lsdj::getSongNames(std::vector<LsdjSongName>& names) {
+	names.insert(names.end(), _songIndex.begin(), _songIndex.end());
+}
 
-	size_t count = lsdj_sav_get_project_count(sav);
-	for (size_t i = 0; i < count; ++i) {
-		lsdj_project_t* project = lsdj_sav_get_project(sav, i);
-		lsdj_song_t* song = lsdj_project_get_song(project);
-		if (song) {
-			std::fill_n(name, 9, '\0');
-			lsdj_project_get_name(project, name, sizeof(name));
-			version = lsdj_project_get_version(project);
-
-			target.push_back(NamedData());
-			target.back().name = std::string(name) + "." + std::to_string(version);
-			serializeSong(project, target.back().data);
-		}
+bool Lsdj::updateSongIndex(const std::byte* header, size_t size) {
+	if (size < LSDJ_SAV_HEADER_SIZE) {
+		return false;
 	}
 
-	lsdj_sav_free(sav);
-}
-
-void Lsdj::deleteSong(int idx) {
-	if (saveData.size() == 0) {
-		return;
+	if (_savHeader.size() == LSDJ_SAV_HEADER_SIZE && memcmp(_savHeader.data(), header, LSDJ_SAV_HEADER_SIZE) == 0) {
+		return false;
 	}
 
-	lsdj_error_t* error = nullptr;
-	lsdj_sav_t* sav = lsdj_sav_read_from_memory((const unsigned char*)saveData.data(), saveData.size(), &error);
-	if (sav == nullptr) {
-		if (error) {
-			consoleLogLine(lsdj_error_get_c_str(error));
+	std::vector<std::byte> previous = std::move(_savHeader);
+	_savHeader.assign(header, header + LSDJ_SAV_HEADER_SIZE);
+	_songIndex.clear();
+
+	// Loading a song only changes the active project, so switching back and forth
+	// between songs keeps them all decoded
+	for (auto it = _projectCache.begin(); it != _projectCache.end();) {
+		if (previous.size() == LSDJ_SAV_HEADER_SIZE && headerProjectMatches(previous, _savHeader, it->first)) {
+			++it;
+		} else {
+			it = _projectCache.erase(it);
 		}
+	}
 
-		return;
+	// If the SRAM hasn't been initialized by LSDj there's nothing to list
+	if (_savHeader[SAV_INIT_OFFSET] != (std::byte)'j' || _savHeader[SAV_INIT_OFFSET + 1] != (std::byte)'k') {
+		return true;
 	}
 
-	auto project = lsdj_sav_get_project(sav, idx);
-	char name[9];
-	std::fill_n(name, 9, '\0');
-	lsdj_project_get_name(project, name, sizeof(name));
-	std::cout << "Deleting " << std::string(name) << std::endl;
+	bool allocated[SAV_PROJECT_COUNT] = { false };
+	for (size_t i = 0; i < BLOCK_COUNT; ++i) {
+		int project = (int)_savHeader[SAV_ALLOCATION_TABLE_OFFSET + i];
+		if (project < SAV_PROJECT_COUNT) {
+			allocated[project] = true;
+		}
+	}
 
-	lsdj_sav_erase_project(sav, idx, &error);
-	if (error) {
-		consoleLogLine(lsdj_error_get_c_str(error));
-		lsdj_sav_free(sav);
-		return;
+	int active = (int)_savHeader[SAV_ACTIVE_PROJECT_OFFSET];
+	if (active < SAV_PROJECT_COUNT) {
+		_songIndex.push_back({ -1, headerProjectName(_savHeader, active) + " (working)", headerProjectVersion(_savHeader, active) });
+	} else {
+		_songIndex.push_back({ -1, " (working)", 0 });
 	}
 
-	saveData.resize(LSDJ_SAV_SIZE);
-	lsdj_sav_write_to_memory(sav, (unsigned char*)saveData.data(), saveData.size(), &error);
-	if (error) {
-		consoleLogLine(lsdj_error_get_c_str(error));
+	for (int i = 0; i < SAV_PROJECT_COUNT; ++i) {
+		if (allocated[i]) {
+			_songIndex.push_back({ i, headerProjectName(_savHeader, i), headerProjectVersion(_savHeader, i) });
+		}
 	}
 
-	lsdj_sav_free(sav);
+	return true;
 }
 
-void Lsdj::getSongNames(std::vector<LsdjSongName>& names) {
-	if (saveData.size() == 0) {
-		return;
+void Lsdj::syncSongIndex() {
+	if (saveData.size() >= LSDJ_SAV_HEADER_OFFSET + LSDJ_SAV_HEADER_SIZE) {
+		updateSongIndex(saveData.data() + LSDJ_SAV_HEADER_OFFSET, LSDJ_SAV_HEADER_SIZE);
 	}
+}
 
-	lsdj_error_t* error = nullptr;
-	lsdj_sav_t* sav = lsdj_sav_read_from_memory((const unsigned char*)saveData.data(), saveData.size(), &error);
-	if (sav == nullptr) {
-		consoleLogLine(lsdj_error_get_c_str(error));
-		return;
+bool Lsdj::readProject(int idx, std::vector<unsigned char>& target) {
+	auto found = _projectCache.find(idx);
+	if (found != _projectCache.end()) {
+		target = found->second;
+		return true;
 	}
 
-	char name[9];
-	std::fill_n(name, 9, '\0');
+	if (_savHeader.size() != LSDJ_SAV_HEADER_SIZE || saveData.size() < LSDJ_SAV_SIZE) {
+		return false;
+	}
 
-	lsdj_project_t* current = lsdj_project_new_from_working_memory_song(sav, &error);
-	if (!error) {
-		lsdj_project_get_name(current, name, sizeof(name));
-		names.push_back({ -1, std::string(name) + " (working)", lsdj_project_get_version(current) });
+	std::vector<unsigned char> song;
+	std::string error;
+	if (!decompressSavProject(saveData.data(), saveData.size(), idx, song, error)) {
+		if (!error.empty()) {
+			consoleLogLine(error);
+		}
+
+		return false;
 	}
 
-	size_t count = lsdj_sav_get_project_count(sav);
-	for (size_t i = 0; i < count; ++i) {
-		lsdj_project_t* project = lsdj_sav_get_project(sav, i);
-		if (lsdj_project_get_song(project) != NULL) {
-			std::fill_n(name, 9, '\0');
-			lsdj_project_get_name(project, name, sizeof(name));
-			names.push_back({ (int)i, name, lsdj_project_get_version(project) });
+	_projectCache[idx] = song;
+	target = std::move(song);
+	return true;
+}
+
+bool Lsdj::readProjectData(int idx, LsdjDecodedSong& target) {
+	if (idx == -1) {
+		target.data.assign((const unsigned char*)saveData.data(), (const unsigned char*)saveData.data() + LSDJ_SONG_DECOMPRESSED_SIZE);
+
+		int active = (int)_savHeader[SAV_ACTIVE_PROJECT_OFFSET];
+		if (active < SAV_PROJECT_COUNT) {
+			target.name = headerProjectName(_savHeader, active);
+			target.version = headerProjectVersion(_savHeader, active);
 		}
+
+		return true;
 	}
 
-	lsdj_sav_free(sav);
+	if (readProject(idx, target.data)) {
+		target.name = headerProjectName(_savHeader, idx);
+		target.version = headerProjectVersion(_savHeader, idx);
+		return true;
+	}
+
+	return false;
+}
+
+bool Lsdj::serializeProject(int idx, std::vector<std::byte>& target) {
+	LsdjDecodedSong song;
+	if (!readProjectData(idx, song)) {
+		return false;
+	}
+
+	serializeSong(song.name, song.version, song.data, target);
+	return !target.empty();
 }
 
 // Kit specific
@@ -337,10 +607,13 @@ void Lsdj::getSongNames(std::vector<LsdjSongName>& names) {
 bool Lsdj::loadRomKits(const std::vector<std::byte>& romData, bool absolute, std::string& error) {
 	int kitIdx = 0;
 
+	// Hashes are only needed to filter out duplicates when kits are being added
 	std::set<uint32_t> hashes;
-	for (size_t i = 0; i < kitData.size(); ++i) {
-		if (kitData[i]) {
-			hashes.insert(kitData[i]->hash);
+	if (!absolute) {
+		for (size_t i = 0; i < kitData.size(); ++i) {
+			if (kitData[i]) {
+				hashes.insert(kitHash(i));
+			}
 		}
 	}
 
@@ -418,7 +691,8 @@ void Lsdj::readKit(const std::vector<std::byte>& romData, std::vector<std::byte>
 	}
 }
 
-void Lsdj::patchKits(std::vector<std::byte>& romData) {
+std::vector<int> Lsdj::patchKits(std::vector<std::byte>& romData) {
+	std::vector<int> changed;
 	int kitIdx = 0;
 
 	char* data = (char*)romData.data();
@@ -427,17 +701,51 @@ void Lsdj::patchKits(std::vector<std::byte>& romData) {
 		if (bank_is_kit(data + offset) || bank_is_empty_kit(data + offset)) {
 			auto kit = kitData[kitIdx];
 			if (kit) {
-				memcpy((void*)(data + offset), (void*)kit->data.data(), kit->data.size());
-			} else {
+				if (memcmp(data + offset, kit->data.data(), kit->data.size()) != 0) {
+					memcpy((void*)(data + offset), (void*)kit->data.data(), kit->data.size());
+					changed.push_back((int)bankIdx);
+				}
+			} else if (!bankIsCleared(data + offset)) {
 				// Clear kit!
 				memset((void*)(data + offset), 0, BANK_SIZE);
 				data[offset + 0] = -1;
 				data[offset + 1] = -1;
+				changed.push_back((int)bankIdx);
+			}
+
+			kitIdx++;
+		}
+	}
+
+	return changed;
+}
+
+bool Lsdj::kitsMatch(const std::vector<std::byte>& romData) {
+	int kitIdx = 0;
+
+	const char* data = (const char*)romData.data();
+	for (size_t bankIdx = 0; bankIdx < BANK_COUNT; ++bankIdx) {
+		size_t offset = bankIdx * BANK_SIZE;
+		if (bank_is_kit(data + offset) || bank_is_empty_kit(data + offset)) {
+			auto kit = kitData[kitIdx];
+			if (kit) {
+				if (memcmp(data + offset, kit->data.data(), kit->data.size()) != 0) {
+					return false;
+				}
+			} else if (!bankIsCleared(data + offset)) {
+				return false;
 			}
 
 			kitIdx++;
 		}
 	}
+
+	return true;
+}
+
+uint32_t Lsdj::kitHash(int idx) const {
+	const NamedHashedDataPtr& kit = kitData[idx];
+	return kit ? kit->hash : 0;
 }
 
 void Lsdj::loadKitAt(const char* data, size_t size, int idx) {
@@ -456,8 +764,9 @@ void Lsdj::loadKitAt(const char* data, size_t size, int idx) {
 	kit->data.resize(size);
 	memcpy(kit->data.data(), data, size);
 
+	// Kits are shared between instances once loaded, so they're never modified
+	// after this
 	kit->hash = crc32::update(kit->data);
-
 	kitData[idx] = kit;
 }
 
@@ -500,10 +809,12 @@ void Lsdj::exportKit(const std::vector<std::byte>& romData, int index, std::vect
 	}
 }
 
-void Lsdj::deleteKit(std::vector<std::byte>& romData, int index) {
+std::vector<int> Lsdj::deleteKit(std::vector<std::byte>& romData, int index) {
 	if (kitData[index]) {
 		kitData[index] = nullptr;
-		patchKits(romData);
+		return patchKits(romData);
 	}
+
+	return {};
 }
 
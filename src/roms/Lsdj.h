@@ -1,6 +1,8 @@
 #pragma once
 
 #include <atomic>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -116,6 +118,11 @@ static LsdjSyncModes syncModeFromString(const std::string& syncMode) {
 	return LsdjSyncModes::Off;
 }
 
+// The block after the working song in an LSDj .sav holds the project names and
+// versions, the active project and the block allocation table
+const size_t LSDJ_SAV_HEADER_OFFSET = 0x8000;
+const size_t LSDJ_SAV_HEADER_SIZE = 0x200;
+
 struct LsdjSongName {
 	int projectId;
 	std::string name;
@@ -136,6 +143,46 @@ struct NamedHashedData {
 using NamedDataPtr = std::shared_ptr<NamedData>;
 using NamedHashedDataPtr = std::shared_ptr<NamedHashedData>;
 
+// A song read from an .lsdsng or from one of the projects in a .sav, ready to
+// be packed in to the save data
+struct LsdjDecodedSong {
+	std::string name;
+	unsigned char version = 0;
+	std::vector<unsigned char> data;
+};
+
+// Reads and decompresses a batch of song files on the shared thread pool.  Only
+// the decoding happens here - the songs are packed in to the save data on the
+// thread that owns it, by passing them to Lsdj::importSongs.
+class LsdjSongImport {
+private:
+	std::vector<tstring> _paths;
+	std::vector<std::vector<LsdjDecodedSong>> _songs;
+	std::vector<std::string> _errors;
+	std::atomic<size_t> _completed = 0;
+
+public:
+	LsdjSongImport(const std::vector<tstring>& paths);
+
+	// Queues every file on the shared pool and returns straight away
+	static std::shared_ptr<LsdjSongImport> start(const std::vector<tstring>& paths);
+
+	// Decodes every file, blocking until they're all done
+	void run();
+
+	size_t total() const { return _paths.size(); }
+
+	size_t completed() const { return _completed; }
+
+	bool done() const { return _completed == _paths.size(); }
+
+	// Only valid once done() returns true.  Errors are listed per file.
+	void collect(std::vector<LsdjDecodedSong>& songs, std::string& errors);
+
+private:
+	void decode(size_t idx);
+};
+
 class Lsdj {
 public:
 	bool found = false;
@@ -163,16 +210,34 @@ public:
 
 	std::vector<int> importSongs(const std::vector<tstring>& paths, std::string& error);
 
+	// Packs songs decoded by LsdjSongImport in to free projects
+	std::vector<int> importSongs(const std::vector<LsdjDecodedSong>& songs, std::string& error);
+
 	void loadSong(int idx);
 
+	// Builds the start of the SRAM as it is once a project has been loaded: the
+	// project in working memory, followed by the header up to and including the
+	// active project.  saveData is only read if the project hasn't been decoded
+	// since it last changed.
+	bool songLoadPatch(int idx, std::vector<std::byte>& target);
+
+	// True if songLoadPatch doesn't need a current copy of saveData
+	bool songCached(int idx) const { return _projectCache.count(idx) > 0; }
+
 	void exportSong(int idx, std::vector<std::byte>& target);
 
 	void exportSongs(std::vector<NamedData>& target);
 
 	void deleteSong(int idx);
 
+	// Returns the songs listed by the last header passed to updateSongIndex (or
+	// found in saveData by one of the song functions above)
 	void getSongNames(std::vector<LsdjSongName>& names);
 
+	// Rebuilds the song list if the header block has changed since the last call.
+	// Only the header is read, nothing is decompressed.
+	bool updateSongIndex(const std::byte* header, size_t size);
+
 	// Kit specific
 
 	bool loadRomKits(const std::vector<std::byte>& romData, bool absolute, std::string& error);
@@ -185,7 +250,8 @@ public:
 
 	void exportKit(const std::vector<std::byte>& romData, int idx, std::vector<std::byte>& target);
 
-	void deleteKit(std::vector<std::byte>& romData, int index);
+	// Returns the banks that were changed
+	std::vector<int> deleteKit(std::vector<std::byte>& romData, int index);
 
 	int findEmptyKit() {
 		for (size_t i = 0; i < kitData.size(); ++i) {
@@ -201,8 +267,33 @@ public:
 
 	void readKit(const std::vector<std::byte>& romData, std::vector<std::byte>& target, int index);
 
-	void patchKits(std::vector<std::byte>& romData);
+	// Writes kitData in to the kit banks of the ROM.  Banks that already hold the
+	// right data are left alone, and the ones that were changed are returned.
+	std::vector<int> patchKits(std::vector<std::byte>& romData);
+
+	// True if patchKits wouldn't change anything
+	bool kitsMatch(const std::vector<std::byte>& romData);
+
+	// The hash is calculated when the kit is loaded
+	uint32_t kitHash(int idx) const;
 
 private:
+	std::vector<std::byte> _savHeader;
+	std::vector<LsdjSongName> _songIndex;
+
+	// Projects are only decompressed when they're needed, and are kept until the
+	// header says they've changed (LSDj bumps the version of a project every time
+	// it's saved)
+	std::map<int, std::vector<unsigned char>> _projectCache;
+
 	void loadKitAt(const char* data, size_t size, int idx);
+
+	void syncSongIndex();
+
+	bool readProject(int idx, std::vector<unsigned char>& target);
+
+	// Reads a project along with its name and version, -1 being working memory
+	bool readProjectData(int idx, LsdjDecodedSong& target);
+
+	bool serializeProject(int idx, std::vector<std::byte>& target);
 };
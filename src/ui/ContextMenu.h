@@ -31,7 +31,13 @@ enum class ProjectMenuItems : int {
 	Sep3,
 
 	AudioRouting,
-	MidiRouting
+	MidiRouting,
+
+	Sep4,
+
+	ExportDspStats,
+	ResetDspStats,
+	AdaptiveQuality
 };
 
 enum class BasicMenuItems {
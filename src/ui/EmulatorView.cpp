@@ -5,6 +5,7 @@
 #include "platform/Shell.h"
 #include "util/File.h"
 #include "util/Serializer.h"
+#include "util/ThreadPool.h"
 #include "Buttons.h"
 
 #include <sstream>
@@ -15,7 +16,9 @@
 EmulatorView::EmulatorView(SameBoyPlugPtr plug, RetroPlug* manager, IGraphics* graphics)
 	: _plug(plug), _manager(manager), _graphics(graphics)
 {
-	memset(_videoScratch, 255, VIDEO_SCRATCH_SIZE);
+	if (_plug) {
+		_plug->setViewAttached(true);
+	}
 
 	_settings = {
 		{ "Color Correction", 2 },
@@ -31,14 +34,15 @@ EmulatorView::EmulatorView(SameBoyPlugPtr plug, RetroPlug* manager, IGraphics* g
 		_textIds[i] = new ITextControl(IRECT(0, -100, 0, 0), "", IText(23, COLOR_WHITE));
 		graphics->AttachControl(_textIds[i]);
 	}
+
+	_booting = _plug && _plug->booting();
 }
 
 EmulatorView::~EmulatorView() {
 	HideText();
 
-	if (_imageId != -1) {
-		NVGcontext* ctx = (NVGcontext*)_graphics->GetDrawContext();
-		nvgDeleteImage(ctx, _imageId);
+	if (_plug) {
+		_plug->setViewAttached(false);
 	}
 }
 
@@ -72,12 +76,6 @@ void EmulatorView::SetArea(const IRECT & area) {
 	UpdateTextPosition();
 }
 
-void EmulatorView::Setup(SameBoyPlugPtr plug, RetroPlug* manager) {
-	_plug = plug;
-	_manager = manager;
-	HideText();
-}
-
 bool EmulatorView::OnKey(const IKeyPress& key, bool down) {
 	if (_plug && _plug->active()) {
 		if (_plug->lsdj().found && _plug->lsdj().keyboardShortcuts) {
@@ -97,54 +95,150 @@ bool EmulatorView::OnKey(const IKeyPress& key, bool down) {
 	return false;
 }
 
-void EmulatorView::Draw(IGraphics& g) {
+const VideoFrame* EmulatorView::Update(bool gpuVideo) {
+	// The host decides how often the editor is redrawn (and it varies between
+	// platforms), so everything that depends on time uses the measured delta.
+	double delta = _pacer.tick();
+	const VideoFrame* frame = nullptr;
+
+	_filtersAvailable = gpuVideo;
+
+	if (_booting && !_plug->booting()) {
+		_booting = false;
+		if (_plug->active()) {
+			// Cores start with rendering disabled, and nothing else turns it on once
+			// the view is already open
+			_plug->disableRendering(false);
+			HideText();
+		} else {
+			ShowText("Unable to find", fs::path(_plug->romPath()).filename().string());
+		}
+	}
+
 	if (_plug && _plug->active()) {
 		MessageBus* bus = _plug->messageBus();
 
-		// FIXME: This constant is the delta time between frames.
-		// It is set to this because on windows iPlug doesn't go higher
-		// than 30fps!  Should probably add some proper time calculation here.
-		_lsdjKeyMap.update(bus, 33.3333333);
+		_lsdjKeyMap.update(bus, delta);
 
-		size_t available = bus->video.readAvailable();
-		if (available > 0) {
-			// If we have multiple frames, skip to the latest
-			if (available > VIDEO_FRAME_SIZE) {
-				bus->video.advanceRead(available - VIDEO_FRAME_SIZE);
-			}
-
-			bus->video.read((char*)_videoScratch, VIDEO_FRAME_SIZE);
+		// Indexed frames are only requested while the GPU path is available.  If it
+		// goes away, any indexed frame that is already in flight is resolved on the CPU.
+		_plug->setIndexedVideo(gpuVideo);
 
-			// TODO: This is all a bit unecessary and should be handled in the SameBoy wrapper
-			unsigned char* px = _videoScratch;
-			for (int i = 0; i < VIDEO_WIDTH; i++) {
-				for (int j = 0; j < VIDEO_HEIGHT; j++) {
-					std::swap(px[0], px[2]);
-					px[3] = 255;
-					px += 4;
-				}
-			}
+		if (bus->video.consume()) {
+			frame = &bus->video.readBuffer();
+			_pacer.framePresented(*frame);
+			_hasFrame = true;
 		}
+	}
 
-		DrawPixelBuffer((NVGcontext*)g.GetDrawContext());
+	if (_songImport && _songImport->done()) {
+		FinishSongImport();
 	}
 
-	_fileWatcher.update();
+	if (_importStatusTime > 0) {
+		_importStatusTime -= delta;
+	}
+
+	return frame;
 }
 
-void EmulatorView::DrawPixelBuffer(NVGcontext* vg) {
-	if (_imageId == -1) {
-		_imageId = nvgCreateImageRGBA(vg, VIDEO_WIDTH, VIDEO_HEIGHT, NVG_IMAGE_NEAREST, (const unsigned char*)_videoScratch);
-	} else {
-		nvgUpdateImage(vg, _imageId, (const unsigned char*)_videoScratch);
+const VideoFrame* EmulatorView::LastFrame() const {
+	// The read buffer stays untouched until the next frame is consumed
+	if (_hasFrame && _plug) {
+		return &_plug->messageBus()->video.readBuffer();
+	}
+
+	return nullptr;
+}
+
+VideoCell EmulatorView::GetCell() const {
+	VideoCell cell;
+	cell.area = _area;
+	cell.filter = _filter;
+	cell.visible = _plug && _plug->active();
+	cell.blendEnabled = _frameBlending;
+	cell.blend = _frameBlending && _pacer.canBlend();
+	cell.alpha = _alpha;
+	return cell;
+}
+
+void EmulatorView::DrawOverlay(IGraphics& g) {
+	if (_showFrameStats && _plug && _plug->active()) {
+		DrawFrameStats(g);
+	}
+
+	if (_showDspLoad && _plug && _plug->active()) {
+		DrawDspLoad(g, _showFrameStats ? 18 : 0);
+	}
+
+	if (_songImport || _importStatusTime > 0) {
+		DrawImportStatus(g);
+	}
+}
+
+void EmulatorView::DrawFrameStats(IGraphics& g) {
+	const FrameStats& stats = _pacer.stats();
+
+	char text[128];
+	snprintf(text, sizeof(text), "%.0f Hz  %.1f ms  %llu dropped", stats.refreshRate, stats.latency, (unsigned long long)stats.dropped);
+
+	IRECT area(_area.L, _area.T, _area.R, _area.T + 18);
+	g.FillRect(IColor(160, 0, 0, 0), area);
+	g.DrawText(IText(14, COLOR_WHITE, "Roboto-Regular", EAlign::Near, EVAlign::Middle), text, area.GetPadded(-4, 0, -4, 0));
+}
+
+void EmulatorView::DrawDspLoad(IGraphics& g, float offset) {
+	LoadStats total = _manager->dspLoad().total.stats();
+	LoadStats instance = _plug->loadMeter().stats();
+
+	// Shown as a percentage of the time available for each audio block
+	char text[128];
+	snprintf(text, sizeof(text), "DSP %.0f%% (peak %.0f%%)  this %.0f%%  %llu overruns  %s quality",
+		total.average * 100, total.peak * 100, instance.average * 100, (unsigned long long)total.overruns,
+		qualityLevelName(_manager->governor().level()));
+
+	IRECT area(_area.L, _area.T + offset, _area.R, _area.T + offset + 18);
+	IColor color = total.average > 0.8 ? IColor(255, 255, 96, 96) : COLOR_WHITE;
+	g.FillRect(IColor(160, 0, 0, 0), area);
+	g.DrawText(IText(14, color, "Roboto-Regular", EAlign::Near, EVAlign::Middle), text, area.GetPadded(-4, 0, -4, 0));
+}
+
+void EmulatorView::DrawImportStatus(IGraphics& g) {
+	std::string text = _importStatus;
+	if (_songImport) {
+		text = "Importing songs " + std::to_string(_songImport->completed()) + " / " + std::to_string(_songImport->total());
+	}
+
+	IRECT area(_area.L, _area.B - 18, _area.R, _area.B);
+	g.FillRect(IColor(160, 0, 0, 0), area);
+	g.DrawText(IText(14, COLOR_WHITE, "Roboto-Regular", EAlign::Near, EVAlign::Middle), text.c_str(), area.GetPadded(-4, 0, -4, 0));
+}
+
+void EmulatorView::FinishSongImport() {
+	std::vector<LsdjDecodedSong> songs;
+	std::string error;
+	_songImport->collect(songs, error);
+	_songImport = nullptr;
+
+	size_t imported = 0;
+	Lsdj& lsdj = _plug->lsdj();
+	if (lsdj.found && songs.size() > 0) {
+		_plug->saveBattery(lsdj.saveData);
+		std::vector<int> ids = lsdj.importSongs(songs, error);
+		if (ids.size() > 0) {
+			_plug->loadBattery(lsdj.saveData, false);
+		}
+
+		imported = ids.size();
 	}
 
-	nvgBeginPath(vg);
+	// Errors have been written to the log, a message box would interrupt drawing
+	_importStatus = "Imported " + std::to_string(imported) + " songs";
+	if (error.size() > 0) {
+		_importStatus += ", some failed (see log)";
+	}
 
-	NVGpaint imgPaint = nvgImagePattern(vg, _area.L, _area.T, VIDEO_WIDTH * 2, VIDEO_HEIGHT * 2, 0, _imageId, _alpha);
-	nvgRect(vg, _area.L, _area.T, _area.W(), _area.H());
-	nvgFillPaint(vg, imgPaint);
-	nvgFill(vg);
+	_importStatusTime = 4000;
 }
 
 enum class SystemMenuItems : int {
@@ -214,8 +308,15 @@ void EmulatorView::CreateMenu(IPopupMenu* root, IPopupMenu* projectMenu) {
 		});
 
 		settingsMenu->SetFunction([this, settingsMenu](int indexInMenu, IPopupMenu::Item * itemChosen) {
-			if (indexInMenu == settingsMenu->NItems() - 1) {
+			int itemCount = settingsMenu->NItems();
+			if (indexInMenu == itemCount - 1) {
 				openShellFolder(getContentPath());
+			} else if (indexInMenu == itemCount - 5) {
+				_frameBlending = !_frameBlending;
+			} else if (indexInMenu == itemCount - 4) {
+				_showFrameStats = !_showFrameStats;
+			} else if (indexInMenu == itemCount - 3) {
+				_showDspLoad = !_showDspLoad;
 			}
 		});
 
@@ -224,9 +325,14 @@ void EmulatorView::CreateMenu(IPopupMenu* root, IPopupMenu* projectMenu) {
 			IPopupMenu* syncMenu = createSyncMenu(_plug->gameLink(), lsdj.autoPlay);
 			root->AddItem("LSDj Sync", syncMenu, (int)RootMenuItems::LsdjModes);
 
+			// Only the header block is needed to list the songs, which saves copying
+			// (and locking the emulator for) the whole SRAM every time the menu opens
+			std::byte header[LSDJ_SAV_HEADER_SIZE];
+			if (_plug->readBattery(LSDJ_SAV_HEADER_OFFSET, header, sizeof(header))) {
+				lsdj.updateSongIndex(header, sizeof(header));
+			}
+
 			std::vector<LsdjSongName> songNames;
-			_plug->saveBattery(lsdj.saveData);
-			
 			lsdj.getSongNames(songNames);
 
 			if (!songNames.empty()) {
@@ -344,6 +450,22 @@ IPopupMenu* EmulatorView::CreateSettingsMenu() {
 		});
 	}
 
+	if (_filtersAvailable) {
+		IPopupMenu* filterMenu = new IPopupMenu();
+		for (int i = 0; i < (int)VideoFilter::COUNT; i++) {
+			filterMenu->AddItem(VIDEO_FILTERS[i].name, i);
+		}
+
+		filterMenu->CheckItem((int)_filter, true);
+		settingsMenu->AddItem("Filter", filterMenu);
+		filterMenu->SetFunction([this](int indexInMenu, IPopupMenu::Item* itemChosen) {
+			_filter = (VideoFilter)indexInMenu;
+		});
+	}
+
+	settingsMenu->AddItem("Frame Blending", -1, _frameBlending ? IPopupMenu::Item::kChecked : 0);
+	settingsMenu->AddItem("Show Frame Stats", -1, _showFrameStats ? IPopupMenu::Item::kChecked : 0);
+	settingsMenu->AddItem("Show DSP Load", -1, _showDspLoad ? IPopupMenu::Item::kChecked : 0);
 	settingsMenu->AddSeparator();
 	settingsMenu->AddItem("Open Settings Folder...");
 
@@ -361,7 +483,7 @@ IPopupMenu* EmulatorView::CreateSystemMenu() {
 	menu->AddItem("Reset As", resetAsModel, (int)SystemMenuItems::ResetAs);
 	menu->AddItem("Replace ROM...", (int)SystemMenuItems::ReplaceRom);
 	menu->AddItem("Save ROM...", (int)SystemMenuItems::SaveRom);
-	menu->AddItem("Reset on ROM changes", (int)SystemMenuItems::WatchRom, _watchId != 0 ? IPopupMenu::Item::kChecked : 0);
+	menu->AddItem("Reload on ROM changes", (int)SystemMenuItems::WatchRom, _plug->watchRom() ? IPopupMenu::Item::kChecked : 0);
 	menu->AddSeparator((int)SystemMenuItems::Sep1);
 	menu->AddItem("New .sav", (int)SystemMenuItems::NewSram);
 	menu->AddItem("Load .sav...", (int)SystemMenuItems::LoadSram);
@@ -421,11 +543,13 @@ void EmulatorView::ExportSongs(const std::vector<LsdjSongName>& songNames) {
 				std::vector<NamedData> songData;
 				lsdj.exportSongs(songData);
 
-				for (const auto& song : songData) {
+				ThreadPool::shared().parallelFor(songData.size(), [&](size_t idx) {
 					fs::path p(paths[0]);
-					p /= song.name + ".lsdsng";
-					writeFile(tstr(p.wstring()), song.data);
-				}
+					p /= songData[idx].name + ".lsdsng";
+					if (!writeFile(tstr(p.wstring()), songData[idx].data)) {
+						consoleLogLine("Failed to write " + songData[idx].name);
+					}
+				});
 			}
 		}
 	}
@@ -433,15 +557,32 @@ void EmulatorView::ExportSongs(const std::vector<LsdjSongName>& songNames) {
 
 void EmulatorView::LoadSong(int index) {
 	Lsdj& lsdj = _plug->lsdj();
-	if (lsdj.found) {
-		lsdj.loadSong(index);
-		_plug->loadBattery(lsdj.saveData, true);
+	if (!lsdj.found) {
+		return;
+	}
+
+	// Only the working song and the header are written back, and the whole SRAM
+	// is only read if the project hasn't been decoded since it last changed
+	std::byte header[LSDJ_SAV_HEADER_SIZE];
+	if (_plug->readBattery(LSDJ_SAV_HEADER_OFFSET, header, sizeof(header))) {
+		lsdj.updateSongIndex(header, sizeof(header));
+	}
+
+	if (!lsdj.songCached(index)) {
+		lsdj.saveData.clear();
+		_plug->saveBattery(lsdj.saveData);
+	}
+
+	std::vector<std::byte> patch;
+	if (lsdj.songLoadPatch(index, patch)) {
+		_plug->writeBattery(0, patch.data(), patch.size(), true);
 	}
 }
 
 void EmulatorView::DeleteSong(int index) {
 	Lsdj& lsdj = _plug->lsdj();
 	if (lsdj.found) {
+		_plug->saveBattery(lsdj.saveData);
 		lsdj.deleteSong(index);
 		_plug->loadBattery(lsdj.saveData, false);
 	}
@@ -458,8 +599,7 @@ void EmulatorView::LoadKit(int index) {
 		Lsdj& lsdj = _plug->lsdj();
 		bool exists = lsdj.kitData[index] != nullptr;
 		if (lsdj.loadKit(paths[0], index, error)) {
-			lsdj.patchKits(_plug->romData());
-			_plug->updateRom();
+			_plug->updateRomBanks(lsdj.patchKits(_plug->romData()));
 			
 			if (!exists) {
 				_plug->reset(_plug->model(), true);
@@ -472,8 +612,7 @@ void EmulatorView::LoadKit(int index) {
 
 void EmulatorView::DeleteKit(int index) {
 	Lsdj& lsdj = _plug->lsdj();
-	lsdj.deleteKit(_plug->romData(), index);
-	_plug->updateRom();
+	_plug->updateRomBanks(lsdj.deleteKit(_plug->romData(), index));
 }
 
 void EmulatorView::ExportKit(int index) {
@@ -492,7 +631,7 @@ void EmulatorView::ExportKit(int index) {
 	Lsdj& lsdj = _plug->lsdj();
 	if (lsdj.found) {
 		std::vector<std::byte> kitData;
-		lsdj.exportKit(_plug->romData(), index, kitData);
+		lsdj.exportKit(_plug->rom(), index, kitData);
 
 		if (kitData.size() > 0) {
 			writeFile(path, kitData);
@@ -521,17 +660,7 @@ void EmulatorView::ResetSystem(bool fast) {
 }
 
 void EmulatorView::ToggleWatchRom() {
-	if (_romListener == nullptr) {
-		_romListener = std::make_unique<RomUpdateListener>(_plug);
-		std::string path = fs::path(_plug->romPath()).parent_path().string();
-		_watchId = _fileWatcher.addWatch(path.c_str(), _romListener.get());
-		_plug->setWatchRom(true);
-	} else {
-		_fileWatcher.removeWatch(_watchId);
-		_watchId = 0;
-		_romListener = nullptr;
-		_plug->setWatchRom(false);
-	}	
+	_plug->setWatchRom(!_plug->watchRom());
 }
 
 void EmulatorView::OpenLoadSongsDialog() {
@@ -543,16 +672,8 @@ void EmulatorView::OpenLoadSongsDialog() {
 
 	std::vector<tstring> paths = BasicFileOpen(_graphics, types, true);
 	Lsdj& lsdj = _plug->lsdj();
-	if (lsdj.found) {
-		std::string error;
-		std::vector<int> ids = lsdj.importSongs(paths, error);
-		if (ids.size() > 0) {
-			_plug->loadBattery(lsdj.saveData, false);
-		}
-
-		if (error.size() > 0) {
-			_graphics->ShowMessageBox(error.c_str(), "Import Failed", kMB_OK);
-		}
+	if (lsdj.found && paths.size() > 0 && !_songImport) {
+		_songImport = LsdjSongImport::start(paths);
 	}
 }
 
@@ -586,8 +707,7 @@ void EmulatorView::OpenLoadKitsDialog() {
 			_graphics->ShowMessageBox(error.c_str(), "Import Failed", kMB_OK);
 		}
 
-		lsdj.patchKits(_plug->romData());
-		_plug->updateRom();
+		_plug->updateRomBanks(lsdj.patchKits(_plug->romData()));
 	}
 }
 
@@ -612,8 +732,7 @@ void EmulatorView::OpenReplaceRomDialog() {
 		
 		if (_plug->lsdj().found) {
 			_plug->lsdj().kitData = kits;
-			_plug->lsdj().patchKits(_plug->romData());
-			_plug->updateRom();
+			_plug->updateRomBanks(_plug->lsdj().patchKits(_plug->romData()));
 		}
 
 		_plug->disableRendering(false);
@@ -629,7 +748,7 @@ void EmulatorView::OpenSaveRomDialog() {
 	tstring romName = tstr(_plug->romName() + ".gb");
 	tstring path = BasicFileSave(_graphics, types, romName);
 	if (path.size() > 0) {
-		if (!writeFile(path, _plug->romData())) {
+		if (!writeFile(path, _plug->rom())) {
 			// Fail
 		}
 	}
@@ -8,16 +8,12 @@
 #include "LsdjKeyMap.h"
 #include "nanovg.h"
 #include "ContextMenu.h"
-#include "util/RomWatcher.h"
+#include "FramePacer.h"
+#include "ShaderRenderer.h"
 
 #include <map>
 #include <set>
 
-const int VIDEO_WIDTH = 160;
-const int VIDEO_HEIGHT = 144;
-const int VIDEO_FRAME_SIZE = VIDEO_WIDTH * VIDEO_HEIGHT * 4;
-const int VIDEO_SCRATCH_SIZE = VIDEO_FRAME_SIZE;
-
 using namespace iplug;
 using namespace igraphics;
 
@@ -25,12 +21,18 @@ class EmulatorView {
 private:
 	RetroPlug* _manager = nullptr;
 	SameBoyPlugPtr _plug;
-	unsigned char _videoScratch[VIDEO_SCRATCH_SIZE];
-
-	int _imageId = -1;
-	NVGpaint _imgPaint;
+	bool _hasFrame = false;
+	bool _booting = false;
 	float _alpha = 1.0f;
 
+	bool _filtersAvailable = false;
+	VideoFilter _filter = VideoFilter::NearestNeighbor;
+
+	FramePacer _pacer;
+	bool _frameBlending = false;
+	bool _showFrameStats = false;
+	bool _showDspLoad = false;
+
 	KeyMap _keyMap;
 	LsdjKeyMap _lsdjKeyMap;
 
@@ -45,9 +47,11 @@ private:
 	bool _showText = false;
 	ITextControl* _textIds[2] = { nullptr };
 
-	FW::FileWatcher _fileWatcher;
-	FW::WatchID _watchId = 0;
-	std::unique_ptr<RomUpdateListener> _romListener;
+	// Songs are decoded in the background and packed in to the save on the UI
+	// thread once every file is done
+	std::shared_ptr<LsdjSongImport> _songImport;
+	std::string _importStatus;
+	double _importStatusTime = 0;
 
 public:
 	EmulatorView(SameBoyPlugPtr plug, RetroPlug* manager, IGraphics* graphics);
@@ -63,15 +67,22 @@ public:
 
 	const IRECT& GetArea() const { return _area; }
 
-	void Setup(SameBoyPlugPtr plug, RetroPlug* manager);
-
 	SameBoyPlugPtr Plug() { return _plug; }
 
 	void SetAlpha(float alpha) { _alpha = alpha; }
 
 	bool OnKey(const IKeyPress& key, bool down);
 
-	void Draw(IGraphics& g);
+	// Pulls in the latest frame and runs anything that depends on time.  Returns
+	// null if no new frame arrived.
+	const VideoFrame* Update(bool gpuVideo);
+
+	// The most recent frame, or null if one hasn't arrived yet
+	const VideoFrame* LastFrame() const;
+
+	VideoCell GetCell() const;
+
+	void DrawOverlay(IGraphics& g);
 
 	void CreateMenu(IPopupMenu* root, IPopupMenu* projectMenu);
 
@@ -84,7 +95,13 @@ public:
 	void LoadSong(int index);
 
 private:
-	void DrawPixelBuffer(NVGcontext* vg);
+	void DrawFrameStats(IGraphics& g);
+
+	void DrawDspLoad(IGraphics& g, float offset);
+
+	void DrawImportStatus(IGraphics& g);
+
+	void FinishSongImport();
 
 	IPopupMenu* CreateSettingsMenu();
 
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include "Types.h"
+#include "util/Timing.h"
+
+// Length of a Game Boy frame in ms (4194304 Hz / 70224 cycles per frame)
+const double GAMEBOY_FRAME_TIME = 1000.0 / 59.7275;
+
+// Upper limit on the delta reported to the UI.  Stops queued button presses from
+// all firing at once after the editor has been stalled or hidden.
+const double MAX_FRAME_DELTA = 100.0;
+
+// Weight given to new samples when smoothing the frame stats
+const double FRAME_STATS_SMOOTHING = 0.05;
+
+struct FrameStats {
+	double refreshRate = 0;		// Measured rate at which the UI draws, in Hz
+	double latency = 0;			// Time between a frame being published and presented, in ms
+	uint64_t presented = 0;
+	uint64_t dropped = 0;
+};
+
+// Measures real time between UI draws and keeps track of the frames that were
+// published by the audio thread, so that input timing doesn't depend on how often
+// the host lets the editor redraw.
+class FramePacer {
+private:
+	double _lastTick = 0;
+	double _delta = 0;
+
+	uint64_t _lastSequence = 0;
+	bool _newFrame = false;
+	bool _consecutive = false;
+	double _lastArrival = 0;
+
+	FrameStats _stats;
+
+public:
+	void reset() {
+		*this = FramePacer();
+	}
+
+	// Called once at the start of every draw.  Returns the time since the last draw in ms
+	double tick() {
+		double now = getTimeMs();
+		if (_lastTick == 0) {
+			_delta = 0;
+		} else {
+			_delta = std::min(now - _lastTick, MAX_FRAME_DELTA);
+			double rate = 1000.0 / std::max(now - _lastTick, 1.0);
+			if (_stats.refreshRate == 0) {
+				_stats.refreshRate = rate;
+			} else {
+				smooth(_stats.refreshRate, rate);
+			}
+		}
+
+		_lastTick = now;
+		_newFrame = false;
+		return _delta;
+	}
+
+	void framePresented(const VideoFrame& frame) {
+		// Frames are numbered as they are published, so any gap in the sequence means
+		// a frame was overwritten before the UI got a chance to see it
+		if (_lastSequence != 0 && frame.sequence > _lastSequence + 1) {
+			_stats.dropped += frame.sequence - _lastSequence - 1;
+		}
+
+		if (_stats.presented == 0) {
+			_stats.latency = _lastTick - frame.timestamp;
+		} else {
+			smooth(_stats.latency, _lastTick - frame.timestamp);
+		}
+
+		// Frames that show up on back to back draws (or within a Game Boy frame of each
+		// other when the UI is drawing faster than that) are treated as consecutive
+		double window = std::max(GAMEBOY_FRAME_TIME, _delta) * 1.5;
+		_consecutive = _lastArrival != 0 && _lastTick - _lastArrival < window;
+		_lastArrival = _lastTick;
+		_newFrame = true;
+
+		_stats.presented++;
+		_lastSequence = frame.sequence;
+	}
+
+	// Unchanged frames are never published, so the previous frame is only worth
+	// blending with while frames are arriving back to back.  Once the screen has
+	// been static for more than a frame the current frame is shown on its own.
+	bool canBlend() const {
+		return _consecutive && (_newFrame || _lastTick - _lastArrival < GAMEBOY_FRAME_TIME * 1.5);
+	}
+
+	double delta() const { return _delta; }
+
+	const FrameStats& stats() const { return _stats; }
+
+private:
+	void smooth(double& value, double sample) {
+		value += (sample - value) * FRAME_STATS_SMOOTHING;
+	}
+};
@@ -4,6 +4,7 @@
 #include "platform/FileDialog.h"
 #include "util/File.h"
 #include "util/fs.h"
+#include "util/EventLog.h"
 #include "util/Serializer.h"
 #include "Keys.h"
 
@@ -12,24 +13,24 @@ RetroPlugRoot::RetroPlugRoot(IRECT b, RetroPlug* plug, EHost host): IControl(b),
 }
 
 RetroPlugRoot::~RetroPlugRoot() {
-	for (size_t i = 0; i < MAX_INSTANCES; i++) {
-		auto plug = _plug->getPlug(i);
-		if (plug && plug->active()) {
+	// The views aren't destroyed along with the editor, so detach them here or
+	// the instances would keep sending frames that nothing draws
+	for (const SameBoyPlugPtr& plug : *_plug->instances()) {
+		plug->setViewAttached(false);
+
+		if (plug->active()) {
 			plug->disableRendering(true);
 		}
 	}
 }
 
 void RetroPlugRoot::OnInit() {
-	size_t plugCount = _plug->instanceCount();
-	if (plugCount == 0) {
+	InstanceListPtr instances = _plug->instances();
+	if (instances->empty()) {
 		NewProject();
 	} else {
-		for (size_t i = 0; i < MAX_INSTANCES; i++) {
-			auto plug = _plug->getPlug(i);
-			if (plug) {
-				AddView(plug);
-			}
+		for (const SameBoyPlugPtr& plug : *instances) {
+			AddView(plug);
 		}
 	}
 }
@@ -63,7 +64,7 @@ bool RetroPlugRoot::OnKey(const IKeyPress& key, bool down) {
 void RetroPlugRoot::OnMouseDblClick(float x, float y, const IMouseMod& mod) {
 	if (_active) {
 		auto plug = _active->Plug();
-		if (!plug->active()) {
+		if (!plug->active() && !plug->booting()) {
 			if (plug->romPath().empty()) {
 				OpenLoadProjectOrRomDialog();
 			} else {
@@ -77,7 +78,7 @@ void RetroPlugRoot::OnMouseDown(float x, float y, const IMouseMod& mod) {
 	SelectActiveAtPoint(x, y);
 
 	if (mod.R) {
-		if (_active) {
+		if (_active && !_active->Plug()->booting()) {
 			auto plug = _active->Plug();
 			_menu.Clear();
 
@@ -92,6 +93,9 @@ void RetroPlugRoot::OnMouseDown(float x, float y, const IMouseMod& mod) {
 					case ProjectMenuItems::SaveAs: SaveProjectAs(); break;
 					case ProjectMenuItems::Load: OpenLoadProjectDialog(); break;
 					case ProjectMenuItems::RemoveInstance: RemoveActive(); break;
+					case ProjectMenuItems::ExportDspStats: ExportDspStats(); break;
+					case ProjectMenuItems::ResetDspStats: _plug->resetDspLoad(); break;
+					case ProjectMenuItems::AdaptiveQuality: _plug->governor().setEnabled(!_plug->governor().enabled()); break;
 					}
 				});
 			} else if (!plug->romPath().empty()) {
@@ -126,8 +130,37 @@ void RetroPlugRoot::OnMouseDown(float x, float y, const IMouseMod& mod) {
 }
 
 void RetroPlugRoot::Draw(IGraphics & g) {
+	EVENT_THREAD_NAME("UI");
+	EVENT_SCOPE(DrawFrame, _views.size());
+
+	if (!_atlas.initialized()) {
+		_atlas.init((NVGcontext*)g.GetDrawContext());
+	}
+
+	// Views only upload the cell belonging to them when a new frame arrives.  If
+	// the atlas has been invalidated (by a layout change for example) the last
+	// frame each view received is sent again.
+	bool refresh = _atlas.needsFrames();
+
+	// Links can only be made between instances that are running
+	if (_plug->takeBootsFinished()) {
+		_plug->updateLinkTargets();
+	}
+
+	for (size_t i = 0; i < _views.size(); i++) {
+		EmulatorView* view = _views[i];
+		const VideoFrame* frame = view->Update(_atlas.gpu());
+		if (!frame && refresh) {
+			frame = view->LastFrame();
+		}
+
+		_atlas.setCell(i, view->GetCell(), frame);
+	}
+
+	_atlas.draw(g.GetDrawScale() * g.GetScreenScale());
+
 	for (auto view : _views) {
-		view->Draw(g);
+		view->DrawOverlay(g);
 	}
 }
 
@@ -135,6 +168,9 @@ void RetroPlugRoot::OnDrop(float x, float y, const char* str) {
 	SelectActiveAtPoint(x, y);
 
 	auto plug = _active->Plug();
+	if (plug->booting()) {
+		return;
+	}
 	
 	tstring path = tstr(str);
 	tstring ext = tstr(fs::path(path).extension().wstring());
@@ -147,8 +183,9 @@ void RetroPlugRoot::OnDrop(float x, float y, const char* str) {
 			int idx = lsdj.findEmptyKit();
 			if (idx != -1) {
 				if (lsdj.loadKit(path, idx, error)) {
-					lsdj.patchKits(plug->romData());
-					plug->updateRom();
+					plug->updateRomBanks(lsdj.patchKits(plug->romData()));
+
+					// LSDj only looks for kits when it boots
 					plug->reset(plug->model(), true);
 				} else {
 					// log err
@@ -205,8 +242,7 @@ void RetroPlugRoot::CreatePlugInstance(EmulatorView* view, CreateInstanceType ty
 
 	if (source->lsdj().found && target->lsdj().found) {
 		target->lsdj().kitData = source->lsdj().kitData;
-		target->lsdj().patchKits(target->romData());
-		target->updateRom();
+		target->updateRomBanks(target->lsdj().patchKits(target->romData()));
 	}
 
 	if (type == CreateInstanceType::Duplicate) {
@@ -237,14 +273,16 @@ EmulatorView* RetroPlugRoot::AddView(SameBoyPlugPtr plug) {
 		}
 
 		if (_views.size() == 2) {
-			auto otherPlug = _plug->plugs()[0];
+			auto otherPlug = _plug->getPlug(0);
 			if (otherPlug->lsdj().found) {
 				otherPlug->setGameLink(true);
 			}
 		}
 	}
 
-	if (!plug->active() && !plug->romPath().empty()) {
+	if (plug->booting()) {
+		view->ShowText("Loading", fs::path(plug->romPath()).filename().string());
+	} else if (!plug->active() && !plug->romPath().empty()) {
 		view->ShowText("Unable to find", fs::path(plug->romPath()).filename().string());
 	}
 
@@ -264,6 +302,12 @@ void RetroPlugRoot::UpdateLayout() {
 		}
 	}
 
+	// Grids are as close to square as they can be, filling rows first
+	size_t gridColumns = 1;
+	while (gridColumns * gridColumns < count) {
+		gridColumns++;
+	}
+
 	int windowW = 320;
 	int windowH = 288;
 
@@ -272,12 +316,9 @@ void RetroPlugRoot::UpdateLayout() {
 	} else if (layout == InstanceLayout::Column) {
 		windowH = count * 288;
 	} else if (layout == InstanceLayout::Grid) {
-		if (count > 2) {
-			windowW = 2 * 320;
-			windowH = 2 * 288;
-		} else {
-			windowW = count * 320;
-		}
+		size_t gridRows = (count + gridColumns - 1) / gridColumns;
+		windowW = (int)gridColumns * 320;
+		windowH = (int)gridRows * 288;
 	}
 
 	GetUI()->SetSizeConstraints(320, windowW, 288, windowH);
@@ -294,12 +335,8 @@ void RetroPlugRoot::UpdateLayout() {
 		} else if (layout == InstanceLayout::Column) {
 			gridY = i;
 		} else {
-			if (i < 2) {
-				gridX = i;
-			} else {
-				gridX = i - 2;
-				gridY = 1;
-			}
+			gridX = i % gridColumns;
+			gridY = i / gridColumns;
 		}
 
 		int x = gridX * 320;
@@ -308,6 +345,8 @@ void RetroPlugRoot::UpdateLayout() {
 		IRECT b(x, y, x + 320, y + 288);
 		_views[i]->SetArea(b);
 	}
+
+	_atlas.setLayout(GetRECT(), _views.size());
 }
 
 void RetroPlugRoot::SetActive(EmulatorView* view) {
@@ -322,7 +361,7 @@ void RetroPlugRoot::SetActive(EmulatorView* view) {
 }
 
 IPopupMenu* RetroPlugRoot::CreateProjectMenu(bool loaded) {
-	IPopupMenu* instanceMenu = createInstanceMenu(loaded, _views.size() < 4);
+	IPopupMenu* instanceMenu = createInstanceMenu(loaded, _views.size() < MAX_INSTANCES);
 	IPopupMenu* layoutMenu = createLayoutMenu(_plug->layout());
 	IPopupMenu* saveOptionsMenu = createSaveOptionsMenu(_plug->saveType());
 	IPopupMenu* audioRouting = createAudioRoutingMenu(_plug->audioRouting());
@@ -360,6 +399,11 @@ IPopupMenu* RetroPlugRoot::CreateProjectMenu(bool loaded) {
 		menu->AddItem("MIDI Routing", (int)ProjectMenuItems::MidiRouting, IPopupMenu::Item::kDisabled);
 	}
 
+	menu->AddSeparator((int)ProjectMenuItems::Sep4);
+	menu->AddItem("Export DSP Stats...", (int)ProjectMenuItems::ExportDspStats);
+	menu->AddItem("Reset DSP Stats", (int)ProjectMenuItems::ResetDspStats);
+	menu->AddItem("Adaptive Quality", (int)ProjectMenuItems::AdaptiveQuality, _plug->governor().enabled() ? IPopupMenu::Item::kChecked : 0);
+
 	instanceMenu->SetFunction([this](int idx, IPopupMenu::Item* itemChosen) {
 		CreatePlugInstance(_active, (CreateInstanceType)idx);
 	});
@@ -430,6 +474,19 @@ void RetroPlugRoot::SaveProjectAs() {
 	}
 }
 
+void RetroPlugRoot::ExportDspStats() {
+	std::vector<FileDialogFilters> types = {
+		{ T("JSON Files"), T("*.json") }
+	};
+
+	tstring path = BasicFileSave(GetUI(), types, T("dsp-stats.json"));
+	if (path.size() > 0) {
+		std::string data;
+		serializeDspLoad(data, *_plug);
+		writeFile(path, data);
+	}
+}
+
 void RetroPlugRoot::OpenFindRomDialog() {
 	std::vector<FileDialogFilters> types = {
 		{ T("GameBoy Roms"), T("*.gb;*.gbc") }
@@ -478,16 +535,14 @@ void RetroPlugRoot::LoadProject(const tstring& path) {
 		deserialize(data.c_str(), *_plug);
 		_plug->setProjectPath(path);
 
-		if (_plug->instanceCount() > 0) {
-			for (size_t i = 0; i < MAX_INSTANCES; i++) {
-				auto plug = _plug->plugs()[i];
-				if (plug) {
-					AddView(plug);
-				}
-
-				_activeIdx = 0;
-				SetActive(_views[_activeIdx]);
+		InstanceListPtr instances = _plug->instances();
+		if (!instances->empty()) {
+			for (const SameBoyPlugPtr& plug : *instances) {
+				AddView(plug);
 			}
+
+			_activeIdx = 0;
+			SetActive(_views[_activeIdx]);
 		} else {
 			NewProject();
 		}
@@ -7,6 +7,7 @@
 #include "plugs/RetroPlug.h"
 #include "EmulatorView.h"
 #include "ContextMenu.h"
+#include "VideoAtlas.h"
 
 using namespace iplug;
 using namespace igraphics;
@@ -18,6 +19,9 @@ private:
 	EmulatorView* _active = nullptr;
 	size_t _activeIdx = 0;
 
+	// Frames from every view are drawn from a single texture
+	VideoAtlas _atlas;
+
 	IPopupMenu _menu;
 	EHost _host;
 
@@ -62,6 +66,8 @@ private:
 
 	void SaveProjectAs();
 
+	void ExportDspStats();
+
 	void OpenFindRomDialog();
 
 	void OpenLoadProjectDialog();
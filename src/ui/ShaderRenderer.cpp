@@ -0,0 +1,607 @@
+#include "ShaderRenderer.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "IGraphics_select.h"
+#include "platform/Logger.h"
+
+#if defined IGRAPHICS_GL2
+
+#ifdef __APPLE__
+#include <OpenGL/glext.h>
+#endif
+
+#include "nanovg_gl.h"
+
+// Each copy of the atlas uses 3 texture units: indices, palettes and pixels
+const int TEXTURE_UNIT_COUNT = 6;
+const int INDEX_TEXTURE_UNIT = 0;
+const int PALETTE_TEXTURE_UNIT = 2;
+const int PIXEL_TEXTURE_UNIT = 4;
+
+// Cells are laid out 4 wide in the index and pixel atlases.  The palette atlas
+// has one row per slot.
+const int ATLAS_COLUMNS = 4;
+const int ATLAS_ROWS = (MAX_INSTANCES + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS;
+const int ATLAS_WIDTH = VIDEO_WIDTH * ATLAS_COLUMNS;
+const int ATLAS_HEIGHT = VIDEO_HEIGHT * ATLAS_ROWS;
+
+const int VERTICES_PER_CELL = 6;
+
+enum VertexAttributes {
+	VertexPosition,
+	VertexTexCoord,
+	VertexCellInfo,
+	VertexCellState,
+	VertexCellSize,
+	VertexAttributeCount
+};
+
+struct CellVertex {
+	float x, y;
+	float u, v;
+	float atlasX, atlasY, paletteRow, alpha;
+	float copy, indexed, previousIndexed, blend;
+	float width, height;
+};
+
+static const char* VERTEX_SHADER = R"(
+uniform vec2 output_size;
+
+attribute vec2 vertex;
+attribute vec2 texcoord;
+attribute vec4 cell_info;
+attribute vec4 cell_state;
+attribute vec2 cell_size;
+
+varying vec2 cell_position;
+varying vec4 cell;
+varying vec4 state;
+varying vec2 cell_resolution;
+
+void main() {
+	cell_position = texcoord;
+	cell = cell_info;
+	state = cell_state;
+	cell_resolution = cell_size;
+	gl_Position = vec4(vertex / output_size * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// Stands in for SameBoy's MasterShader.  Filters take their samples through
+// texture(), which finds the cell in the atlas and resolves the palette first, so
+// they see the same colors they would if the frame had been converted on the CPU.
+//
+// cell holds the origin of the cell in the atlas (in texels), the palette row and
+// the alpha to fade to.  state holds which copy of the atlas is current, whether
+// the current and previous frames are indexed, and whether to blend them.
+static const char* FRAGMENT_HEADER = R"(
+uniform sampler2D indices0;
+uniform sampler2D indices1;
+uniform sampler2D palettes0;
+uniform sampler2D palettes1;
+uniform sampler2D pixels0;
+uniform sampler2D pixels1;
+uniform vec2 input_resolution;
+uniform vec2 atlas_size;
+uniform float palette_rows;
+
+varying vec2 cell_position;
+varying vec4 cell;
+varying vec4 state;
+varying vec2 cell_resolution;
+
+bool sample_previous;
+
+#define equal(x, y) ((x) == (y))
+#define inequal(x, y) ((x) != (y))
+#define STATIC
+
+vec4 lookup(vec2 position) {
+	// Filters sample their neighbours, which mustn't bleed in to the next cell
+	vec2 texel = clamp(floor(position * input_resolution), vec2(0.0), input_resolution - 1.0);
+	vec2 uv = (cell.xy + texel + 0.5) / atlas_size;
+
+	bool second = (state.x > 0.5) != sample_previous;
+	bool indexed = sample_previous ? state.z > 0.5 : state.y > 0.5;
+
+	if (indexed) {
+		float index = floor((second ? texture2D(indices1, uv).r : texture2D(indices0, uv).r) * 255.0 + 0.5);
+		vec2 entry = vec2((index + 0.5) / 64.0, (cell.z + 0.5) / palette_rows);
+		return second ? texture2D(palettes1, entry) : texture2D(palettes0, entry);
+	}
+
+	return second ? texture2D(pixels1, uv) : texture2D(pixels0, uv);
+}
+
+#define texture(sampler, position) lookup(position)
+
+#line 1
+)";
+
+// Mixes the current frame 50/50 with the previous one when blending, which is
+// what games that flicker sprites every other frame expect the LCD to do.  The
+// views are drawn over black, so fading is baked in here as well.
+static const char* FRAGMENT_MAIN = R"(
+
+void main() {
+	sample_previous = false;
+	vec4 color = scale(indices0, cell_position, input_resolution, cell_resolution);
+
+	if (state.w > 0.5) {
+		sample_previous = true;
+		color = mix(color, scale(indices0, cell_position, input_resolution, cell_resolution), 0.5);
+	}
+
+	gl_FragColor = vec4(color.rgb * cell.w, 1.0);
+}
+)";
+
+// Everything NanoVG (or anything else drawing in to the same context) might rely
+// on is put back after rendering
+struct GLState {
+	GLint framebuffer;
+	GLint program;
+	GLint arrayBuffer;
+	GLint activeTexture;
+	GLint textures[TEXTURE_UNIT_COUNT];
+	GLint viewport[4];
+	GLfloat clearColor[4];
+	GLboolean blend;
+	GLboolean scissor;
+	GLboolean stencil;
+	GLboolean cull;
+	GLboolean depth;
+
+	void save() {
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+		glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+		glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &arrayBuffer);
+		glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+		for (int i = 0; i < TEXTURE_UNIT_COUNT; i++) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glGetIntegerv(GL_TEXTURE_BINDING_2D, &textures[i]);
+		}
+
+		blend = glIsEnabled(GL_BLEND);
+		scissor = glIsEnabled(GL_SCISSOR_TEST);
+		stencil = glIsEnabled(GL_STENCIL_TEST);
+		cull = glIsEnabled(GL_CULL_FACE);
+		depth = glIsEnabled(GL_DEPTH_TEST);
+	}
+
+	void restore() {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glUseProgram(program);
+		glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+		for (int i = 0; i < TEXTURE_UNIT_COUNT; i++) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+		}
+
+		glActiveTexture(activeTexture);
+
+		setEnabled(GL_BLEND, blend);
+		setEnabled(GL_SCISSOR_TEST, scissor);
+		setEnabled(GL_STENCIL_TEST, stencil);
+		setEnabled(GL_CULL_FACE, cull);
+		setEnabled(GL_DEPTH_TEST, depth);
+	}
+
+	static void setEnabled(GLenum cap, GLboolean enabled) {
+		if (enabled) {
+			glEnable(cap);
+		} else {
+			glDisable(cap);
+		}
+	}
+};
+
+static GLuint compileShader(GLenum type, const std::string& source) {
+	GLuint shader = glCreateShader(type);
+	const char* str = source.c_str();
+	glShaderSource(shader, 1, &str, nullptr);
+	glCompileShader(shader);
+
+	GLint status = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (status != GL_TRUE) {
+		char log[1024] = { 0 };
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		consoleLogLine(std::string("Failed to compile shader: ") + log);
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+static GLuint createTexture(GLint format, int width, int height, GLint filter, const void* data) {
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return texture;
+}
+
+static void addCell(std::vector<CellVertex>& vertices, const VideoCell& cell, const IRECT& bounds, float scale, size_t slot, int copy, bool indexed, bool previousIndexed, bool blend) {
+	float l = (cell.area.L - bounds.L) * scale;
+	float t = (cell.area.T - bounds.T) * scale;
+	float r = (cell.area.R - bounds.L) * scale;
+	float b = (cell.area.B - bounds.T) * scale;
+
+	CellVertex v;
+	v.atlasX = (float)((slot % ATLAS_COLUMNS) * VIDEO_WIDTH);
+	v.atlasY = (float)((slot / ATLAS_COLUMNS) * VIDEO_HEIGHT);
+	v.paletteRow = (float)slot;
+	v.alpha = cell.alpha;
+	v.copy = (float)copy;
+	v.indexed = indexed ? 1.0f : 0.0f;
+	v.previousIndexed = previousIndexed ? 1.0f : 0.0f;
+	v.blend = blend ? 1.0f : 0.0f;
+	v.width = r - l;
+	v.height = b - t;
+
+	const float corners[VERTICES_PER_CELL][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+	for (const auto& corner : corners) {
+		v.u = corner[0];
+		v.v = corner[1];
+		v.x = l + (r - l) * corner[0];
+		v.y = t + (b - t) * corner[1];
+		vertices.push_back(v);
+	}
+}
+
+bool ShaderRenderer::init(NVGcontext* vg) {
+	_vg = vg;
+
+	GLState state;
+	state.save();
+
+	for (int i = 0; i < 2; i++) {
+		_indexTextures[i] = createTexture(GL_LUMINANCE, ATLAS_WIDTH, ATLAS_HEIGHT, GL_NEAREST, nullptr);
+		_paletteTextures[i] = createTexture(GL_RGBA, VIDEO_PALETTE_SIZE, MAX_INSTANCES, GL_NEAREST, nullptr);
+		_pixelTextures[i] = createTexture(GL_RGBA, ATLAS_WIDTH, ATLAS_HEIGHT, GL_NEAREST, nullptr);
+	}
+
+	glGenBuffers(1, &_vertexBuffer);
+
+	// Every other filter is built the first time a view asks for it
+	_valid = getProgram(VideoFilter::NearestNeighbor) != 0;
+	state.restore();
+
+	if (!_valid) {
+		destroy();
+	}
+
+	return _valid;
+}
+
+void ShaderRenderer::destroy() {
+	if (!_vg) {
+		return;
+	}
+
+	destroyTarget();
+
+	for (int i = 0; i < (int)VideoFilter::COUNT; i++) {
+		if (_programs[i]) {
+			glDeleteProgram(_programs[i]);
+			_programs[i] = 0;
+		}
+
+		_programFailed[i] = false;
+	}
+
+	glDeleteTextures(2, _indexTextures);
+	glDeleteTextures(2, _paletteTextures);
+	glDeleteTextures(2, _pixelTextures);
+	glDeleteBuffers(1, &_vertexBuffer);
+
+	for (int i = 0; i < 2; i++) {
+		_indexTextures[i] = _paletteTextures[i] = _pixelTextures[i] = 0;
+	}
+
+	_vertexBuffer = 0;
+	_valid = false;
+	_vg = nullptr;
+	clear();
+}
+
+void ShaderRenderer::clear() {
+	for (Slot& slot : _slots) {
+		slot = Slot();
+	}
+
+	_cellCount = 0;
+	_dirty = true;
+}
+
+void ShaderRenderer::setFrame(size_t slot, const VideoFrame& frame) {
+	if (!_valid || slot >= MAX_INSTANCES) {
+		return;
+	}
+
+	// The copy on screen becomes the previous frame
+	Slot& s = _slots[slot];
+	if (s.hasFrame) {
+		s.current ^= 1;
+		s.hasPrevious = true;
+	}
+
+	s.hasFrame = true;
+	s.indexed[s.current] = frame.indexed;
+
+	GLState state;
+	state.save();
+
+	int x = (int)(slot % ATLAS_COLUMNS) * VIDEO_WIDTH;
+	int y = (int)(slot / ATLAS_COLUMNS) * VIDEO_HEIGHT;
+
+	glActiveTexture(GL_TEXTURE0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if (frame.indexed) {
+		glBindTexture(GL_TEXTURE_2D, _indexTextures[s.current]);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VIDEO_WIDTH, VIDEO_HEIGHT, GL_LUMINANCE, GL_UNSIGNED_BYTE, frame.indices);
+
+		glBindTexture(GL_TEXTURE_2D, _paletteTextures[s.current]);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, (GLint)slot, VIDEO_PALETTE_SIZE, 1, GL_RGBA, GL_UNSIGNED_BYTE, frame.palette);
+	} else {
+		glBindTexture(GL_TEXTURE_2D, _pixelTextures[s.current]);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VIDEO_WIDTH, VIDEO_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, frame.pixels);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	state.restore();
+
+	if (slot < _cellCount && _cells[slot].visible) {
+		_dirty = true;
+	}
+}
+
+void ShaderRenderer::render(const VideoCell* cells, size_t count, const IRECT& bounds, float scale) {
+	if (!_valid) {
+		return;
+	}
+
+	count = std::min(count, (size_t)MAX_INSTANCES);
+	if (count != _cellCount || !std::equal(cells, cells + count, _cells)) {
+		std::copy(cells, cells + count, _cells);
+		_cellCount = count;
+		_dirty = true;
+	}
+
+	// The filters render at the resolution of the backing surface, so the result
+	// is drawn 1:1 rather than being stretched by NanoVG
+	int width = (int)(bounds.W() * scale + 0.5f);
+	int height = (int)(bounds.H() * scale + 0.5f);
+	if (width <= 0 || height <= 0) {
+		return;
+	}
+
+	GLState state;
+	state.save();
+
+	if (width != _width || height != _height) {
+		createTarget(width, height);
+		_dirty = true;
+
+		if (!_valid) {
+			state.restore();
+			destroy();
+			return;
+		}
+	}
+
+	if (!_dirty) {
+		state.restore();
+		return;
+	}
+
+	// Cells are grouped by filter so each program is only bound once
+	std::vector<CellVertex> vertices;
+	std::vector<std::pair<GLuint, GLsizei>> batches;
+	vertices.reserve(count * VERTICES_PER_CELL);
+
+	for (int i = 0; i < (int)VideoFilter::COUNT; i++) {
+		size_t first = vertices.size();
+
+		for (size_t j = 0; j < count; j++) {
+			const VideoCell& cell = cells[j];
+			const Slot& slot = _slots[j];
+			if (cell.visible && (int)cell.filter == i) {
+				bool blend = cell.blend && slot.hasPrevious;
+				addCell(vertices, cell, bounds, scale, j, slot.current, slot.indexed[slot.current], slot.indexed[slot.current ^ 1], blend);
+			}
+		}
+
+		if (vertices.size() > first) {
+			batches.push_back({ getProgram((VideoFilter)i), (GLsizei)(vertices.size() - first) });
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glViewport(0, 0, _width, _height);
+
+	glDisable(GL_BLEND);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	if (!vertices.empty()) {
+		GLuint textures[TEXTURE_UNIT_COUNT] = {
+			_indexTextures[0], _indexTextures[1],
+			_paletteTextures[0], _paletteTextures[1],
+			_pixelTextures[0], _pixelTextures[1]
+		};
+
+		for (int i = 0; i < TEXTURE_UNIT_COUNT; i++) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(CellVertex), vertices.data(), GL_STREAM_DRAW);
+
+		const GLint sizes[VertexAttributeCount] = { 2, 2, 4, 4, 2 };
+		size_t offset = 0;
+		for (int i = 0; i < VertexAttributeCount; i++) {
+			glEnableVertexAttribArray(i);
+			glVertexAttribPointer(i, sizes[i], GL_FLOAT, GL_FALSE, sizeof(CellVertex), (const GLvoid*)offset);
+			offset += sizes[i] * sizeof(float);
+		}
+
+		GLint first = 0;
+		for (const auto& batch : batches) {
+			glUseProgram(batch.first);
+			glUniform2f(glGetUniformLocation(batch.first, "output_size"), (float)_width, (float)_height);
+			glDrawArrays(GL_TRIANGLES, first, batch.second);
+			first += batch.second;
+		}
+
+		for (int i = 0; i < VertexAttributeCount; i++) {
+			glDisableVertexAttribArray(i);
+		}
+	}
+
+	state.restore();
+	_dirty = false;
+}
+
+GLuint ShaderRenderer::getProgram(VideoFilter filter) {
+	int idx = (int)filter;
+	if (!_programs[idx] && !_programFailed[idx]) {
+		_programs[idx] = buildProgram(filter);
+		_programFailed[idx] = _programs[idx] == 0;
+	}
+
+	// Filters that need a newer GLSL version than the context supports fall back
+	// to nearest neighbor
+	if (_programFailed[idx] && filter != VideoFilter::NearestNeighbor) {
+		return getProgram(VideoFilter::NearestNeighbor);
+	}
+
+	return _programs[idx];
+}
+
+GLuint ShaderRenderer::buildProgram(VideoFilter filter) {
+	const VideoFilterSource& source = VIDEO_FILTERS[(int)filter];
+	std::string version = source.integerOps ? "#version 130\n" : "#version 120\n";
+
+	GLuint vertex = compileShader(GL_VERTEX_SHADER, version + VERTEX_SHADER);
+	GLuint fragment = compileShader(GL_FRAGMENT_SHADER, version + FRAGMENT_HEADER + source.source + FRAGMENT_MAIN);
+	if (!vertex || !fragment) {
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	glBindAttribLocation(program, VertexPosition, "vertex");
+	glBindAttribLocation(program, VertexTexCoord, "texcoord");
+	glBindAttribLocation(program, VertexCellInfo, "cell_info");
+	glBindAttribLocation(program, VertexCellState, "cell_state");
+	glBindAttribLocation(program, VertexCellSize, "cell_size");
+	glLinkProgram(program);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		char log[1024] = { 0 };
+		glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+		consoleLogLine(std::string("Failed to link shader: ") + log);
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	const char* samplers[TEXTURE_UNIT_COUNT] = { "indices0", "indices1", "palettes0", "palettes1", "pixels0", "pixels1" };
+
+	glUseProgram(program);
+	for (int i = 0; i < TEXTURE_UNIT_COUNT; i++) {
+		glUniform1i(glGetUniformLocation(program, samplers[i]), i);
+	}
+
+	glUniform2f(glGetUniformLocation(program, "input_resolution"), (float)VIDEO_WIDTH, (float)VIDEO_HEIGHT);
+	glUniform2f(glGetUniformLocation(program, "atlas_size"), (float)ATLAS_WIDTH, (float)ATLAS_HEIGHT);
+	glUniform1f(glGetUniformLocation(program, "palette_rows"), (float)MAX_INSTANCES);
+
+	return program;
+}
+
+void ShaderRenderer::createTarget(int width, int height) {
+	destroyTarget();
+
+	_width = width;
+	_height = height;
+	_texture = createTexture(GL_RGBA, width, height, GL_LINEAR, nullptr);
+
+	glGenFramebuffers(1, &_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _texture, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		consoleLogLine("Failed to create framebuffer for video output");
+		_valid = false;
+		return;
+	}
+
+	_imageId = nvglCreateImageFromHandleGL2(_vg, _texture, width, height, NVG_IMAGE_NODELETE);
+}
+
+void ShaderRenderer::destroyTarget() {
+	if (_imageId != -1) {
+		nvgDeleteImage(_vg, _imageId);
+	}
+
+	if (_framebuffer) {
+		glDeleteFramebuffers(1, &_framebuffer);
+	}
+
+	if (_texture) {
+		glDeleteTextures(1, &_texture);
+	}
+
+	_imageId = -1;
+	_framebuffer = 0;
+	_texture = 0;
+	_width = 0;
+	_height = 0;
+}
+
+#else
+
+// No GPU path for this backend, VideoAtlas draws RGBA8 frames with NanoVG instead
+bool ShaderRenderer::init(NVGcontext* vg) { return false; }
+void ShaderRenderer::destroy() {}
+void ShaderRenderer::clear() {}
+void ShaderRenderer::setFrame(size_t slot, const VideoFrame& frame) {}
+void ShaderRenderer::render(const VideoCell* cells, size_t count, const IRECT& bounds, float scale) {}
+unsigned int ShaderRenderer::getProgram(VideoFilter filter) { return 0; }
+unsigned int ShaderRenderer::buildProgram(VideoFilter filter) { return 0; }
+void ShaderRenderer::createTarget(int width, int height) {}
+void ShaderRenderer::destroyTarget() {}
+
+#endif
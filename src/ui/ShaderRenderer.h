@@ -0,0 +1,102 @@
+#pragma once
+
+#include "IGraphicsStructs.h"
+#include "Types.h"
+#include "VideoFilters.h"
+#include "nanovg.h"
+
+using namespace iplug;
+using namespace igraphics;
+
+// How a single view's frame should be drawn
+struct VideoCell {
+	IRECT area;
+	VideoFilter filter = VideoFilter::NearestNeighbor;
+	bool visible = false;
+	bool blendEnabled = false;	// Frame blending is switched on for the view
+	bool blend = false;			// ...and the previous frame should be mixed in right now
+	float alpha = 1.0f;
+
+	bool operator==(const VideoCell& other) const {
+		return area == other.area && filter == other.filter && visible == other.visible
+			&& blendEnabled == other.blendEnabled && blend == other.blend && alpha == other.alpha;
+	}
+
+	bool operator!=(const VideoCell& other) const { return !(*this == other); }
+};
+
+// Draws the frames of every view on the GPU.  Frames are uploaded in to shared
+// atlas textures (8 bit palette indices plus a row of a palette atlas, or RGBA8
+// when a frame can't be indexed), with each view only touching its own cell.
+// All visible cells are then resolved, scaled with one of SameBoy's filters,
+// blended and faded in a single pass per filter in to an offscreen texture the
+// size of the editor, which NanoVG draws with one fill.
+//
+// Only available with the OpenGL backends - init() fails everywhere else.
+class ShaderRenderer {
+private:
+	// Every slot has two cells, one in each copy of the atlas textures.  New
+	// frames go in to the copy the slot isn't currently showing, so the previous
+	// frame is still around for blending.
+	struct Slot {
+		int current = 0;
+		bool indexed[2] = { false, false };
+		bool hasFrame = false;
+		bool hasPrevious = false;
+	};
+
+	NVGcontext* _vg = nullptr;
+	bool _valid = false;
+
+	unsigned int _programs[(int)VideoFilter::COUNT] = { 0 };
+	bool _programFailed[(int)VideoFilter::COUNT] = { false };
+
+	unsigned int _vertexBuffer = 0;
+	unsigned int _indexTextures[2] = { 0 };
+	unsigned int _paletteTextures[2] = { 0 };
+	unsigned int _pixelTextures[2] = { 0 };
+
+	Slot _slots[MAX_INSTANCES];
+	VideoCell _cells[MAX_INSTANCES];
+	size_t _cellCount = 0;
+
+	unsigned int _framebuffer = 0;
+	unsigned int _texture = 0;
+	int _imageId = -1;
+	int _width = 0;
+	int _height = 0;
+
+	bool _dirty = false;
+
+public:
+	ShaderRenderer() {}
+	~ShaderRenderer() { destroy(); }
+
+	// Must be called with the GL context current (i.e. while drawing)
+	bool init(NVGcontext* vg);
+
+	void destroy();
+
+	bool valid() const { return _valid; }
+
+	// Forgets the frames held by every slot, for when views move between slots
+	void clear();
+
+	// Uploads a frame in to the slot's cell of the atlas
+	void setFrame(size_t slot, const VideoFrame& frame);
+
+	// Renders the cells in to the output texture, if anything has changed since
+	// the last call.  bounds is the area covered by the output, in UI coordinates.
+	void render(const VideoCell* cells, size_t count, const IRECT& bounds, float scale);
+
+	int image() const { return _imageId; }
+
+private:
+	unsigned int getProgram(VideoFilter filter);
+
+	unsigned int buildProgram(VideoFilter filter);
+
+	void createTarget(int width, int height);
+
+	void destroyTarget();
+};
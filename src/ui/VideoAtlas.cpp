@@ -0,0 +1,205 @@
+#include "VideoAtlas.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "util/EventLog.h"
+
+VideoAtlas::VideoAtlas() {
+	memset(&_blankFrame, 0, sizeof(VideoFrame));
+	memset(_blankFrame.pixels, 255, VIDEO_FRAME_SIZE);
+}
+
+VideoAtlas::~VideoAtlas() {
+	destroyImages();
+}
+
+void VideoAtlas::init(NVGcontext* vg) {
+	_vg = vg;
+	_renderer.init(vg);
+	_refresh = true;
+}
+
+void VideoAtlas::setLayout(const IRECT& bounds, size_t count) {
+	_bounds = bounds;
+	_count = std::min(count, (size_t)MAX_INSTANCES);
+	_refresh = true;
+
+	for (VideoCell& cell : _cells) {
+		cell = VideoCell();
+	}
+}
+
+void VideoAtlas::setCell(size_t slot, const VideoCell& cell, const VideoFrame* frame) {
+	if (!_vg || slot >= _count) {
+		return;
+	}
+
+	_cells[slot] = cell;
+
+	if (_refresh && !frame) {
+		frame = &_blankFrame;
+	}
+
+	if (!frame) {
+		return;
+	}
+
+	EVENT_SCOPE(UploadFrame, slot);
+
+	if (_renderer.valid()) {
+		_renderer.setFrame(slot, *frame);
+	} else {
+		uploadPixels(slot, *frame);
+	}
+}
+
+void VideoAtlas::draw(float scale) {
+	if (!_vg) {
+		return;
+	}
+
+	_refresh = false;
+
+	if (_renderer.valid()) {
+		_renderer.render(_cells, _count, _bounds, scale);
+
+		if (_renderer.valid()) {
+			fillCells(_renderer.image(), 1.0f, false);
+			return;
+		}
+
+		// The GPU path failed, frames need to be sent again as RGBA8
+		_refresh = true;
+		return;
+	}
+
+	if (_images[0] == -1) {
+		return;
+	}
+
+	fillCells(_images[0], 1.0f, false);
+	fillCells(_images[1], 0.5f, true);
+
+	// The views are drawn over black, so inactive views are faded with a single
+	// overlay per alpha value rather than drawing each of them transparent
+	for (size_t i = 0; i < _count; i++) {
+		float alpha = _cells[i].alpha;
+		if (!_cells[i].visible || alpha >= 1.0f) {
+			continue;
+		}
+
+		bool drawn = false;
+		for (size_t j = 0; j < i; j++) {
+			drawn |= _cells[j].visible && _cells[j].alpha == alpha;
+		}
+
+		if (drawn) {
+			continue;
+		}
+
+		nvgBeginPath(_vg);
+		for (size_t j = i; j < _count; j++) {
+			const IRECT& area = _cells[j].area;
+			if (_cells[j].visible && _cells[j].alpha == alpha) {
+				nvgRect(_vg, area.L, area.T, area.W(), area.H());
+			}
+		}
+
+		nvgFillColor(_vg, nvgRGBAf(0, 0, 0, 1.0f - alpha));
+		nvgFill(_vg);
+	}
+}
+
+void VideoAtlas::createImages() {
+	destroyImages();
+
+	_width = (int)(_bounds.W() / 2);
+	_height = (int)(_bounds.H() / 2);
+
+	for (int i = 0; i < 2; i++) {
+		_pixels[i].assign(_width * _height, 0xFF000000);
+		_images[i] = nvgCreateImageRGBA(_vg, _width, _height, NVG_IMAGE_NEAREST, (const unsigned char*)_pixels[i].data());
+	}
+
+	for (bool& hasPrevious : _hasPrevious) {
+		hasPrevious = false;
+	}
+}
+
+void VideoAtlas::destroyImages() {
+	for (int i = 0; i < 2; i++) {
+		if (_images[i] != -1) {
+			nvgDeleteImage(_vg, _images[i]);
+			_images[i] = -1;
+		}
+
+		_pixels[i].clear();
+	}
+
+	_width = 0;
+	_height = 0;
+}
+
+void VideoAtlas::uploadPixels(size_t slot, const VideoFrame& frame) {
+	if (_images[0] == -1 || _width != (int)(_bounds.W() / 2) || _height != (int)(_bounds.H() / 2)) {
+		createImages();
+	}
+
+	const VideoCell& cell = _cells[slot];
+	int x = (int)((cell.area.L - _bounds.L) / 2);
+	int y = (int)((cell.area.T - _bounds.T) / 2);
+	if (x < 0 || y < 0 || x + VIDEO_WIDTH > _width || y + VIDEO_HEIGHT > _height) {
+		return;
+	}
+
+	NVGparams* params = nvgInternalParams(_vg);
+
+	// The cell on screen becomes the previous frame, which is only kept while
+	// blending is switched on for the view
+	if (cell.blendEnabled) {
+		for (int row = 0; row < VIDEO_HEIGHT; row++) {
+			size_t offset = (y + row) * _width + x;
+			memcpy(&_pixels[1][offset], &_pixels[0][offset], VIDEO_WIDTH * 4);
+		}
+
+		params->renderUpdateTexture(params->userPtr, _images[1], x, y, VIDEO_WIDTH, VIDEO_HEIGHT, (const unsigned char*)_pixels[1].data());
+		_hasPrevious[slot] = !_refresh;
+	} else {
+		_hasPrevious[slot] = false;
+	}
+
+	for (int row = 0; row < VIDEO_HEIGHT; row++) {
+		uint32_t* target = &_pixels[0][(y + row) * _width + x];
+
+		if (frame.indexed) {
+			const uint8_t* indices = frame.indices + row * VIDEO_WIDTH;
+			for (int i = 0; i < VIDEO_WIDTH; i++) {
+				target[i] = frame.palette[indices[i] & (VIDEO_PALETTE_SIZE - 1)];
+			}
+		} else {
+			memcpy(target, frame.pixels + row * VIDEO_WIDTH, VIDEO_WIDTH * 4);
+		}
+	}
+
+	params->renderUpdateTexture(params->userPtr, _images[0], x, y, VIDEO_WIDTH, VIDEO_HEIGHT, (const unsigned char*)_pixels[0].data());
+}
+
+void VideoAtlas::fillCells(int imageId, float alpha, bool blendOnly) {
+	bool empty = true;
+	nvgBeginPath(_vg);
+
+	for (size_t i = 0; i < _count; i++) {
+		const VideoCell& cell = _cells[i];
+		if (cell.visible && (!blendOnly || (cell.blend && _hasPrevious[i]))) {
+			nvgRect(_vg, cell.area.L, cell.area.T, cell.area.W(), cell.area.H());
+			empty = false;
+		}
+	}
+
+	if (!empty) {
+		NVGpaint paint = nvgImagePattern(_vg, _bounds.L, _bounds.T, _bounds.W(), _bounds.H(), 0, imageId, alpha);
+		nvgFillPaint(_vg, paint);
+		nvgFill(_vg);
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include "IGraphicsStructs.h"
+#include "ShaderRenderer.h"
+#include "nanovg.h"
+
+using namespace iplug;
+using namespace igraphics;
+
+// Packs the frames of every view in to a single texture so they can all be
+// drawn with one fill.  Each view owns a slot, and only the cell belonging to a
+// slot is uploaded when that view receives a new frame.
+//
+// The GPU path is used where available (see ShaderRenderer).  Everywhere else
+// the atlas is a NanoVG image that mirrors the layout of the views at half
+// size, with a second image holding the previous frames for blending.
+class VideoAtlas {
+private:
+	NVGcontext* _vg = nullptr;
+	ShaderRenderer _renderer;
+
+	IRECT _bounds;
+	VideoCell _cells[MAX_INSTANCES];
+	size_t _count = 0;
+
+	// Set when the contents of the atlas no longer match the views, in which case
+	// every slot expects to be given a frame again
+	bool _refresh = true;
+
+	VideoFrame _blankFrame;
+
+	int _images[2] = { -1, -1 };
+	std::vector<uint32_t> _pixels[2];
+	int _width = 0;
+	int _height = 0;
+	bool _hasPrevious[MAX_INSTANCES] = { false };
+
+public:
+	VideoAtlas();
+	~VideoAtlas();
+
+	// Must be called while drawing
+	void init(NVGcontext* vg);
+
+	bool initialized() const { return _vg != nullptr; }
+
+	// True if frames can be sent indexed and filters are available
+	bool gpu() const { return _renderer.valid(); }
+
+	bool needsFrames() const { return _refresh; }
+
+	void setLayout(const IRECT& bounds, size_t count);
+
+	// Frame may be null if the view has nothing new to show
+	void setCell(size_t slot, const VideoCell& cell, const VideoFrame* frame);
+
+	void draw(float scale);
+
+private:
+	void createImages();
+
+	void destroyImages();
+
+	void uploadPixels(size_t slot, const VideoFrame& frame);
+
+	void fillCells(int imageId, float alpha, bool blendOnly);
+};
@@ -0,0 +1,533 @@
+#pragma once
+
+// Scaling filters from SameBoy (thirdparty/SameBoy/Shaders, MIT licensed, Copyright (c) 2015-2019
+// Lior Halphon).  The sources are embedded unmodified; ShaderRenderer provides the STATIC,
+// equal/inequal and texture() definitions that SameBoy's MasterShader would normally supply.
+
+enum class VideoFilter {
+	NearestNeighbor,
+	Bilinear,
+	SmoothBilinear,
+	Scale2x,
+	Scale4x,
+	HQ2x,
+	OmniScale,
+	COUNT
+};
+
+struct VideoFilterSource {
+	const char* name;
+	const char* source;
+
+	// Filters that use integer bit operations need GLSL 1.30
+	bool integerOps;
+};
+
+const VideoFilterSource VIDEO_FILTERS[(int)VideoFilter::COUNT] = {
+	{ "Nearest Neighbor", R"(STATIC vec4 scale(sampler2D image, vec2 position, vec2 input_resolution, vec2 output_resolution)
+{
+    return texture(image, position);
+})", false },
+	{ "Bilinear", R"(STATIC vec4 scale(sampler2D image, vec2 position, vec2 input_resolution, vec2 output_resolution)
+{
+    vec2 pixel = position * input_resolution - vec2(0.5, 0.5);
+
+    vec4 q11 = texture(image, (floor(pixel) + 0.5) / input_resolution);
+    vec4 q12 = texture(image, (vec2(floor(pixel.x), ceil(pixel.y)) + 0.5) / input_resolution);
+    vec4 q21 = texture(image, (vec2(ceil(pixel.x), floor(pixel.y)) + 0.5) / input_resolution);
+    vec4 q22 = texture(image, (ceil(pixel) + 0.5) / input_resolution);
+
+    vec4 r1 = mix(q11, q21, fract(pixel.x));
+    vec4 r2 = mix(q12, q22, fract(pixel.x));
+
+    return mix (r1, r2, fract(pixel.y));
+})", false },
+	{ "Smooth Bilinear", R"(STATIC vec4 scale(sampler2D image, vec2 position, vec2 input_resolution, vec2 output_resolution)
+{
+    vec2 pixel = position * input_resolution - vec2(0.5, 0.5);
+
+    vec4 q11 = texture(image, (floor(pixel) + 0.5) / input_resolution);
+    vec4 q12 = texture(image, (vec2(floor(pixel.x), ceil(pixel.y)) + 0.5) / input_resolution);
+    vec4 q21 = texture(image, (vec2(ceil(pixel.x), floor(pixel.y)) + 0.5) / input_resolution);
+    vec4 q22 = texture(image, (ceil(pixel) + 0.5) / input_resolution);
+
+    vec2 s = smoothstep(0., 1., fract(pixel));
+
+    vec4 r1 = mix(q11, q21, s.x);
+    vec4 r2 = mix(q12, q22, s.x);
+
+    return mix (r1, r2, s.y);
+})", false },
+	{ "Scale2x", R"(/* Shader implementation of Scale2x is adapted from https://gist.github.com/singron/3161079 */
+
+STATIC vec4 scale(sampler2D image, vec2 position, vec2 input_resolution, vec2 output_resolution)
+{
+    // o = offset, the width of a pixel
+    vec2 o = 1.0 / input_resolution;
+    
+    // texel arrangement
+    // A B C
+    // D E F
+    // G H I
+    // vec4 A = texture(image, position + vec2( -o.x,  o.y));
+    vec4 B = texture(image, position + vec2(    0,  o.y));
+    // vec4 C = texture(image, position + vec2(  o.x,  o.y));
+    vec4 D = texture(image, position + vec2( -o.x,    0));
+    vec4 E = texture(image, position + vec2(    0,    0));
+    vec4 F = texture(image, position + vec2(  o.x,    0));
+    // vec4 G = texture(image, position + vec2( -o.x, -o.y));
+    vec4 H = texture(image, position + vec2(    0, -o.y));
+    // vec4 I = texture(image, position + vec2(  o.x, -o.y));
+    vec2 p = position * input_resolution;
+    // p = the position within a pixel [0...1]
+    p = fract(p);
+    if (p.x > .5) {
+        if (p.y > .5) {
+            // Top Right
+            return equal(B, F) && inequal(B, D) && inequal(F, H) ? F : E;
+        } else {
+            // Bottom Right
+            return equal(H, F) && inequal(D, H) && inequal(B, F) ? F : E;
+        }
+    } else {
+        if (p.y > .5) {
+            // Top Left
+            return equal(D, B) && inequal(B, F) && inequal(D, H) ? D : E;
+        } else {
+            // Bottom Left
+            return equal(D, H) && inequal(D, B) && inequal(H, F) ? D : E;
+        }
+    }
+})", false },
+	{ "Scale4x", R"(STATIC vec4 scale2x(sampler2D image, vec2 position, vec2 input_resolution, vec2 output_resolution)
+{
+    // o = offset, the width of a pixel
+    vec2 o = 1.0 / input_resolution;
+    // texel arrangement
+    // A B C
+    // D E F
+    // G H I
+    // vec4 A = texture(image, position + vec2( -o.x,  o.y));
+    vec4 B = texture(image, position + vec2(    0,  o.y));
+    // vec4 C = texture(image, position + vec2(  o.x,  o.y));
+    vec4 D = texture(image, position + vec2( -o.x,    0));
+    vec4 E = texture(image, position + vec2(    0,    0));
+    vec4 F = texture(image, position + vec2(  o.x,    0));
+    // vec4 G = texture(image, position + vec2( -o.x, -o.y));
+    vec4 H = texture(image, position + vec2(    0, -o.y));
+    // vec4 I = texture(image, position + vec2(  o.x, -o.y));
+    vec2 p = position * input_resolution;
+    // p = the position within a pixel [0...1]
+    vec4 R;
+    p = fract(p);
+    if (p.x > .5) {
+        if (p.y > .5) {
+            // Top Right
+            return equal(B, F) && inequal(B, D) && inequal(F, H) ? F : E;
+        } else {
+            // Bottom Right
+            return equal(H, F) && inequal(D, H) && inequal(B, F) ? F : E;
+        }
+    } else {
+        if (p.y > .5) {
+            // Top Left
+            return equal(D, B) && inequal(B, F) && inequal(D, H) ? D : E;
+        } else {
+            // Bottom Left
+            return equal(D, H) && inequal(D, B) && inequal(H, F) ? D : E;
+        }
+    }
+}
+
+STATIC vec4 scale(sampler2D image, vec2 position, vec2 input_resolution, vec2 output_resolution)
+{
+    // o = offset, the width of a pixel
+    vec2 o = 1.0 / (input_resolution * 2.);
+    
+    // texel arrangement
+    // A B C
+    // D E F
+    // G H I
+    // vec4 A = scale2x(image, position + vec2( -o.x,  o.y), input_resolution, output_resolution);
+    vec4 B = scale2x(image, position + vec2(    0,  o.y), input_resolution, output_resolution);
+    // vec4 C = scale2x(image, position + vec2(  o.x,  o.y), input_resolution, output_resolution);
+    vec4 D = scale2x(image, position + vec2( -o.x,    0), input_resolution, output_resolution);
+    vec4 E = scale2x(image, position + vec2(    0,    0), input_resolution, output_resolution);
+    vec4 F = scale2x(image, position + vec2(  o.x,    0), input_resolution, output_resolution);
+    // vec4 G = scale2x(image, position + vec2( -o.x, -o.y), input_resolution, output_resolution);
+    vec4 H = scale2x(image, position + vec2(    0, -o.y), input_resolution, output_resolution);
+    // vec4 I = scale2x(image, position + vec2(  o.x, -o.y), input_resolution, output_resolution);
+    vec2 p = position * input_resolution * 2.;
+    // p = the position within a pixel [0...1]
+    p = fract(p);
+    if (p.x > .5) {
+        if (p.y > .5) {
+            // Top Right
+            return equal(B, F) && inequal(B, D) && inequal(F, H) ? F : E;
+        } else {
+            // Bottom Right
+            return equal(H, F) && inequal(D, H) && inequal(B, F) ? F : E;
+        }
+    } else {
+        if (p.y > .5) {
+            // Top Left
+            return equal(D, B) && inequal(B, F) && inequal(D, H) ? D : E;
+        } else {
+            // Bottom Left
+            return equal(D, H) && inequal(D, B) && inequal(H, F) ? D : E;
+        }
+    }
+})", false },
+	{ "HQ2x", R"(/* Based on this (really good) article: http://blog.pkh.me/p/19-butchering-hqx-scaling-filters.html */
+
+/* The colorspace used by the HQnx filters is not really YUV, despite the algorithm description claims it is. It is
+   also not normalized. Therefore, we shall call the colorspace used by HQnx "HQ Colorspace" to avoid confusion. */
+STATIC vec3 rgb_to_hq_colospace(vec4 rgb)
+{
+    return vec3( 0.250 * rgb.r + 0.250 * rgb.g + 0.250 * rgb.b,
+                 0.250 * rgb.r - 0.000 * rgb.g - 0.250 * rgb.b,
+                -0.125 * rgb.r + 0.250 * rgb.g - 0.125 * rgb.b);
+}
+
+STATIC bool is_different(vec4 a, vec4 b)
+{
+    vec3 diff = abs(rgb_to_hq_colospace(a) - rgb_to_hq_colospace(b));
+    return diff.x > 0.188 || diff.y > 0.027 || diff.z > 0.031;
+}
+
+#define P(m, r) ((pattern & (m)) == (r))
+
+STATIC vec4 interp_2px(vec4 c1, float w1, vec4 c2, float w2)
+{
+    return (c1 * w1 + c2 * w2) / (w1 + w2);
+}
+
+STATIC vec4 interp_3px(vec4 c1, float w1, vec4 c2, float w2, vec4 c3, float w3)
+{
+    return (c1 * w1 + c2 * w2 + c3 * w3) / (w1 + w2 + w3);
+}
+
+STATIC vec4 scale(sampler2D image, vec2 position, vec2 input_resolution, vec2 output_resolution)
+{
+    // o = offset, the width of a pixel
+    vec2 o = 1.0 / input_resolution;
+    
+    /* We always calculate the top left pixel.  If we need a different pixel, we flip the image */
+
+    // p = the position within a pixel [0...1]
+    vec2 p = fract(position * input_resolution);
+
+    if (p.x > 0.5) o.x = -o.x;
+    if (p.y > 0.5) o.y = -o.y;
+
+
+
+    vec4 w0 = texture(image, position + vec2( -o.x, -o.y));
+    vec4 w1 = texture(image, position + vec2(    0, -o.y));
+    vec4 w2 = texture(image, position + vec2(  o.x, -o.y));
+    vec4 w3 = texture(image, position + vec2( -o.x,    0));
+    vec4 w4 = texture(image, position + vec2(    0,    0));
+    vec4 w5 = texture(image, position + vec2(  o.x,    0));
+    vec4 w6 = texture(image, position + vec2( -o.x,  o.y));
+    vec4 w7 = texture(image, position + vec2(    0,  o.y));
+    vec4 w8 = texture(image, position + vec2(  o.x,  o.y));
+
+    int pattern = 0;
+    if (is_different(w0, w4)) pattern |= 1;
+    if (is_different(w1, w4)) pattern |= 2;
+    if (is_different(w2, w4)) pattern |= 4;
+    if (is_different(w3, w4)) pattern |= 8;
+    if (is_different(w5, w4)) pattern |= 16;
+    if (is_different(w6, w4)) pattern |= 32;
+    if (is_different(w7, w4)) pattern |= 64;
+    if (is_different(w8, w4)) pattern |= 128;
+
+    if ((P(0xbf,0x37) || P(0xdb,0x13)) && is_different(w1, w5))
+        return interp_2px(w4, 3.0, w3, 1.0);
+    if ((P(0xdb,0x49) || P(0xef,0x6d)) && is_different(w7, w3))
+        return interp_2px(w4, 3.0, w1, 1.0);
+    if ((P(0x0b,0x0b) || P(0xfe,0x4a) || P(0xfe,0x1a)) && is_different(w3, w1))
+        return w4;
+    if ((P(0x6f,0x2a) || P(0x5b,0x0a) || P(0xbf,0x3a) || P(0xdf,0x5a) ||
+         P(0x9f,0x8a) || P(0xcf,0x8a) || P(0xef,0x4e) || P(0x3f,0x0e) ||
+         P(0xfb,0x5a) || P(0xbb,0x8a) || P(0x7f,0x5a) || P(0xaf,0x8a) ||
+         P(0xeb,0x8a)) && is_different(w3, w1))
+        return interp_2px(w4, 3.0, w0, 1.0);
+    if (P(0x0b,0x08))
+        return interp_3px(w4, 2.0, w0, 1.0, w1, 1.0);
+    if (P(0x0b,0x02))
+        return interp_3px(w4, 2.0, w0, 1.0, w3, 1.0);
+    if (P(0x2f,0x2f))
+        return interp_3px(w4, 1.04, w3, 1.0, w1, 1.0);
+    if (P(0xbf,0x37) || P(0xdb,0x13))
+        return interp_3px(w4, 5.0, w1, 2.0, w3, 1.0);
+    if (P(0xdb,0x49) || P(0xef,0x6d))
+        return interp_3px(w4, 5.0, w3, 2.0, w1, 1.0);
+    if (P(0x1b,0x03) || P(0x4f,0x43) || P(0x8b,0x83) || P(0x6b,0x43))
+        return interp_2px(w4, 3.0, w3, 1.0);
+    if (P(0x4b,0x09) || P(0x8b,0x89) || P(0x1f,0x19) || P(0x3b,0x19))
+        return interp_2px(w4, 3.0, w1, 1.0);
+    if (P(0x7e,0x2a) || P(0xef,0xab) || P(0xbf,0x8f) || P(0x7e,0x0e))
+        return interp_3px(w4, 2.0, w3, 3.0, w1, 3.0);
+    if (P(0xfb,0x6a) || P(0x6f,0x6e) || P(0x3f,0x3e) || P(0xfb,0xfa) ||
+        P(0xdf,0xde) || P(0xdf,0x1e))
+        return interp_2px(w4, 3.0, w0, 1.0);
+    if (P(0x0a,0x00) || P(0x4f,0x4b) || P(0x9f,0x1b) || P(0x2f,0x0b) ||
+        P(0xbe,0x0a) || P(0xee,0x0a) || P(0x7e,0x0a) || P(0xeb,0x4b) ||
+        P(0x3b,0x1b))
+        return interp_3px(w4, 2.0, w3, 1.0, w1, 1.0);
+    
+    return interp_3px(w4, 6.0, w3, 1.0, w1, 1.0);
+})", true },
+	{ "OmniScale", R"(/* OmniScale is derived from the pattern based design of HQnx, but with the following general differences:
+    - The actual output calculating was completely redesigned as resolution independent graphic generator. This allows
+      scaling to any factor.
+    - HQnx approximations that were good enough for a 2x/3x/4x factor were refined, creating smoother gradients.
+    - "Quarters" can be interpolated in more ways than in the HQnx filters 
+    - If a pattern does not provide enough information to determine the suitable scaling interpolation, up to 16 pixels 
+      per quarter are sampled (in contrast to the usual 9) in order to determine the best interpolation. 
+ */
+
+/* We use the same colorspace as the HQ algorithms. */
+STATIC vec3 rgb_to_hq_colospace(vec4 rgb)
+{
+    return vec3( 0.250 * rgb.r + 0.250 * rgb.g + 0.250 * rgb.b,
+                 0.250 * rgb.r - 0.000 * rgb.g - 0.250 * rgb.b,
+                -0.125 * rgb.r + 0.250 * rgb.g - 0.125 * rgb.b);
+}
+
+
+STATIC bool is_different(vec4 a, vec4 b)
+{
+    vec3 diff = abs(rgb_to_hq_colospace(a) - rgb_to_hq_colospace(b));
+    return diff.x > 0.125 || diff.y > 0.027 || diff.z > 0.031;
+}
+
+#define P(m, r) ((pattern & (m)) == (r))
+
+STATIC vec4 scale(sampler2D image, vec2 position, vec2 input_resolution, vec2 output_resolution)
+{
+    // o = offset, the width of a pixel
+    vec2 o = 1.0 / input_resolution;
+    
+    /* We always calculate the top left quarter.  If we need a different quarter, we flip our co-ordinates */
+
+    // p = the position within a pixel [0...1]
+    vec2 p = fract(position * input_resolution);
+
+    if (p.x > 0.5) {
+        o.x = -o.x;
+        p.x = 1.0 - p.x;
+    }
+    if (p.y > 0.5) {
+        o.y = -o.y;
+        p.y = 1.0 - p.y;
+    }
+
+    vec4 w0 = texture(image, position + vec2( -o.x, -o.y));
+    vec4 w1 = texture(image, position + vec2(    0, -o.y));
+    vec4 w2 = texture(image, position + vec2(  o.x, -o.y));
+    vec4 w3 = texture(image, position + vec2( -o.x,    0));
+    vec4 w4 = texture(image, position + vec2(    0,    0));
+    vec4 w5 = texture(image, position + vec2(  o.x,    0));
+    vec4 w6 = texture(image, position + vec2( -o.x,  o.y));
+    vec4 w7 = texture(image, position + vec2(    0,  o.y));
+    vec4 w8 = texture(image, position + vec2(  o.x,  o.y));
+
+    int pattern = 0;
+    if (is_different(w0, w4)) pattern |= 1 << 0;
+    if (is_different(w1, w4)) pattern |= 1 << 1;
+    if (is_different(w2, w4)) pattern |= 1 << 2;
+    if (is_different(w3, w4)) pattern |= 1 << 3;
+    if (is_different(w5, w4)) pattern |= 1 << 4;
+    if (is_different(w6, w4)) pattern |= 1 << 5;
+    if (is_different(w7, w4)) pattern |= 1 << 6;
+    if (is_different(w8, w4)) pattern |= 1 << 7;
+
+    if ((P(0xbf,0x37) || P(0xdb,0x13)) && is_different(w1, w5))
+        return mix(w4, w3, 0.5 - p.x);
+    if ((P(0xdb,0x49) || P(0xef,0x6d)) && is_different(w7, w3))
+        return mix(w4, w1, 0.5 - p.y);
+    if ((P(0x0b,0x0b) || P(0xfe,0x4a) || P(0xfe,0x1a)) && is_different(w3, w1))
+        return w4;
+    if ((P(0x6f,0x2a) || P(0x5b,0x0a) || P(0xbf,0x3a) || P(0xdf,0x5a) ||
+         P(0x9f,0x8a) || P(0xcf,0x8a) || P(0xef,0x4e) || P(0x3f,0x0e) ||
+         P(0xfb,0x5a) || P(0xbb,0x8a) || P(0x7f,0x5a) || P(0xaf,0x8a) ||
+         P(0xeb,0x8a)) && is_different(w3, w1))
+        return mix(w4, mix(w4, w0, 0.5 - p.x), 0.5 - p.y);
+    if (P(0x0b,0x08))
+        return mix(mix(w0 * 0.375 + w1 * 0.25 + w4 * 0.375, w4 * 0.5 + w1 * 0.5, p.x * 2.0), w4, p.y * 2.0);
+    if (P(0x0b,0x02))
+        return mix(mix(w0 * 0.375 + w3 * 0.25 + w4 * 0.375, w4 * 0.5 + w3 * 0.5, p.y * 2.0), w4, p.x * 2.0);
+    if (P(0x2f,0x2f)) {
+        float dist = length(p - vec2(0.5));
+        float pixel_size = length(1.0 / (output_resolution / input_resolution));
+        if (dist < 0.5 - pixel_size / 2) {
+            return w4;
+        }
+        vec4 r;
+        if (is_different(w0, w1) || is_different(w0, w3)) {
+            r = mix(w1, w3, p.y - p.x + 0.5);
+        }
+        else {
+            r = mix(mix(w1 * 0.375 + w0 * 0.25 + w3 * 0.375, w3, p.y * 2.0), w1, p.x * 2.0);
+        }
+
+        if (dist > 0.5 + pixel_size / 2) {
+            return r;
+        }
+        return mix(w4, r, (dist - 0.5 + pixel_size / 2) / pixel_size);
+    }
+    if (P(0xbf,0x37) || P(0xdb,0x13)) {
+        float dist = p.x - 2.0 * p.y;
+        float pixel_size = length(1.0 / (output_resolution / input_resolution)) * sqrt(5.0);
+        if (dist > pixel_size / 2) {
+            return w1;
+        }
+        vec4 r = mix(w3, w4, p.x + 0.5);
+        if (dist < -pixel_size / 2) {
+            return r;
+        }
+        return mix(r, w1, (dist + pixel_size / 2) / pixel_size);
+    }
+    if (P(0xdb,0x49) || P(0xef,0x6d)) {
+        float dist = p.y - 2.0 * p.x;
+        float pixel_size = length(1.0 / (output_resolution / input_resolution)) * sqrt(5.0);
+        if (p.y - 2.0 * p.x > pixel_size / 2) {
+            return w3;
+        }
+        vec4 r = mix(w1, w4, p.x + 0.5);
+        if (dist < -pixel_size / 2) {
+            return r;
+        }
+        return mix(r, w3, (dist + pixel_size / 2) / pixel_size);
+    }
+    if (P(0xbf,0x8f) || P(0x7e,0x0e)) {
+        float dist = p.x + 2.0 * p.y;
+        float pixel_size = length(1.0 / (output_resolution / input_resolution)) * sqrt(5.0);
+
+        if (dist > 1.0 + pixel_size / 2) {
+            return w4;
+        }
+
+        vec4 r;
+        if (is_different(w0, w1) || is_different(w0, w3)) {
+            r = mix(w1, w3, p.y - p.x + 0.5);
+        }
+        else {
+            r = mix(mix(w1 * 0.375 + w0 * 0.25 + w3 * 0.375, w3, p.y * 2.0), w1, p.x * 2.0);
+        }
+
+        if (dist < 1.0 - pixel_size / 2) {
+            return r;
+        }
+
+        return mix(r, w4, (dist + pixel_size / 2 - 1.0) / pixel_size);
+
+    }
+
+    if (P(0x7e,0x2a) || P(0xef,0xab)) {
+        float dist = p.y + 2.0 * p.x;
+        float pixel_size = length(1.0 / (output_resolution / input_resolution)) * sqrt(5.0);
+
+        if (p.y + 2.0 * p.x > 1.0 + pixel_size / 2) {
+            return w4;
+        }
+
+        vec4 r;
+
+        if (is_different(w0, w1) || is_different(w0, w3)) {
+            r = mix(w1, w3, p.y - p.x + 0.5);
+        }
+        else {
+            r = mix(mix(w1 * 0.375 + w0 * 0.25 + w3 * 0.375, w3, p.y * 2.0), w1, p.x * 2.0);
+        }
+
+        if (dist < 1.0 - pixel_size / 2) {
+            return r;
+        }
+
+        return mix(r, w4, (dist + pixel_size / 2 - 1.0) / pixel_size);
+    }
+
+    if (P(0x1b,0x03) || P(0x4f,0x43) || P(0x8b,0x83) || P(0x6b,0x43))
+        return mix(w4, w3, 0.5 - p.x);
+
+    if (P(0x4b,0x09) || P(0x8b,0x89) || P(0x1f,0x19) || P(0x3b,0x19))
+        return mix(w4, w1, 0.5 - p.y);
+
+    if (P(0xfb,0x6a) || P(0x6f,0x6e) || P(0x3f,0x3e) || P(0xfb,0xfa) ||
+        P(0xdf,0xde) || P(0xdf,0x1e))
+        return mix(w4, w0, (1.0 - p.x - p.y) / 2.0);
+
+    if (P(0x4f,0x4b) || P(0x9f,0x1b) || P(0x2f,0x0b) ||
+        P(0xbe,0x0a) || P(0xee,0x0a) || P(0x7e,0x0a) || P(0xeb,0x4b) ||
+        P(0x3b,0x1b)) {
+        float dist = p.x + p.y;
+        float pixel_size = length(1.0 / (output_resolution / input_resolution));
+
+        if (dist > 0.5 + pixel_size / 2) {
+            return w4;
+        }
+
+        vec4 r;
+        if (is_different(w0, w1) || is_different(w0, w3)) {
+            r = mix(w1, w3, p.y - p.x + 0.5);
+        }
+        else {
+            r = mix(mix(w1 * 0.375 + w0 * 0.25 + w3 * 0.375, w3, p.y * 2.0), w1, p.x * 2.0);
+        }
+
+        if (dist < 0.5 - pixel_size / 2) {
+            return r;
+        }
+
+        return mix(r, w4, (dist + pixel_size / 2 - 0.5) / pixel_size);
+    }
+
+    if (P(0x0b,0x01))
+        return mix(mix(w4, w3, 0.5 - p.x), mix(w1, (w1 + w3) / 2.0, 0.5 - p.x), 0.5 - p.y);
+
+    if (P(0x0b,0x00))
+        return mix(mix(w4, w3, 0.5 - p.x), mix(w1, w0, 0.5 - p.x), 0.5 - p.y);
+
+    float dist = p.x + p.y;
+    float pixel_size = length(1.0 / (output_resolution / input_resolution));
+
+    if (dist > 0.5 + pixel_size / 2)
+        return w4;
+
+    /* We need more samples to "solve" this diagonal */
+    vec4 x0 = texture(image, position + vec2( -o.x * 2.0, -o.y * 2.0));
+    vec4 x1 = texture(image, position + vec2( -o.x      , -o.y * 2.0));
+    vec4 x2 = texture(image, position + vec2(  0.0      , -o.y * 2.0));
+    vec4 x3 = texture(image, position + vec2(  o.x      , -o.y * 2.0));
+    vec4 x4 = texture(image, position + vec2( -o.x * 2.0, -o.y      ));
+    vec4 x5 = texture(image, position + vec2( -o.x * 2.0,  0.0      ));
+    vec4 x6 = texture(image, position + vec2( -o.x * 2.0,  o.y      ));
+
+    if (is_different(x0, w4)) pattern |= 1 << 8;
+    if (is_different(x1, w4)) pattern |= 1 << 9;
+    if (is_different(x2, w4)) pattern |= 1 << 10;
+    if (is_different(x3, w4)) pattern |= 1 << 11;
+    if (is_different(x4, w4)) pattern |= 1 << 12;
+    if (is_different(x5, w4)) pattern |= 1 << 13;
+    if (is_different(x6, w4)) pattern |= 1 << 14;
+
+    int diagonal_bias = -7;
+    while (pattern != 0) {
+        diagonal_bias += pattern & 1;
+        pattern >>= 1;
+    }
+
+    if (diagonal_bias <=  0) {
+        vec4 r = mix(w1, w3, p.y - p.x + 0.5);
+        if (dist < 0.5 - pixel_size / 2) {
+            return r;
+        }
+        return mix(r, w4, (dist + pixel_size / 2 - 0.5) / pixel_size);
+    }
+    
+    return w4;
+})", true }
+};
@@ -0,0 +1,249 @@
+#include "AudioWorkers.h"
+
+#include <algorithm>
+#include <climits>
+
+#include "EventLog.h"
+
+#ifdef WIN32
+#include <windows.h>
+#include <avrt.h>
+#pragma comment(lib, "avrt.lib")
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#include <pthread.h>
+#else
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#include <immintrin.h>
+#define AUDIO_WORKERS_PAUSE() _mm_pause()
+#elif defined(__aarch64__)
+#define AUDIO_WORKERS_PAUSE() __asm__ __volatile__("yield")
+#else
+#define AUDIO_WORKERS_PAUSE()
+#endif
+
+// Roughly 10-100 microseconds of spinning, depending on the CPU, before the audio
+// thread starts yielding
+const int SPIN_LIMIT = 2000;
+
+// Posting never blocks, so it's safe from the audio thread
+struct AudioWorkers::Semaphore {
+#ifdef WIN32
+	HANDLE handle = CreateSemaphoreW(nullptr, 0, LONG_MAX, nullptr);
+
+	~Semaphore() { CloseHandle(handle); }
+
+	void post(size_t count) { ReleaseSemaphore(handle, (LONG)count, nullptr); }
+
+	void wait() { WaitForSingleObject(handle, INFINITE); }
+#elif defined(__APPLE__)
+	dispatch_semaphore_t handle = dispatch_semaphore_create(0);
+
+	~Semaphore() { dispatch_release(handle); }
+
+	void post(size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			dispatch_semaphore_signal(handle);
+		}
+	}
+
+	void wait() { dispatch_semaphore_wait(handle, DISPATCH_TIME_FOREVER); }
+#else
+	sem_t handle;
+
+	Semaphore() { sem_init(&handle, 0, 0); }
+
+	~Semaphore() { sem_destroy(&handle); }
+
+	void post(size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			sem_post(&handle);
+		}
+	}
+
+	void wait() {
+		while (sem_wait(&handle) != 0 && errno == EINTR) {}
+	}
+#endif
+};
+
+// Gives the calling thread the scheduling class of a host audio thread for as long
+// as this exists.  A worker that is preempted in the middle of a task holds up the
+// audio thread, which waits for it.  Failing isn't fatal, the worker just runs at
+// normal priority.
+class RealtimePriority {
+private:
+#ifdef WIN32
+	HANDLE _task = nullptr;
+	int _previous = THREAD_PRIORITY_NORMAL;
+#endif
+
+public:
+	RealtimePriority(double periodSeconds) {
+#ifdef WIN32
+		DWORD taskIndex = 0;
+		_task = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+		if (_task) {
+			AvSetMmThreadPriority(_task, AVRT_PRIORITY_HIGH);
+		} else {
+			_previous = GetThreadPriority(GetCurrentThread());
+			SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+		}
+#elif defined(__APPLE__)
+		// The same policy CoreAudio gives its IO threads, with half the period to
+		// do the work in
+		mach_timebase_info_data_t timebase;
+		mach_timebase_info(&timebase);
+		double ticksPerSecond = 1e9 * timebase.denom / timebase.numer;
+
+		thread_time_constraint_policy_data_t policy;
+		policy.period = (uint32_t)(periodSeconds * ticksPerSecond);
+		policy.computation = (uint32_t)(periodSeconds * 0.5 * ticksPerSecond);
+		policy.constraint = policy.period;
+		policy.preemptible = 1;
+		thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY,
+			(thread_policy_t)&policy, THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+#else
+		// Needs CAP_SYS_NICE or an rtprio limit, which audio setups usually grant
+		sched_param param = {};
+		param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+		pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#endif
+	}
+
+	~RealtimePriority() {
+#ifdef WIN32
+		if (_task) {
+			AvRevertMmThreadCharacteristics(_task);
+		} else {
+			SetThreadPriority(GetCurrentThread(), _previous);
+		}
+#endif
+	}
+};
+
+AudioWorkers::AudioWorkers(): _wake(std::make_unique<Semaphore>()) {}
+
+AudioWorkers::~AudioWorkers() {
+	stop();
+}
+
+void AudioWorkers::start(size_t threadCount, double blockSeconds) {
+	if (running() || threadCount == 0) {
+		return;
+	}
+
+	_blockSeconds = blockSeconds;
+	_stopping = false;
+	for (size_t i = 0; i < threadCount; i++) {
+		_threads.emplace_back([this]() { work(); });
+	}
+
+	_running.store(true, std::memory_order_release);
+}
+
+void AudioWorkers::stop() {
+	if (_threads.empty()) {
+		return;
+	}
+
+	_running = false;
+	_stopping = true;
+	_wake->post(_threads.size());
+
+	for (std::thread& thread : _threads) {
+		thread.join();
+	}
+
+	_threads.clear();
+}
+
+void AudioWorkers::run(size_t count, Task task, void* context) {
+	size_t begin = _next.load(std::memory_order_relaxed);
+	size_t end = begin + count;
+
+	// Anyone who reads one of the new fields also sees the odd sequence number
+	uint64_t sequence = _sequence.load(std::memory_order_relaxed);
+	_sequence.store(sequence + 1, std::memory_order_relaxed);
+	_task.store(task, std::memory_order_release);
+	_context.store(context, std::memory_order_release);
+	_begin.store(begin, std::memory_order_release);
+	_end.store(end, std::memory_order_release);
+
+	_sequence.store(sequence + 2, std::memory_order_release);
+
+	// The calling thread does one of the tasks itself
+	size_t wakeCount = std::min(_threads.size(), count - 1);
+	if (wakeCount > 0) {
+		_wake->post(wakeCount);
+	}
+
+	claim(task, context, begin, end);
+
+	// Every task has been claimed by now, so this only waits for the ones workers
+	// are in the middle of: at most one each, and each a single instance's block.
+	// Tasks that no worker woke up in time for were run above.
+	for (int spins = 0; _finished.load(std::memory_order_acquire) != end; spins++) {
+		if (spins < SPIN_LIMIT) {
+			AUDIO_WORKERS_PAUSE();
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void AudioWorkers::work() {
+	EVENT_THREAD_NAME("Audio Worker");
+	RealtimePriority priority(_blockSeconds);
+
+	while (true) {
+		_wake->wait();
+		if (_stopping.load(std::memory_order_acquire)) {
+			return;
+		}
+
+		Task task;
+		void* context;
+		size_t begin;
+		size_t end;
+
+		while (true) {
+			uint64_t sequence = _sequence.load(std::memory_order_acquire);
+			if (sequence & 1) {
+				AUDIO_WORKERS_PAUSE();
+				continue;
+			}
+
+			task = _task.load(std::memory_order_acquire);
+			context = _context.load(std::memory_order_acquire);
+			begin = _begin.load(std::memory_order_acquire);
+			end = _end.load(std::memory_order_acquire);
+
+			if (_sequence.load(std::memory_order_relaxed) == sequence) {
+				break;
+			}
+		}
+
+		claim(task, context, begin, end);
+	}
+}
+
+void AudioWorkers::claim(Task task, void* context, size_t begin, size_t end) {
+	size_t idx = _next.load();
+	while (idx < end) {
+		if (_next.compare_exchange_weak(idx, idx + 1)) {
+			task(context, idx - begin);
+			_finished.fetch_add(1, std::memory_order_release);
+			idx = _next.load();
+		}
+	}
+}
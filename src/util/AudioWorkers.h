@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Threads that help the audio thread emulate instances in parallel.  Unlike
+// ThreadPool, nothing on the audio thread's side locks or allocates: jobs are
+// published through atomics and workers are woken with a semaphore.  Workers run
+// at the same real-time priority as a host audio thread.  Threads are started and
+// stopped off the audio thread.
+class AudioWorkers {
+public:
+	using Task = void(*)(void* context, size_t index);
+
+private:
+	// Wraps the platform's semaphore, see AudioWorkers.cpp
+	struct Semaphore;
+
+	std::vector<std::thread> _threads;
+	std::unique_ptr<Semaphore> _wake;
+	std::atomic<bool> _running = false;
+	std::atomic<bool> _stopping = false;
+
+	// The audio thread's period, which macOS needs for the time constraint policy
+	double _blockSeconds = 0;
+
+	// The current job, written between two increments of _sequence so a worker
+	// can tell when it read a job that was being replaced.  Indices are never
+	// reused, so a worker that reads a job late can't claim work from it once a
+	// newer one has started.
+	std::atomic<uint64_t> _sequence = 0;
+	std::atomic<Task> _task = nullptr;
+	std::atomic<void*> _context = nullptr;
+	std::atomic<size_t> _begin = 0;
+	std::atomic<size_t> _end = 0;
+
+	std::atomic<size_t> _next = 0;
+	std::atomic<size_t> _finished = 0;
+
+public:
+	AudioWorkers();
+	~AudioWorkers();
+
+	// blockSeconds is the length of an audio block
+	void start(size_t threadCount, double blockSeconds);
+
+	void stop();
+
+	bool running() const { return _running.load(std::memory_order_acquire); }
+
+	// Audio thread only.  Calls task for every index in [0, count) and returns
+	// once they have all finished.  The calling thread does its share.
+	void run(size_t count, Task task, void* context);
+
+private:
+	void work();
+
+	void claim(Task task, void* context, size_t begin, size_t end);
+};
@@ -0,0 +1,34 @@
+#include "BootStateCache.h"
+
+// States are around 40-90 KB, and ROMs that are being rebuilt get a new entry
+// every time they change
+const size_t MAX_BOOT_STATES = 16;
+
+BootStateCache& BootStateCache::shared() {
+	static BootStateCache cache;
+	return cache;
+}
+
+BootStatePtr BootStateCache::find(uint64_t romHash, int model) {
+	std::scoped_lock lock(_lock);
+	auto found = _states.find({ romHash, model });
+	return found != _states.end() ? found->second : nullptr;
+}
+
+void BootStateCache::insert(uint64_t romHash, int model, std::vector<std::byte> state) {
+	Key key = { romHash, model };
+	auto ptr = std::make_shared<const std::vector<std::byte>>(std::move(state));
+
+	std::scoped_lock lock(_lock);
+	if (_states.find(key) != _states.end()) {
+		return;
+	}
+
+	_states[key] = ptr;
+	_order.push_back(key);
+
+	if (_order.size() > MAX_BOOT_STATES) {
+		_states.erase(_order.front());
+		_order.pop_front();
+	}
+}
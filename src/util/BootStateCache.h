@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+using BootStatePtr = std::shared_ptr<const std::vector<std::byte>>;
+
+// Emulator states captured the moment the boot ROM hands over to the cartridge,
+// keyed by ROM contents and model.  The boot ROM only reads the cartridge
+// header, so a state can be restored in to any instance running the same ROM
+// (even one with patched kits) in place of running the boot ROM again.
+class BootStateCache {
+private:
+	using Key = std::pair<uint64_t, int>;
+
+	std::mutex _lock;
+	std::map<Key, BootStatePtr> _states;
+	std::deque<Key> _order;
+
+public:
+	static BootStateCache& shared();
+
+	BootStatePtr find(uint64_t romHash, int model);
+
+	void insert(uint64_t romHash, int model, std::vector<std::byte> state);
+};
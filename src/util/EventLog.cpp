@@ -0,0 +1,349 @@
+#include "EventLog.h"
+
+#include <assert.h>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include "Buttons.h"
+#include "QualityGovernor.h"
+
+// 160 KB per thread, which is a few seconds of tracing at 16 instances
+const size_t RING_SIZE = 4096;
+
+const auto DRAIN_INTERVAL = std::chrono::milliseconds(20);
+
+// Enough for the threads that usually start logging at once (the host's audio
+// threads and the workers) to get a ring before the next drain
+const size_t SPARE_RINGS = 8;
+
+struct EventType {
+	const char* name;
+
+	// Null for timed events, which only appear in traces
+	std::string (*format)(const EventRecord& record);
+};
+
+static const char* pressTypeName(int64_t type) {
+	switch (type) {
+	case 0: return "Press";
+	case 1: return "Hold";
+	case 2: return "Release";
+	}
+
+	return "";
+}
+
+static const EventType EVENT_TYPES[] = {
+	{ "TransportChanged", [](const EventRecord& r) { return "Transport running: " + std::to_string(r.args[0]); } },
+	{ "StartPressed", [](const EventRecord& r) { return std::string("Pressing start"); } },
+	{ "ButtonPressed", [](const EventRecord& r) {
+		return std::string("Button ") + pressTypeName(r.args[0]) + ": " + ButtonTypes::toString((ButtonType)r.args[1]);
+	} },
+	{ "ButtonReleased", [](const EventRecord& r) { return "Button Release: " + ButtonTypes::toString((ButtonType)r.args[0]); } },
+	{ "QualityChanged", [](const EventRecord& r) {
+		return std::string("Quality: ") + qualityLevelName((QualityLevel)r.args[0]) + " (DSP load " + std::to_string(r.args[1]) + "%)";
+	} },
+
+	{ "RomReloaded", [](const EventRecord& r) {
+		return "ROM reloaded: " + std::to_string(r.args[0]) + " banks changed in " + std::to_string(r.args[1]) + "ms";
+	} },
+
+	{ "ProcessBlock", nullptr },
+	{ "EmulateInstance", nullptr },
+	{ "EmulateLinked", nullptr },
+	{ "EmulateParallel", nullptr },
+	{ "RenderBatchedAudio", nullptr },
+	{ "DrawFrame", nullptr },
+	{ "UploadFrame", nullptr },
+};
+
+static_assert(sizeof(EVENT_TYPES) / sizeof(EventType) == (size_t)EventId::Count, "Every event needs a type");
+
+static std::atomic<uint64_t> nextGeneration = 0;
+
+static std::mutex sharedLock;
+static size_t sharedRefs = 0;
+static std::atomic<EventLog*> sharedLog = nullptr;
+
+// Owned jointly with the log, so whichever of the thread and the log goes first
+// doesn't leave the other with a dangling ring
+struct EventLog::ThreadRing {
+	std::shared_ptr<Ring> ring;
+	uint64_t generation = 0;
+
+	~ThreadRing() {
+		if (ring) {
+			ring->retired.store(true, std::memory_order_release);
+		}
+	}
+};
+
+EventLog::EventLog(): _start(std::chrono::steady_clock::now()), _generation(++nextGeneration) {
+	if (const char* path = std::getenv("RETROPLUG_LOG")) {
+		setLogFile(path);
+	}
+
+	if (const char* path = std::getenv("RETROPLUG_TRACE")) {
+		startTrace(path);
+	}
+
+	fillPool();
+
+	_thread = std::thread([this]() { run(); });
+}
+
+EventLog::~EventLog() {
+	{
+		std::scoped_lock lock(_lock);
+		_stopping = true;
+	}
+
+	_wake.notify_all();
+	_thread.join();
+
+	stopTrace();
+}
+
+EventLog& EventLog::shared() {
+	EventLog* log = sharedLog.load(std::memory_order_acquire);
+	assert(log);
+	return *log;
+}
+
+void EventLog::retain() {
+	std::scoped_lock lock(sharedLock);
+	if (sharedRefs++ == 0) {
+		sharedLog = new EventLog();
+	}
+}
+
+void EventLog::release() {
+	std::scoped_lock lock(sharedLock);
+	assert(sharedRefs > 0);
+	if (--sharedRefs == 0) {
+		delete sharedLog.exchange(nullptr);
+	}
+}
+
+void EventLog::record(EventId id, uint64_t time, uint64_t duration, int64_t arg0, int64_t arg1) {
+	Ring* ring = threadRing();
+	if (!ring) {
+		_unclaimedDropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	size_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= RING_SIZE) {
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	ring->records[head & (RING_SIZE - 1)] = { time, duration, { arg0, arg1 }, id };
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+void EventLog::setThreadName(const char* name) {
+	if (Ring* ring = threadRing()) {
+		ring->name = name;
+	}
+}
+
+bool EventLog::setLogFile(const std::string& path) {
+	std::scoped_lock lock(_lock);
+	_logFile = std::ofstream(path, std::ios::app);
+	return _logFile.is_open();
+}
+
+bool EventLog::startTrace(const std::string& path) {
+	std::scoped_lock lock(_lock);
+	if (_tracing) {
+		return false;
+	}
+
+	_traceFile = std::ofstream(path, std::ios::trunc);
+	if (!_traceFile.is_open()) {
+		return false;
+	}
+
+	// The JSON array format, which doesn't need closing if the process dies
+	_traceFile << "[";
+	_traceStarted = false;
+	_namedThreads.clear();
+	_tracing = true;
+
+	return true;
+}
+
+void EventLog::stopTrace() {
+	std::scoped_lock lock(_lock);
+	if (!_tracing) {
+		return;
+	}
+
+	drain();
+	_tracing = false;
+
+	_traceFile << "\n]\n";
+	_traceFile.close();
+}
+
+void EventLog::flush() {
+	std::scoped_lock lock(_lock);
+	drain();
+}
+
+// Claiming is a scan over at most MAX_RINGS slots.  Copying the shared_ptr only
+// touches its reference count.
+EventLog::Ring* EventLog::threadRing() {
+	thread_local ThreadRing local;
+	if (local.generation == _generation) {
+		return local.ring.get();
+	}
+
+	if (local.ring) {
+		local.ring->retired.store(true, std::memory_order_release);
+		local.ring = nullptr;
+	}
+
+	size_t count = _ringCount.load(std::memory_order_acquire);
+	for (size_t i = 0; i < count; i++) {
+		Ring& ring = *_rings[i];
+
+		bool claimed = false;
+		if (!ring.claimed.load(std::memory_order_relaxed) && ring.claimed.compare_exchange_strong(claimed, true, std::memory_order_acquire)) {
+			ring.threadId.store(_nextThreadId.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+			local.ring = _rings[i];
+			local.generation = _generation;
+			return &ring;
+		}
+	}
+
+	// Tried again with the next event, by which time the pool may have been filled
+	return nullptr;
+}
+
+// Called from the constructor, or with _lock held
+void EventLog::fillPool() {
+	size_t count = _ringCount.load(std::memory_order_relaxed);
+
+	size_t spare = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (!_rings[i]->claimed.load(std::memory_order_relaxed)) {
+			spare++;
+		}
+	}
+
+	for (; spare < SPARE_RINGS && count < MAX_RINGS; spare++, count++) {
+		auto ring = std::make_shared<Ring>();
+		ring->records.resize(RING_SIZE);
+		_rings[count] = std::move(ring);
+		_ringCount.store(count + 1, std::memory_order_release);
+	}
+}
+
+void EventLog::run() {
+	std::unique_lock lock(_lock);
+	while (!_stopping) {
+		_wake.wait_for(lock, DRAIN_INTERVAL);
+		drain();
+	}
+}
+
+// Called with _lock held, so there's only ever one reader per ring
+void EventLog::drain() {
+	size_t count = _ringCount.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < count; i++) {
+		Ring* ring = _rings[i].get();
+		if (!ring->claimed.load(std::memory_order_acquire)) {
+			continue;
+		}
+
+		// A ring is retired after its thread's last event, so everything read
+		// below is all it will ever hold
+		bool retired = ring->retired.load(std::memory_order_acquire);
+
+		size_t tail = ring->tail.load(std::memory_order_relaxed);
+		size_t head = ring->head.load(std::memory_order_acquire);
+		for (; tail != head; ++tail) {
+			write(*ring, ring->records[tail & (RING_SIZE - 1)]);
+		}
+
+		ring->tail.store(tail, std::memory_order_release);
+
+		uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+		if (dropped > 0) {
+			std::ostream& out = _logFile.is_open() ? _logFile : std::cout;
+			out << "Dropped " << dropped << " events on thread " << ring->threadId << "\n";
+		}
+
+		if (retired) {
+			ring->name = nullptr;
+			ring->retired.store(false, std::memory_order_relaxed);
+			ring->claimed.store(false, std::memory_order_release);
+		}
+	}
+
+	uint64_t unclaimed = _unclaimedDropped.exchange(0, std::memory_order_relaxed);
+	if (unclaimed > 0) {
+		std::ostream& out = _logFile.is_open() ? _logFile : std::cout;
+		out << "Dropped " << unclaimed << " events on threads without a ring\n";
+	}
+
+	fillPool();
+
+	if (_logFile.is_open()) {
+		_logFile.flush();
+	} else {
+		std::cout.flush();
+	}
+
+	if (_tracing) {
+		_traceFile.flush();
+	}
+}
+
+void EventLog::write(const Ring& ring, const EventRecord& record) {
+	const EventType& type = EVENT_TYPES[(size_t)record.id];
+
+	if (type.format) {
+		std::ostream& out = _logFile.is_open() ? _logFile : std::cout;
+		out << type.format(record) << "\n";
+	}
+
+	if (!_tracing) {
+		return;
+	}
+
+	uint32_t threadId = ring.threadId.load(std::memory_order_relaxed);
+
+	char line[256];
+	const char* separator = _traceStarted ? ",\n" : "\n";
+	_traceStarted = true;
+
+	if (threadId >= _namedThreads.size()) {
+		_namedThreads.resize(threadId + 1, false);
+	}
+
+	const char* threadName = ring.name.load();
+	if (threadName && !_namedThreads[threadId]) {
+		_namedThreads[threadId] = true;
+		snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			separator, threadId, threadName);
+		_traceFile << line;
+		separator = ",\n";
+	}
+
+	// Timestamps are in microseconds
+	double ts = record.time / 1000.0;
+	if (type.format) {
+		snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"a\":%" PRId64 ",\"b\":%" PRId64 "}}",
+			separator, type.name, ts, threadId, record.args[0], record.args[1]);
+	} else {
+		snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"arg\":%" PRId64 "}}",
+			separator, type.name, ts, record.duration / 1000.0, threadId, record.args[0]);
+	}
+
+	_traceFile << line;
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Events above this level are compiled out entirely
+#define EVENT_LEVEL_OFF 0
+#define EVENT_LEVEL_INFO 1
+#define EVENT_LEVEL_TRACE 2
+
+#ifndef EVENT_LOG_LEVEL
+#define EVENT_LOG_LEVEL EVENT_LEVEL_TRACE
+#endif
+
+// Every event has a fixed name and formatter (see EventLog.cpp), so only the id
+// and two integers are recorded when it happens
+enum class EventId : uint16_t {
+	TransportChanged,	// running
+	StartPressed,
+	ButtonPressed,		// press type, button
+	ButtonReleased,		// button
+	QualityChanged,		// quality level, load percentage
+	RomReloaded,		// changed banks, milliseconds
+
+	// Timed
+	ProcessBlock,		// frame count
+	EmulateInstance,	// instance index
+	EmulateLinked,		// instance count
+	EmulateParallel,	// instance count
+	RenderBatchedAudio,	// instance count
+	DrawFrame,			// view count
+	UploadFrame,		// slot
+
+	Count
+};
+
+struct EventRecord {
+	uint64_t time;
+	uint64_t duration;
+	int64_t args[2];
+	EventId id;
+};
+
+// Logging and tracing that is safe to use from the audio thread.  Each thread
+// writes fixed size records in to a ring of its own, which a background thread
+// drains every few milliseconds - formatting messages to stdout (or a file), and
+// writing timed events to a Chrome trace that can be opened in Perfetto or
+// chrome://tracing.
+//
+// Recording never locks or allocates.  Rings come from a pool that the drain
+// thread keeps a few spares in, and a thread claims one with its first event.  If
+// none is free, or a ring fills up, events are dropped and counted.  A thread's
+// ring is retired when the thread exits, and goes back to the pool once it has
+// been drained.
+//
+// Setting RETROPLUG_LOG or RETROPLUG_TRACE to a path sends the log there or
+// starts a trace when the log is first used.
+class EventLog {
+private:
+	struct Ring {
+		std::vector<EventRecord> records;
+		std::atomic<size_t> head = 0;
+		std::atomic<size_t> tail = 0;
+		std::atomic<uint64_t> dropped = 0;
+		std::atomic<const char*> name = nullptr;
+		std::atomic<bool> claimed = false;
+		std::atomic<bool> retired = false;
+		std::atomic<uint32_t> threadId = 0;
+	};
+
+	static const size_t MAX_RINGS = 64;
+
+	// Held by each thread that has logged something, see threadRing()
+	struct ThreadRing;
+
+	std::chrono::steady_clock::time_point _start;
+
+	// Tells rings registered with an earlier log apart, as threads can outlive
+	// one log and go on to use the next
+	uint64_t _generation;
+
+	// Slots are only added, by the drain thread, and published through _ringCount
+	std::shared_ptr<Ring> _rings[MAX_RINGS];
+	std::atomic<size_t> _ringCount = 0;
+	std::atomic<uint32_t> _nextThreadId = 1;
+
+	// Events from threads that couldn't get a ring
+	std::atomic<uint64_t> _unclaimedDropped = 0;
+
+	std::atomic<bool> _tracing = false;
+
+	std::thread _thread;
+	std::mutex _lock;
+	std::condition_variable _wake;
+	bool _stopping = false;
+
+	// Only touched by the drain thread, or with _lock held
+	std::ofstream _logFile;
+	std::ofstream _traceFile;
+	bool _traceStarted = false;
+	std::vector<bool> _namedThreads;
+
+public:
+	EventLog();
+	~EventLog();
+
+	// Only valid between retain() and the matching release()
+	static EventLog& shared();
+
+	// Started by the first plugin instance and stopped by the last one, as joining
+	// the drain thread from a static destructor deadlocks when Windows unloads the
+	// plugin
+	static void retain();
+
+	static void release();
+
+	uint64_t now() const {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+	}
+
+	// Timed events are only recorded while a trace is being written
+	bool tracing() const { return _tracing.load(std::memory_order_relaxed); }
+
+	void record(EventId id, uint64_t time, uint64_t duration, int64_t arg0 = 0, int64_t arg1 = 0);
+
+	// Names the calling thread in traces.  The string must outlive the log.
+	void setThreadName(const char* name);
+
+	bool setLogFile(const std::string& path);
+
+	bool startTrace(const std::string& path);
+
+	void stopTrace();
+
+	// Blocks until everything recorded so far has been written
+	void flush();
+
+private:
+	// Null if the pool is empty, in which case the event is dropped
+	Ring* threadRing();
+
+	// Adds rings until there are enough spare ones
+	void fillPool();
+
+	void run();
+
+	void drain();
+
+	void write(const Ring& ring, const EventRecord& record);
+};
+
+// Times the enclosing scope, if a trace is running when it starts
+class EventScope {
+private:
+	EventId _id;
+	int64_t _arg;
+	bool _active;
+	uint64_t _start = 0;
+
+public:
+	EventScope(EventId id, int64_t arg = 0): _id(id), _arg(arg), _active(EventLog::shared().tracing()) {
+		if (_active) {
+			_start = EventLog::shared().now();
+		}
+	}
+
+	~EventScope() {
+		if (_active) {
+			EventLog& log = EventLog::shared();
+			log.record(_id, _start, log.now() - _start, _arg);
+		}
+	}
+};
+
+#define EVENT_CONCAT_INNER(a, b) a##b
+#define EVENT_CONCAT(a, b) EVENT_CONCAT_INNER(a, b)
+
+#if EVENT_LOG_LEVEL >= EVENT_LEVEL_INFO
+#define EVENT_INFO(id, ...) EventLog::shared().record(EventId::id, EventLog::shared().now(), 0, ##__VA_ARGS__)
+#else
+#define EVENT_INFO(id, ...)
+#endif
+
+#if EVENT_LOG_LEVEL >= EVENT_LEVEL_TRACE
+#define EVENT_SCOPE(id, ...) EventScope EVENT_CONCAT(_eventScope, __LINE__)(EventId::id, ##__VA_ARGS__)
+#define EVENT_THREAD_NAME(name) EventLog::shared().setThreadName(name)
+#else
+#define EVENT_SCOPE(id, ...)
+#define EVENT_THREAD_NAME(name)
+#endif
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+// Time constant of the smoothed load, in seconds
+const double LOAD_METER_SMOOTHING = 0.3;
+
+// Each histogram bucket covers 10% of the block budget.  The last one holds
+// everything over budget.
+const size_t LOAD_HISTOGRAM_BUCKETS = 11;
+
+struct LoadStats {
+	double average = 0;		// Fraction of the block budget, smoothed
+	double peak = 0;
+	double last = 0;
+	uint64_t blocks = 0;
+	uint64_t overruns = 0;
+	std::array<uint64_t, LOAD_HISTOGRAM_BUCKETS> histogram = {};
+};
+
+// Measures elapsed time with the highest resolution monotonic clock
+class LoadTimer {
+private:
+	std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+
+public:
+	void restart() { _start = std::chrono::steady_clock::now(); }
+
+	// Seconds since construction or the last restart
+	double elapsed() const {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+	}
+};
+
+// How much of the time available for each audio block something is taking.
+// Only the audio thread adds to it, every other thread just reads.  Resets are
+// requested with a flag and carried out by the audio thread on the next block,
+// so nothing here needs a lock.
+class LoadMeter {
+private:
+	std::atomic<double> _average = 0;
+	std::atomic<double> _peak = 0;
+	std::atomic<double> _last = 0;
+	std::atomic<uint64_t> _blocks = 0;
+	std::atomic<uint64_t> _overruns = 0;
+	std::array<std::atomic<uint64_t>, LOAD_HISTOGRAM_BUCKETS> _histogram = {};
+	std::atomic<bool> _resetPending = false;
+
+public:
+	// Audio thread only.  Both times are in seconds.
+	void add(double time, double budget) {
+		if (budget <= 0) {
+			return;
+		}
+
+		if (_resetPending.exchange(false, std::memory_order_relaxed)) {
+			clear();
+		}
+
+		double load = time / budget;
+		uint64_t blocks = _blocks.load(std::memory_order_relaxed);
+
+		// Weighted by block length so the smoothing doesn't depend on the host's block size
+		double average = load;
+		if (blocks > 0) {
+			double weight = 1.0 - std::exp(-budget / LOAD_METER_SMOOTHING);
+			average = _average.load(std::memory_order_relaxed);
+			average += (load - average) * weight;
+		}
+
+		size_t bucket = load >= 1.0 ? LOAD_HISTOGRAM_BUCKETS - 1 : (size_t)(load * 10);
+
+		_last.store(load, std::memory_order_relaxed);
+		_average.store(average, std::memory_order_relaxed);
+		if (load > _peak.load(std::memory_order_relaxed)) {
+			_peak.store(load, std::memory_order_relaxed);
+		}
+
+		if (load > 1.0) {
+			_overruns.store(_overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		_histogram[bucket].store(_histogram[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		_blocks.store(blocks + 1, std::memory_order_relaxed);
+	}
+
+	// Clears the stats before the next block is added
+	void reset() {
+		_resetPending = true;
+	}
+
+	// Values may be from different blocks, which is fine for display
+	LoadStats stats() const {
+		LoadStats stats;
+		stats.average = _average.load(std::memory_order_relaxed);
+		stats.peak = _peak.load(std::memory_order_relaxed);
+		stats.last = _last.load(std::memory_order_relaxed);
+		stats.blocks = _blocks.load(std::memory_order_relaxed);
+		stats.overruns = _overruns.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < LOAD_HISTOGRAM_BUCKETS; i++) {
+			stats.histogram[i] = _histogram[i].load(std::memory_order_relaxed);
+		}
+
+		return stats;
+	}
+
+private:
+	void clear() {
+		_average.store(0, std::memory_order_relaxed);
+		_peak.store(0, std::memory_order_relaxed);
+		_last.store(0, std::memory_order_relaxed);
+		_blocks.store(0, std::memory_order_relaxed);
+		_overruns.store(0, std::memory_order_relaxed);
+		for (auto& count : _histogram) {
+			count.store(0, std::memory_order_relaxed);
+		}
+	}
+};
+
+// Meters for the stages of each audio block.  Instances have a meter of their own
+// covering their emulation and mixing (see SameBoyPlug::loadMeter()).
+struct DspLoad {
+	LoadMeter total;
+	LoadMeter midi;
+	LoadMeter emulate;
+	LoadMeter mix;
+
+	void reset() {
+		total.reset();
+		midi.reset();
+		emulate.reset();
+		mix.reset();
+	}
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "LoadMeter.h"
+
+enum class QualityLevel : int {
+	// Everything as configured
+	Full,
+
+	// Video is only sent to the UI every other frame
+	Reduced,
+
+	// Video every fourth frame, the high-pass filter is switched off, and
+	// unlinked instances are emulated in parallel on worker threads
+	Minimal
+};
+
+inline const char* qualityLevelName(QualityLevel level) {
+	switch (level) {
+	case QualityLevel::Full: return "Full";
+	case QualityLevel::Reduced: return "Reduced";
+	case QualityLevel::Minimal: return "Minimal";
+	}
+
+	return "";
+}
+
+// Smoothed load above which quality is lowered a step
+const double QUALITY_LOWER_LOAD = 0.75;
+
+// Smoothed load below which quality is raised a step...
+const double QUALITY_RAISE_LOAD = 0.45;
+
+// ...once it has stayed there this long, in seconds
+const double QUALITY_RAISE_TIME = 3.0;
+
+// Time after a change before quality can be lowered again, so the smoothed load
+// has a chance to reflect it
+const double QUALITY_SETTLE_TIME = 0.5;
+
+// Trades emulation quality for time when the audio thread gets close to its
+// deadline, and gives it back once there's headroom again.  Runs on the audio
+// thread at the end of every block, everything else only reads the level.
+class QualityGovernor {
+private:
+	std::atomic<QualityLevel> _level = QualityLevel::Full;
+	std::atomic<bool> _enabled = true;
+	std::atomic<uint64_t> _changes = 0;
+
+	// Audio thread only
+	uint64_t _overruns = 0;
+	double _sinceChange = 0;
+	double _calmTime = 0;
+
+public:
+	QualityLevel level() const { return _level.load(std::memory_order_relaxed); }
+
+	bool enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+	// Returns to full quality on the next block when disabled
+	void setEnabled(bool enabled) { _enabled = enabled; }
+
+	// How many times the level has changed
+	uint64_t changes() const { return _changes.load(std::memory_order_relaxed); }
+
+	// Audio thread only.  Takes the block meter after the block has been added to
+	// it, and the length of the block in seconds.  Returns true if the level changed.
+	bool update(const LoadMeter& meter, double budget) {
+		LoadStats stats = meter.stats();
+		bool overran = stats.overruns > _overruns;
+		_overruns = stats.overruns;
+		_sinceChange += budget;
+
+		QualityLevel current = level();
+		QualityLevel next = current;
+
+		if (!enabled()) {
+			next = QualityLevel::Full;
+		} else if (overran || stats.average > QUALITY_LOWER_LOAD) {
+			_calmTime = 0;
+			if (current != QualityLevel::Minimal && _sinceChange >= QUALITY_SETTLE_TIME) {
+				next = (QualityLevel)((int)current + 1);
+			}
+		} else if (stats.average < QUALITY_RAISE_LOAD) {
+			_calmTime += budget;
+			if (current != QualityLevel::Full && _calmTime >= QUALITY_RAISE_TIME) {
+				next = (QualityLevel)((int)current - 1);
+			}
+		} else {
+			_calmTime = 0;
+		}
+
+		if (next == current) {
+			return false;
+		}
+
+		_level.store(next, std::memory_order_relaxed);
+		_changes.store(_changes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		_sinceChange = 0;
+		_calmTime = 0;
+		return true;
+	}
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Publishes immutable values to one real-time reader (the audio thread), which
+// only does plain atomic loads and stores - no locks and no reference counts.
+//
+// Writers keep ownership of everything.  A value that has been replaced is held
+// until the reader is known to have moved on, and is then freed by a later call
+// to publish() or collect() on the writing thread, never by the reader.
+template <typename T>
+class Rcu {
+private:
+	struct Retired {
+		std::shared_ptr<const T> value;
+		uint64_t epoch;
+	};
+
+	std::atomic<const T*> _current;
+	std::atomic<uint64_t> _epoch = 1;
+
+	// The epoch the reader entered in, or 0 while it's outside a ReadScope
+	mutable std::atomic<uint64_t> _readerEpoch = 0;
+
+	mutable std::mutex _lock;
+	std::shared_ptr<const T> _owned;
+	std::vector<Retired> _retired;
+
+public:
+	// Only one may exist at a time
+	class ReadScope {
+	private:
+		const Rcu& _rcu;
+		const T* _value;
+
+	public:
+		ReadScope(const Rcu& rcu): _rcu(rcu) {
+			_rcu._readerEpoch.store(_rcu._epoch.load());
+			_value = _rcu._current.load();
+		}
+
+		~ReadScope() { _rcu._readerEpoch.store(0); }
+
+		ReadScope(const ReadScope&) = delete;
+		ReadScope& operator=(const ReadScope&) = delete;
+
+		const T& operator*() const { return *_value; }
+
+		const T* operator->() const { return _value; }
+	};
+
+	Rcu(std::shared_ptr<const T> value): _current(value.get()), _owned(std::move(value)) {}
+
+	// For everything but the reader.  The value stays valid for as long as the
+	// pointer is held.
+	std::shared_ptr<const T> get() const {
+		std::scoped_lock lock(_lock);
+		return _owned;
+	}
+
+	void publish(std::shared_ptr<const T> value) {
+		std::scoped_lock lock(_lock);
+		publishLocked(std::move(value));
+	}
+
+	// Publishes a modified copy of the current value.  Writers on different
+	// threads can't lose each other's changes.
+	template <typename Func>
+	void update(Func&& modify) {
+		std::scoped_lock lock(_lock);
+		auto value = std::make_shared<T>(*_owned);
+		modify(*value);
+		publishLocked(std::move(value));
+	}
+
+	// Frees values that the reader can no longer be using
+	void collect() {
+		std::scoped_lock lock(_lock);
+		collectRetired();
+	}
+
+private:
+	void publishLocked(std::shared_ptr<const T> value) {
+		_current.store(value.get());
+		_retired.push_back({ std::move(_owned), _epoch.fetch_add(1) + 1 });
+		_owned = std::move(value);
+		collectRetired();
+	}
+
+	void collectRetired() {
+		uint64_t reader = _readerEpoch.load();
+		_retired.erase(std::remove_if(_retired.begin(), _retired.end(), [reader](const Retired& retired) {
+			return reader == 0 || reader >= retired.epoch;
+		}), _retired.end());
+	}
+};
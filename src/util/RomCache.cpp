@@ -0,0 +1,79 @@
+#include "RomCache.h"
+
+#include <string.h>
+
+#include "util/hash64.h"
+#include "util/File.h"
+#include "util/fs.h"
+
+RomCache& RomCache::shared() {
+	static RomCache cache;
+	return cache;
+}
+
+RomImagePtr RomCache::load(const tstring& path) {
+	std::error_code err;
+	uintmax_t size = fs::file_size(path, err);
+	if (err) {
+		return nullptr;
+	}
+
+	int64_t modified = (int64_t)fs::last_write_time(path, err).time_since_epoch().count();
+	if (err) {
+		return nullptr;
+	}
+
+	{
+		std::scoped_lock lock(_lock);
+		auto found = _paths.find(path);
+		if (found != _paths.end() && found->second.modified == modified && found->second.size == size) {
+			RomImagePtr image = found->second.image.lock();
+			if (image) {
+				return image;
+			}
+		}
+	}
+
+	// Read outside of the lock, other instances may be loading different ROMs
+	auto image = std::make_shared<RomImage>();
+	image->path = path;
+	if (!readFile(path, image->data) || image->data.empty()) {
+		return nullptr;
+	}
+
+	image->hash = hash64::compute(image->data);
+
+	std::scoped_lock lock(_lock);
+	prune();
+
+	RomImagePtr shared = findByContents(*image);
+	if (!shared) {
+		shared = image;
+		_hashes.insert({ image->hash, shared });
+	}
+
+	_paths[path] = Entry { modified, size, shared };
+	return shared;
+}
+
+RomImagePtr RomCache::findByContents(const RomImage& image) {
+	auto range = _hashes.equal_range(image.hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		RomImagePtr existing = it->second.lock();
+		if (existing && existing->data.size() == image.data.size() && memcmp(existing->data.data(), image.data.data(), image.data.size()) == 0) {
+			return existing;
+		}
+	}
+
+	return nullptr;
+}
+
+void RomCache::prune() {
+	for (auto it = _paths.begin(); it != _paths.end();) {
+		it = it->second.image.expired() ? _paths.erase(it) : std::next(it);
+	}
+
+	for (auto it = _hashes.begin(); it != _hashes.end();) {
+		it = it->second.expired() ? _hashes.erase(it) : std::next(it);
+	}
+}
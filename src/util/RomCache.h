@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "util/xstring.h"
+
+// A ROM as read from disk.  Images are shared by every instance that loads the
+// same file (including the emulator cores, which read them in place) and are
+// never modified - an instance that patches its ROM works on its own copy.
+struct RomImage {
+	tstring path;
+	uint64_t hash = 0;
+	std::vector<std::byte> data;
+};
+
+using RomImagePtr = std::shared_ptr<const RomImage>;
+
+// Loading a ROM that another instance already has open doesn't touch the disk or
+// allocate anything.  Files are looked up by path, size and modification time, so
+// a ROM that has been rebuilt is read again.  Images with identical contents are
+// shared even if they were loaded from different paths.
+//
+// The cache doesn't keep anything alive, images are freed along with the last
+// instance using them.
+class RomCache {
+private:
+	struct Entry {
+		int64_t modified = 0;
+		uintmax_t size = 0;
+		std::weak_ptr<const RomImage> image;
+	};
+
+	std::mutex _lock;
+	std::map<tstring, Entry> _paths;
+	std::multimap<uint64_t, std::weak_ptr<const RomImage>> _hashes;
+
+public:
+	static RomCache& shared();
+
+	// Returns null if the file can't be read
+	RomImagePtr load(const tstring& path);
+
+private:
+	RomImagePtr findByContents(const RomImage& image);
+
+	void prune();
+};
@@ -0,0 +1,54 @@
+#include "RomWatcher.h"
+
+#include "util/EventLog.h"
+#include "util/fs.h"
+
+RomWatcher::RomWatcher(const tstring& path): _path(path) {
+	fs::path p(path);
+	_filename = p.filename().string();
+	_thread = std::thread([this, dir = p.parent_path().string()]() { run(dir); });
+}
+
+RomWatcher::~RomWatcher() {
+	{
+		std::scoped_lock lock(_lock);
+		_stopping = true;
+	}
+
+	_wake.notify_all();
+	_thread.join();
+}
+
+void RomWatcher::handleFileAction(FW::WatchID watchid, const FW::String& dir, const FW::String& filename, FW::Action action) {
+	if (filename == _filename && action != FW::Actions::Delete) {
+		_pending = true;
+		_lastChange = std::chrono::steady_clock::now();
+	}
+}
+
+void RomWatcher::run(std::string dir) {
+	EVENT_THREAD_NAME("ROM Watcher");
+
+	FW::FileWatcher watcher;
+	FW::WatchID id;
+	try {
+		id = watcher.addWatch(dir, this);
+	} catch (const FW::Exception&) {
+		return;
+	}
+
+	std::unique_lock lock(_lock);
+	while (!_wake.wait_for(lock, ROM_WATCH_INTERVAL, [this]() { return _stopping; })) {
+		lock.unlock();
+
+		watcher.update();
+		if (_pending && std::chrono::steady_clock::now() - _lastChange >= ROM_RELOAD_DELAY) {
+			_pending = false;
+			_changed = true;
+		}
+
+		lock.lock();
+	}
+
+	watcher.removeWatch(id);
+}
@@ -1,21 +1,53 @@
 #pragma once
 
 #include <FileWatcher/FileWatcher.h>
-#include "plugs/SameBoyPlug.h"
-#include <iostream>
+#include "util/xstring.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
-class RomUpdateListener : public FW::FileWatchListener {
+// How long a ROM has to go without being written to before it's reloaded.  Build
+// tools tend to write the file in several goes.
+const std::chrono::milliseconds ROM_RELOAD_DELAY(50);
+
+// How often the watcher thread checks for file system events
+const std::chrono::milliseconds ROM_WATCH_INTERVAL(10);
+
+// Watches a ROM file for changes, see SameBoyPlug::setWatchRom().  The directory
+// is watched on a thread of its own, as the file watcher has to be polled from the
+// thread that created it.  The thread only notices changes - the reload itself is
+// left to the UI thread, which everything it touches belongs to.
+class RomWatcher : public FW::FileWatchListener {
 private:
-	SameBoyPlugPtr _plug;
+	tstring _path;
+	std::string _filename;
+
+	std::thread _thread;
+	std::mutex _lock;
+	std::condition_variable _wake;
+	bool _stopping = false;
+
+	// Set once a change has settled, cleared by takeChanged()
+	std::atomic<bool> _changed = false;
+
+	// Watcher thread only
+	bool _pending = false;
+	std::chrono::steady_clock::time_point _lastChange;
 
 public:
-	RomUpdateListener(SameBoyPlugPtr plug): _plug(plug) {}
-	~RomUpdateListener() {}
-
-	void handleFileAction(FW::WatchID watchid, const FW::String& dir, const FW::String& filename, FW::Action action) {
-		if (fs::path(_plug->romPath()).filename().string() == filename && action != FW::Actions::Delete) {
-			_plug->init(_plug->romPath(), _plug->model(), true);
-			_plug->disableRendering(false);
-		}
-	}
+	RomWatcher(const tstring& path);
+	~RomWatcher();
+
+	const tstring& path() const { return _path; }
+
+	// True once after the file has changed and then been left alone for
+	// ROM_RELOAD_DELAY
+	bool takeChanged() { return _changed.exchange(false); }
+
+	void handleFileAction(FW::WatchID watchid, const FW::String& dir, const FW::String& filename, FW::Action action) override;
+
+private:
+	void run(std::string dir);
 };
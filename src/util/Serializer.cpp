@@ -5,8 +5,8 @@
 #include "plugs/SameBoyPlug.h"
 #include "base64.h"
 #include "roms/Lsdj.h"
+#include "crc32.h"
 #include "fs.h"
-#include "util/crc32.h"
 
 #include "rapidjson/document.h"
 #include "rapidjson/prettywriter.h"
@@ -42,6 +42,22 @@ std::string modelToString(GameboyModel model) {
 	}
 }
 
+// Encodes straight in to memory owned by the document, rather than going through a
+// std::string that rapidjson would then copy
+template <typename Allocator>
+rapidjson::Value base64Value(const std::byte* data, size_t size, Allocator& a) {
+	size_t encodedSize = base64_encoded_size(size);
+	char* target = (char*)a.Malloc(encodedSize + 1);
+	base64_encode((const unsigned char*)data, size, target);
+	target[encodedSize] = '\0';
+
+	return rapidjson::Value(rapidjson::StringRef(target, encodedSize));
+}
+
+std::vector<std::byte> base64Value(const rapidjson::Value& value) {
+	return base64_decode(value.GetString(), value.GetStringLength());
+}
+
 GameboyModel stringToModel(const std::string & model) {
 	if (model == "DMG_B") return GameboyModel::DmgB;
 	if (model == "CGB_C") return GameboyModel::CgbC;
@@ -100,7 +116,10 @@ MidiChannelRouting stringToMidiRouting(const std::string & model) {
 }
 
 void serialize(std::string & target, const RetroPlug & manager) {
-	const SameBoyPlugPtr* plugs = manager.plugs();
+	// Instances that are still booting don't have any state to save yet
+	manager.waitForBoots();
+
+	InstanceListPtr plugs = manager.instances();
 
 	rapidjson::Document root(rapidjson::kObjectType);
 	auto& a = root.GetAllocator();
@@ -117,80 +136,74 @@ void serialize(std::string & target, const RetroPlug & manager) {
 
 	rapidjson::Value instances(rapidjson::kArrayType);
 
-	for (size_t i = 0; i < MAX_INSTANCES; i++) {
-		const SameBoyPlugPtr plug = plugs[i];
-		if (plug) {
-			rapidjson::Value gb(rapidjson::kObjectType);
-			gb.AddMember("model", modelToString(plug->model()), a);
-			gb.AddMember("gameLink", plug->gameLink(), a);
-
-			rapidjson::Value sb(rapidjson::kObjectType);
-			sb.AddMember("colorCorrection", "emulateHardware", a);
-			sb.AddMember("highpassFilter", "accurate", a);
-
-			rapidjson::Value rp(rapidjson::kObjectType);
-			sb.AddMember("watchRom", plug->watchRom(), a);
-
-			rapidjson::Value settings(rapidjson::kObjectType);
-			settings.AddMember("gameBoy", gb, a);
-			settings.AddMember("sameBoy", sb, a);
-			settings.AddMember("retroPlug", rp, a);
-
-			const Lsdj& lsdj = plug->lsdj();
-			if (lsdj.found) {
-				rapidjson::Value l(rapidjson::kObjectType);
-				l.AddMember("syncMode", syncModeToString(lsdj.syncMode), a);
-				l.AddMember("autoPlay", lsdj.autoPlay.load(), a);
-				l.AddMember("keyboardShortcuts", lsdj.keyboardShortcuts.load(), a);
-
-				rapidjson::Value kits(rapidjson::kObjectType);
-				for (size_t i = 0; i < lsdj.kitData.size(); ++i) {
-					auto kit = lsdj.kitData[i];
-					if (kit) {
-						rapidjson::Value id;
-						id.SetString(std::to_string(i), a);
-
-						rapidjson::Value kitData(rapidjson::kObjectType);
-						kitData.AddMember("name", kit->name, a);
-						kitData.AddMember("checksum", kit->hash, a);
-
-						std::string kitDataStr = base64_encode((const unsigned char*)kit->data.data(), kit->data.size());
-						kitData.AddMember("data", kitDataStr, a);
-
-						kits.AddMember(id, kitData, a);
-					}
-				}
+	for (const SameBoyPlugPtr& plug : *plugs) {
+		rapidjson::Value gb(rapidjson::kObjectType);
+		gb.AddMember("model", modelToString(plug->model()), a);
+		gb.AddMember("gameLink", plug->gameLink(), a);
 
-				l.AddMember("kits", kits, a);
+		rapidjson::Value sb(rapidjson::kObjectType);
+		sb.AddMember("colorCorrection", "emulateHardware", a);
+		sb.AddMember("highpassFilter", "accurate", a);
 
-				settings.AddMember("lsdj", l, a);
-			}
+		rapidjson::Value rp(rapidjson::kObjectType);
+		sb.AddMember("watchRom", plug->watchRom(), a);
+
+		rapidjson::Value settings(rapidjson::kObjectType);
+		settings.AddMember("gameBoy", gb, a);
+		settings.AddMember("sameBoy", sb, a);
+		settings.AddMember("retroPlug", rp, a);
+
+		const Lsdj& lsdj = plug->lsdj();
+		if (lsdj.found) {
+			rapidjson::Value l(rapidjson::kObjectType);
+			l.AddMember("syncMode", syncModeToString(lsdj.syncMode), a);
+			l.AddMember("autoPlay", lsdj.autoPlay.load(), a);
+			l.AddMember("keyboardShortcuts", lsdj.keyboardShortcuts.load(), a);
+
+			rapidjson::Value kits(rapidjson::kObjectType);
+			for (size_t i = 0; i < lsdj.kitData.size(); ++i) {
+				auto kit = lsdj.kitData[i];
+				if (kit) {
+					rapidjson::Value id;
+					id.SetString(std::to_string(i), a);
+
+					rapidjson::Value kitData(rapidjson::kObjectType);
+					kitData.AddMember("name", kit->name, a);
+					kitData.AddMember("checksum", lsdj.kitHash(i), a);
+
+					kitData.AddMember("data", base64Value(kit->data.data(), kit->data.size(), a), a);
 
-			std::vector<std::byte> saveState;
-			if (plug->active()) {
-				if (manager.saveType() == SaveStateType::State) {
-					plug->saveState(saveState);
-				} else {
-					plug->saveBattery(saveState);
+					kits.AddMember(id, kitData, a);
 				}
 			}
 
-			std::string saveStateStr = base64_encode((const unsigned char*)saveState.data(), saveState.size());
+			l.AddMember("kits", kits, a);
 
-			rapidjson::Value instRoot(rapidjson::kObjectType);
-			instRoot.AddMember("romPath", ws2s(plug->romPath()), a);
-			instRoot.AddMember("settings", settings, a);
-
-			rapidjson::Value s(rapidjson::kObjectType);
-			s.AddMember("data", saveStateStr, a);
-			instRoot.AddMember("state", s, a);
+			settings.AddMember("lsdj", l, a);
+		}
 
-			if (plug->savePath().size() > 0) {
-				instRoot.AddMember("lastSramPath", ws2s(plug->savePath()), a);
+		std::vector<std::byte> saveState;
+		if (plug->active()) {
+			if (manager.saveType() == SaveStateType::State) {
+				plug->saveState(saveState);
+			} else {
+				plug->saveBattery(saveState);
 			}
+		}
+
+		rapidjson::Value instRoot(rapidjson::kObjectType);
+		instRoot.AddMember("romPath", ws2s(plug->romPath()), a);
+		instRoot.AddMember("settings", settings, a);
 
-			instances.PushBack(instRoot, a);
+		rapidjson::Value s(rapidjson::kObjectType);
+		s.AddMember("data", base64Value(saveState.data(), saveState.size(), a), a);
+		instRoot.AddMember("state", s, a);
+
+		if (plug->savePath().size() > 0) {
+			instRoot.AddMember("lastSramPath", ws2s(plug->savePath()), a);
 		}
+
+		instances.PushBack(instRoot, a);
 	}
 
 	root.AddMember("instances", instances, a);
@@ -202,11 +215,68 @@ void serialize(std::string & target, const RetroPlug & manager) {
 	target = sb.GetString();
 }
 
-void deserializeInstance(const rapidjson::Value& instRoot, RetroPlug& plug, SaveStateType saveType) {
+rapidjson::Value loadStatsValue(const LoadStats& stats, rapidjson::Document::AllocatorType& a) {
+	rapidjson::Value histogram(rapidjson::kArrayType);
+	for (uint64_t count : stats.histogram) {
+		histogram.PushBack(count, a);
+	}
+
+	rapidjson::Value v(rapidjson::kObjectType);
+	v.AddMember("average", stats.average, a);
+	v.AddMember("peak", stats.peak, a);
+	v.AddMember("last", stats.last, a);
+	v.AddMember("blocks", stats.blocks, a);
+	v.AddMember("overruns", stats.overruns, a);
+	v.AddMember("histogram", histogram, a);
+	return v;
+}
+
+void serializeDspLoad(std::string& target, const RetroPlug& manager) {
+	rapidjson::Document root(rapidjson::kObjectType);
+	auto& a = root.GetAllocator();
+
+	const DspLoad& load = manager.dspLoad();
+	root.AddMember("version", PLUG_VERSION_STR, a);
+	root.AddMember("total", loadStatsValue(load.total.stats(), a), a);
+	root.AddMember("midi", loadStatsValue(load.midi.stats(), a), a);
+	root.AddMember("emulate", loadStatsValue(load.emulate.stats(), a), a);
+	root.AddMember("mix", loadStatsValue(load.mix.stats(), a), a);
+
+	const QualityGovernor& governor = manager.governor();
+	rapidjson::Value quality(rapidjson::kObjectType);
+	quality.AddMember("enabled", governor.enabled(), a);
+	quality.AddMember("level", rapidjson::StringRef(qualityLevelName(governor.level())), a);
+	quality.AddMember("changes", governor.changes(), a);
+	root.AddMember("quality", quality, a);
+
+	rapidjson::Value instances(rapidjson::kArrayType);
+	for (const SameBoyPlugPtr& plug : *manager.instances()) {
+		rapidjson::Value inst = loadStatsValue(plug->loadMeter().stats(), a);
+		inst.AddMember("romPath", ws2s(plug->romPath()), a);
+		instances.PushBack(inst, a);
+	}
+
+	root.AddMember("instances", instances, a);
+
+	rapidjson::StringBuffer sb;
+	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(sb);
+	root.Accept(writer);
+
+	target = sb.GetString();
+}
+
+// An instance that has had its settings restored, but still needs its core booting
+struct PendingBoot {
+	SameBoyPlugPtr plug;
+	tstring romPath;
+	GameboyModel model;
+	bool priority;
+};
+
+PendingBoot deserializeInstance(const rapidjson::Value& instRoot, RetroPlug& plug, SaveStateType saveType) {
 	const std::string& romPath = instRoot["romPath"].GetString();
 	const auto& state = instRoot["state"].GetObject();
-	const std::string& stateDataStr = state["data"].GetString();
-	std::vector<std::byte> stateData = base64_decode(stateDataStr);
+	std::vector<std::byte> stateData = base64Value(state["data"]);
 
 	GameboyModel model = GameboyModel::Auto;
 	const auto& settings = instRoot.FindMember("settings");
@@ -222,17 +292,14 @@ void deserializeInstance(const rapidjson::Value& instRoot, RetroPlug& plug, Save
 	}
 
 	SameBoyPlugPtr plugPtr = plug.addInstance(EmulatorType::SameBoy);
-	plugPtr->setModel(model);
+	if (!plugPtr) {
+		return PendingBoot { nullptr };
+	}
 
-	// TODO: Load and patch rom before loading in SameBoy! Patching also needs to be accounted
-	// for when the rom is not found and is loaded later.  This would probably be implemented
-	// when replacing and patching a rom
+	plugPtr->setModel(model);
 
-	if (fs::exists(romPath)) {
-		plugPtr->init(tstr(romPath), model, true);
-	} else {
-		plugPtr->setRomPath(tstr(romPath));
-	}
+	// The core is booted later, state set now is loaded in to it by init()
+	plugPtr->setRomPath(tstr(romPath));
 
 	plug.setSaveType(saveType);
 	switch (saveType) {
@@ -264,8 +331,6 @@ void deserializeInstance(const rapidjson::Value& instRoot, RetroPlug& plug, Save
 
 		const auto& lsdjSettings = settings->value.FindMember("lsdj");
 		if (lsdjSettings != settings->value.MemberEnd()) {
-			plugPtr->lsdj().clearKits();
-
 			const std::string& syncMode = lsdjSettings->value["syncMode"].GetString();
 			plugPtr->lsdj().syncMode = syncModeFromString(syncMode);
 
@@ -279,30 +344,37 @@ void deserializeInstance(const rapidjson::Value& instRoot, RetroPlug& plug, Save
 				plugPtr->lsdj().keyboardShortcuts = keyboardShortcuts->value.GetBool();
 			}
 
+			std::vector<NamedHashedDataPtr> kitsData(plugPtr->lsdj().kitData.size());
 			const auto& kits = lsdjSettings->value.FindMember("kits"); 
 			if (kits != lsdjSettings->value.MemberEnd()) {
-				auto& kitsData = plugPtr->lsdj().kitData;
 				for (auto it = kits->value.MemberBegin(); it != kits->value.MemberEnd(); ++it) {
 					int idx = std::stoi(it->name.GetString());
 					
 					const auto& kitName = it->value.FindMember("name");
 					const auto& kitData = it->value.FindMember("data");
-					auto kitDecoded = base64_decode(kitData->value.GetString());
-
 					if (kitName != it->value.MemberEnd() && kitData != it->value.MemberEnd()) {
-						kitsData[idx] = std::make_shared<NamedHashedData>(NamedHashedData {
+						auto kit = std::make_shared<NamedHashedData>(NamedHashedData {
 							kitName->value.GetString(),
-							kitDecoded,
-							crc32::update(kitDecoded)
+							base64Value(kitData->value),
+							0
 						});
+
+						kit->hash = crc32::update(kit->data);
+						kitsData[idx] = kit;
 					}
 				}
 			}
 
-			plugPtr->lsdj().patchKits(plugPtr->romData());
-			plugPtr->updateRom();
+			plugPtr->setPendingKits(std::move(kitsData));
 		}
 	}
+
+	// Instances that follow the transport will be heard as soon as the host starts
+	// playing, so they are booted first
+	Lsdj& lsdj = plugPtr->lsdj();
+	bool priority = lsdj.autoPlay || lsdj.syncMode != LsdjSyncModes::Off;
+
+	return PendingBoot { plugPtr, tstr(romPath), model, priority };
 }
 
 int versionToInt(const std::string& v) {
@@ -346,8 +418,16 @@ void deserialize(const char * data, RetroPlug& plug) {
 
 			const auto& instances = root.FindMember("instances");
 			if (instances != root.MemberEnd()) {
+				std::vector<PendingBoot> boots;
 				for (auto& instance : instances->value.GetArray()) {
-					deserializeInstance(instance, plug, saveType);
+					boots.push_back(deserializeInstance(instance, plug, saveType));
+				}
+
+				std::stable_partition(boots.begin(), boots.end(), [](const PendingBoot& boot) { return boot.priority; });
+				for (const PendingBoot& boot : boots) {
+					if (boot.plug) {
+						plug.bootInstance(boot.plug, boot.romPath, boot.model);
+					}
 				}
 			}
 
@@ -374,7 +454,10 @@ void deserialize(const char * data, RetroPlug& plug) {
 				plug.setMidiRouting(mode);
 			}
 		} else {
-			deserializeInstance(root, plug, SaveStateType::State);
+			PendingBoot boot = deserializeInstance(root, plug, SaveStateType::State);
+			if (boot.plug) {
+				plug.bootInstance(boot.plug, boot.romPath, boot.model);
+			}
 		}
 	} catch (...) {
 		// Fail
@@ -7,3 +7,6 @@ class RetroPlug;
 void serialize(std::string& target, const RetroPlug& manager);
 
 void deserialize(const char* data, RetroPlug& plug);
+
+// The DSP load meters of the project and each instance, for diagnosing overruns
+void serializeDspLoad(std::string& target, const RetroPlug& manager);
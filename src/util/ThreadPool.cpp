@@ -0,0 +1,126 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <assert.h>
+
+ThreadPool::ThreadPool(size_t threadCount) {
+	if (threadCount == 0) {
+		size_t cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+
+	for (size_t i = 0; i < threadCount; ++i) {
+		_workers.emplace_back([this]() { run(); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::scoped_lock lock(_lock);
+		_stopping = true;
+	}
+
+	_wake.notify_all();
+	for (std::thread& worker : _workers) {
+		worker.join();
+	}
+}
+
+static std::mutex sharedLock;
+static size_t sharedRefs = 0;
+static ThreadPool* sharedPool = nullptr;
+
+ThreadPool& ThreadPool::shared() {
+	assert(sharedPool);
+	return *sharedPool;
+}
+
+void ThreadPool::retain() {
+	std::scoped_lock lock(sharedLock);
+	if (sharedRefs++ == 0) {
+		sharedPool = new ThreadPool();
+	}
+}
+
+void ThreadPool::release() {
+	std::scoped_lock lock(sharedLock);
+	assert(sharedRefs > 0);
+	if (--sharedRefs == 0) {
+		// Queued jobs are finished before the workers exit
+		delete sharedPool;
+		sharedPool = nullptr;
+	}
+}
+
+void ThreadPool::enqueue(std::function<void()> job) {
+	{
+		std::scoped_lock lock(_lock);
+		_jobs.push_back(std::move(job));
+	}
+
+	_wake.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& func) {
+	if (count == 0) {
+		return;
+	}
+
+	struct State {
+		std::atomic<size_t> next = 0;
+		size_t finished = 0;
+		std::mutex lock;
+		std::condition_variable done;
+	};
+
+	// Helpers may only get to run after everything has been handled by other
+	// threads, so they must not touch anything but the shared state until they
+	// have claimed an index
+	auto state = std::make_shared<State>();
+	const std::function<void(size_t)>* target = &func;
+
+	auto work = [state, target, count]() {
+		size_t handled = 0;
+		for (size_t idx = state->next++; idx < count; idx = state->next++) {
+			(*target)(idx);
+			handled++;
+		}
+
+		if (handled > 0) {
+			std::scoped_lock lock(state->lock);
+			state->finished += handled;
+			if (state->finished == count) {
+				state->done.notify_all();
+			}
+		}
+	};
+
+	size_t helpers = std::min(count - 1, _workers.size());
+	for (size_t i = 0; i < helpers; ++i) {
+		enqueue(work);
+	}
+
+	work();
+
+	std::unique_lock lock(state->lock);
+	state->done.wait(lock, [&]() { return state->finished == count; });
+}
+
+void ThreadPool::run() {
+	while (true) {
+		std::function<void()> job;
+
+		{
+			std::unique_lock lock(_lock);
+			_wake.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+			if (_stopping && _jobs.empty()) {
+				return;
+			}
+
+			job = std::move(_jobs.front());
+			_jobs.pop_front();
+		}
+
+		job();
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads for jobs that would otherwise stall the UI,
+// such as decoding a folder full of songs.  Never used from the audio thread.
+class ThreadPool {
+private:
+	std::vector<std::thread> _workers;
+	std::deque<std::function<void()>> _jobs;
+	std::mutex _lock;
+	std::condition_variable _wake;
+	bool _stopping = false;
+
+public:
+	ThreadPool(size_t threadCount = 0);
+	~ThreadPool();
+
+	// Shared by everything in the process, sized to the number of cores.  Only
+	// valid between retain() and the matching release().
+	static ThreadPool& shared();
+
+	// The shared pool is started by the first plugin instance and stopped by the
+	// last one.  A static destructor would join the workers under the loader lock
+	// when Windows unloads the plugin, which deadlocks.
+	static void retain();
+
+	static void release();
+
+	size_t size() const { return _workers.size(); }
+
+	void enqueue(std::function<void()> job);
+
+	// Calls func for every index in [0, count) and waits for all of them to
+	// finish.  The calling thread does its share of the work, so this is safe to
+	// call while the pool is busy.
+	void parallelFor(size_t count, const std::function<void(size_t)>& func);
+
+private:
+	void run();
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <chrono>
+
+// Milliseconds from a monotonic clock.  Only useful for measuring intervals, but
+// the same clock is used on every thread so timestamps can be compared between
+// the audio and UI threads.
+inline double getTimeMs() {
+	using namespace std::chrono;
+	return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
@@ -27,97 +27,384 @@
 
    René Nyffenegger rene.nyffenegger@adp-gmbh.ch
 
+   Altered for RetroPlug: encodes and decodes between caller provided buffers,
+   with SSSE3 and AVX2 paths chosen at runtime.
+
 */
 
 #include "base64.h"
-#include <iostream>
 
-static const std::string base64_chars = 
-             "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-             "abcdefghijklmnopqrstuvwxyz"
-             "0123456789+/";
+#include <string.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define BASE64_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+#if defined(BASE64_X86) && !defined(_MSC_VER)
+#define BASE64_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define BASE64_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define BASE64_TARGET_SSSE3
+#define BASE64_TARGET_AVX2
+#endif
+
+static const char BASE64_CHARS[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+	"abcdefghijklmnopqrstuvwxyz"
+	"0123456789+/";
+
+// Maps characters back to their 6 bit values, 0xFF for anything else
+struct base64_table {
+	unsigned char table[256];
+
+	base64_table() {
+		memset(table, 0xFF, sizeof(table));
+		for (unsigned char i = 0; i < 64; ++i) {
+			table[(unsigned char)BASE64_CHARS[i]] = i;
+		}
+	}
+} BASE64_TABLE;
+
+// The SIMD paths handle whole blocks and return how much input they consumed.  The
+// scalar code deals with whatever is left, including padding and bad characters.
+// Based on the algorithms described by Wojciech Muła and Daniel Lemire in
+// "Faster Base64 Encoding and Decoding Using AVX2 Instructions".
+
+#ifdef BASE64_X86
+static Base64Simd detectSimd() {
+	int info[4] = { 0 };
+	int ext[4] = { 0 };
+#ifdef _MSC_VER
+	__cpuid(info, 1);
+	__cpuidex(ext, 7, 0);
+#else
+	unsigned int a, b, c, d;
+	if (!__get_cpuid(1, &a, &b, &c, &d)) {
+		return Base64Simd::None;
+	}
+
+	info[2] = (int)c;
+	if (__get_cpuid_max(0, nullptr) >= 7) {
+		__cpuid_count(7, 0, a, b, c, d);
+		ext[1] = (int)b;
+	}
+#endif
+
+	bool ssse3 = (info[2] & (1 << 9)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx2 = (ext[1] & (1 << 5)) != 0;
+
+	if (avx2 && osxsave) {
+		// The OS has to save the upper halves of the YMM registers
+#ifdef _MSC_VER
+		unsigned long long xcr0 = _xgetbv(0);
+#else
+		unsigned int lo, hi;
+		__asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		unsigned long long xcr0 = ((unsigned long long)hi << 32) | lo;
+#endif
+		if ((xcr0 & 6) == 6) {
+			return Base64Simd::Avx2;
+		}
+	}
+
+	return ssse3 ? Base64Simd::Ssse3 : Base64Simd::None;
+}
 
+// 12 input bytes in each 16 byte lane, laid out by the shuffle, to 16 six bit values
+BASE64_TARGET_SSSE3 static inline __m128i encodeReshuffle(__m128i in) {
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	__m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	__m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	__m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	__m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(t1, t3);
+}
 
-static inline bool is_base64(unsigned char c) {
-  return (isalnum(c) || (c == '+') || (c == '/'));
+BASE64_TARGET_SSSE3 static inline __m128i encodeTranslate(__m128i in) {
+	const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+	__m128i indices = _mm_subs_epu8(in, _mm_set1_epi8(51));
+	indices = _mm_sub_epi8(indices, _mm_cmpgt_epi8(in, _mm_set1_epi8(25)));
+	return _mm_add_epi8(in, _mm_shuffle_epi8(lut, indices));
 }
 
-std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
-  std::string ret;
-  int i = 0;
-  int j = 0;
-  unsigned char char_array_3[3];
-  unsigned char char_array_4[4];
+BASE64_TARGET_SSSE3 static size_t encodeSsse3(const unsigned char* src, size_t len, char* target) {
+	size_t consumed = 0;
+
+	// Each load reads 16 bytes but only uses 12 of them
+	while (len - consumed >= 16) {
+		__m128i in = _mm_loadu_si128((const __m128i*)(src + consumed));
+		_mm_storeu_si128((__m128i*)target, encodeTranslate(encodeReshuffle(in)));
+		consumed += 12;
+		target += 16;
+	}
+
+	return consumed;
+}
+
+BASE64_TARGET_AVX2 static size_t encodeAvx2(const unsigned char* src, size_t len, char* target) {
+	const __m256i shuffle = _mm256_set_epi8(
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+	const __m256i lut = _mm256_setr_epi8(
+		65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+		65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+
+	size_t consumed = 0;
+
+	// Two lanes of 12 bytes, the second load reads up to 28 bytes in
+	while (len - consumed >= 28) {
+		const unsigned char* s = src + consumed;
+		__m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)s)), _mm_loadu_si128((const __m128i*)(s + 12)), 1);
+
+		in = _mm256_shuffle_epi8(in, shuffle);
+		__m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+		__m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		__m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+		__m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+		in = _mm256_or_si256(t1, t3);
+
+		__m256i indices = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+		indices = _mm256_sub_epi8(indices, _mm256_cmpgt_epi8(in, _mm256_set1_epi8(25)));
+		in = _mm256_add_epi8(in, _mm256_shuffle_epi8(lut, indices));
+
+		_mm256_storeu_si256((__m256i*)target, in);
+		consumed += 24;
+		target += 32;
+	}
+
+	return consumed + encodeSsse3(src + consumed, len - consumed, target);
+}
+
+// Returns false if any of the characters aren't valid base64 (including padding)
+BASE64_TARGET_SSSE3 static inline bool decodeTranslate(__m128i& str) {
+	const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask2F = _mm_set1_epi8(0x2F);
+
+	__m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask2F);
+	__m128i loNibbles = _mm_and_si128(str, mask2F);
+	__m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+	__m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF) {
+		return false;
+	}
+
+	__m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(str, mask2F), hiNibbles));
+	str = _mm_add_epi8(str, roll);
+	return true;
+}
 
-  while (in_len--) {
-    char_array_3[i++] = *(bytes_to_encode++);
-    if (i == 3) {
-      char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-      char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-      char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-      char_array_4[3] = char_array_3[2] & 0x3f;
+// 16 six bit values to 12 bytes at the bottom of the register
+BASE64_TARGET_SSSE3 static inline __m128i decodeReshuffle(__m128i in) {
+	__m128i merged = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+	__m128i out = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(out, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
 
-      for(i = 0; (i <4) ; i++)
-        ret += base64_chars[char_array_4[i]];
-      i = 0;
-    }
-  }
+// len must not include padding, so that target has room for the extra 4 bytes
+// each 16 byte store writes past the 12 it decoded
+BASE64_TARGET_SSSE3 static size_t decodeSsse3(const char* src, size_t len, std::byte* target) {
+	size_t consumed = 0;
 
-  if (i)
-  {
-    for(j = i; j < 3; j++)
-      char_array_3[j] = '\0';
+	while (len - consumed >= 24) {
+		__m128i str = _mm_loadu_si128((const __m128i*)(src + consumed));
+		if (!decodeTranslate(str)) {
+			break;
+		}
 
-    char_array_4[0] = ( char_array_3[0] & 0xfc) >> 2;
-    char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-    char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
+		_mm_storeu_si128((__m128i*)target, decodeReshuffle(str));
+		consumed += 16;
+		target += 12;
+	}
 
-    for (j = 0; (j < i + 1); j++)
-      ret += base64_chars[char_array_4[j]];
+	return consumed;
+}
 
-    while((i++ < 3))
-      ret += '=';
+BASE64_TARGET_AVX2 static size_t decodeAvx2(const char* src, size_t len, std::byte* target) {
+	const __m256i lutLo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m256i lutHi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lutRoll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i pack = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i mask2F = _mm256_set1_epi8(0x2F);
+
+	size_t consumed = 0;
+
+	// 32 characters to 24 bytes, stored as 32
+	while (len - consumed >= 44) {
+		__m256i str = _mm256_loadu_si256((const __m256i*)(src + consumed));
+
+		__m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask2F);
+		__m256i loNibbles = _mm256_and_si256(str, mask2F);
+		__m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+		__m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+		if (!_mm256_testz_si256(lo, hi)) {
+			break;
+		}
+
+		__m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(str, mask2F), hiNibbles));
+		str = _mm256_add_epi8(str, roll);
+
+		__m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+		__m256i out = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+		out = _mm256_shuffle_epi8(out, pack);
+		out = _mm256_permutevar8x32_epi32(out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+		_mm256_storeu_si256((__m256i*)target, out);
+		consumed += 32;
+		target += 24;
+	}
+
+	return consumed + decodeSsse3(src + consumed, len - consumed, target);
+}
+#endif
+
+Base64Simd base64_simd_level() {
+#ifdef BASE64_X86
+	static const Base64Simd level = detectSimd();
+	return level;
+#else
+	return Base64Simd::None;
+#endif
+}
 
-  }
+size_t base64_encoded_size(size_t len) {
+	return (len + 2) / 3 * 4;
+}
 
-  return ret;
+// Length of src without trailing padding
+static size_t unpaddedLength(const char* src, size_t len) {
+	while (len > 0 && src[len - 1] == '=') {
+		len--;
+	}
+
+	return len;
+}
+
+size_t base64_decoded_size(const char* src, size_t len) {
+	return unpaddedLength(src, len) * 3 / 4;
+}
+
+void base64_encode(unsigned char const* src, size_t len, char* target) {
+	base64_encode(src, len, target, base64_simd_level());
+}
+
+void base64_encode(unsigned char const* src, size_t len, char* target, Base64Simd simd) {
+	size_t i = 0;
+
+#ifdef BASE64_X86
+	switch (simd) {
+	case Base64Simd::Avx2: i = encodeAvx2(src, len, target); break;
+	case Base64Simd::Ssse3: i = encodeSsse3(src, len, target); break;
+	default: break;
+	}
+
+	target += i / 3 * 4;
+#endif
+
+	for (; i + 3 <= len; i += 3) {
+		unsigned int v = (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+		target[0] = BASE64_CHARS[(v >> 18) & 0x3F];
+		target[1] = BASE64_CHARS[(v >> 12) & 0x3F];
+		target[2] = BASE64_CHARS[(v >> 6) & 0x3F];
+		target[3] = BASE64_CHARS[v & 0x3F];
+		target += 4;
+	}
+
+	size_t remaining = len - i;
+	if (remaining > 0) {
+		unsigned int v = src[i] << 16;
+		if (remaining == 2) {
+			v |= src[i + 1] << 8;
+		}
+
+		target[0] = BASE64_CHARS[(v >> 18) & 0x3F];
+		target[1] = BASE64_CHARS[(v >> 12) & 0x3F];
+		target[2] = remaining == 2 ? BASE64_CHARS[(v >> 6) & 0x3F] : '=';
+		target[3] = '=';
+	}
+}
+
+size_t base64_decode(const char* src, size_t len, std::byte* target) {
+	return base64_decode(src, len, target, base64_simd_level());
+}
+
+size_t base64_decode(const char* src, size_t len, std::byte* target, Base64Simd simd) {
+	len = unpaddedLength(src, len);
+
+	std::byte* start = target;
+	size_t i = 0;
+
+#ifdef BASE64_X86
+	switch (simd) {
+	case Base64Simd::Avx2: i = decodeAvx2(src, len, target); break;
+	case Base64Simd::Ssse3: i = decodeSsse3(src, len, target); break;
+	default: break;
+	}
+
+	target += i / 4 * 3;
+#endif
+
+	unsigned int v = 0;
+	size_t count = 0;
+	for (; i < len; ++i) {
+		unsigned char c = BASE64_TABLE.table[(unsigned char)src[i]];
+		if (c == 0xFF) {
+			break;
+		}
+
+		v = (v << 6) | c;
+		if (++count == 4) {
+			target[0] = (std::byte)(v >> 16);
+			target[1] = (std::byte)(v >> 8);
+			target[2] = (std::byte)v;
+			target += 3;
+			v = 0;
+			count = 0;
+		}
+	}
+
+	// A partial group of n characters holds n - 1 bytes
+	if (count > 1) {
+		v <<= 6 * (4 - count);
+		target[0] = (std::byte)(v >> 16);
+		if (count == 3) {
+			target[1] = (std::byte)(v >> 8);
+		}
+
+		target += count - 1;
+	}
+
+	return target - start;
+}
+
+std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
+	std::string ret(base64_encoded_size(in_len), '\0');
+	base64_encode(bytes_to_encode, in_len, ret.data());
+	return ret;
+}
 
+std::vector<std::byte> base64_decode(const char* src, size_t len) {
+	std::vector<std::byte> ret(base64_decoded_size(src, len));
+	ret.resize(base64_decode(src, len, ret.data()));
+	return ret;
 }
 
 std::vector<std::byte> base64_decode(std::string const& encoded_string) {
-  int in_len = encoded_string.size();
-  int i = 0;
-  int j = 0;
-  int in_ = 0;
-  unsigned char char_array_4[4], char_array_3[3];
-  std::vector<std::byte> ret;
-
-  while (in_len-- && ( encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-    char_array_4[i++] = encoded_string[in_]; in_++;
-    if (i ==4) {
-      for (i = 0; i <4; i++)
-        char_array_4[i] = base64_chars.find(char_array_4[i]);
-
-      char_array_3[0] = ( char_array_4[0] << 2       ) + ((char_array_4[1] & 0x30) >> 4);
-      char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-      char_array_3[2] = ((char_array_4[2] & 0x3) << 6) +   char_array_4[3];
-
-	  for (i = 0; (i < 3); i++)
-		ret.push_back((std::byte)char_array_3[i]);
-      i = 0;
-    }
-  }
-
-  if (i) {
-    for (j = 0; j < i; j++)
-      char_array_4[j] = base64_chars.find(char_array_4[j]);
-
-    char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-    char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-
-    for (j = 0; (j < i - 1); j++) 
-	  ret.push_back((std::byte)char_array_3[j]);
-  }
-
-  return ret;
+	return base64_decode(encoded_string.data(), encoded_string.size());
 }
@@ -6,10 +6,41 @@
 #ifndef BASE64_H_C0CE2A47_D10E_42C9_A27C_C883944E704A
 #define BASE64_H_C0CE2A47_D10E_42C9_A27C_C883944E704A
 
+#include <stddef.h>
 #include <string>
 #include <vector>
 
+// The vector paths base64 can use.  Only x86 has any.
+enum class Base64Simd {
+	None,
+	Ssse3,
+	Avx2
+};
+
+// The fastest level the CPU supports, chosen at runtime
+Base64Simd base64_simd_level();
+
+// The number of characters written by base64_encode for len bytes, including padding
+size_t base64_encoded_size(size_t len);
+
+// The number of bytes base64_decode writes for a well formed string
+size_t base64_decoded_size(const char* src, size_t len);
+
+// Writes exactly base64_encoded_size(len) characters to target.  No null terminator
+// is written.
+void base64_encode(unsigned char const* src, size_t len, char* target);
+
+// Decodes src up to the end, the first padding character, or the first character
+// that isn't valid base64.  target must have room for base64_decoded_size(src, len)
+// bytes.  Returns the number of bytes written.
+size_t base64_decode(const char* src, size_t len, std::byte* target);
+
+// Force a particular path, for testing.  The CPU must support it.
+void base64_encode(unsigned char const* src, size_t len, char* target, Base64Simd simd);
+size_t base64_decode(const char* src, size_t len, std::byte* target, Base64Simd simd);
+
 std::string base64_encode(unsigned char const* , unsigned int len);
 std::vector<std::byte> base64_decode(std::string const& s);
+std::vector<std::byte> base64_decode(const char* src, size_t len);
 
 #endif /* BASE64_H_C0CE2A47_D10E_42C9_A27C_C883944E704A */
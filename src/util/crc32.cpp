@@ -1,8 +1,33 @@
-#include "crc32.h"
-
-namespace crc32 {
+#include "crc32.h"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CRC32_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define CRC32_ARM
+#include <arm_acle.h>
+#endif
+
+#if defined(CRC32_X86) && !defined(_MSC_VER)
+#define CRC32_TARGET_CLMUL __attribute__((target("sse4.1,pclmul")))
+#else
+#define CRC32_TARGET_CLMUL
+#endif
+
+namespace crc32 {
+	// Slicing-by-8 tables.  table[0] is the classic byte at a time table, table[n]
+	// gives the CRC of a byte followed by n zero bytes.
 	struct crc32_table {
-		uint32_t table[256];
+		uint32_t table[8][256];
 
 		crc32_table() {
 			uint32_t polynomial = 0xEDB88320;
@@ -16,18 +41,201 @@ namespace crc32 {
 					}
 				}
 
-				table[i] = c;
+				table[0][i] = c;
+			}
+
+			for (uint32_t i = 0; i < 256; i++) {
+				for (size_t j = 1; j < 8; j++) {
+					table[j][i] = table[0][table[j - 1][i] & 0xFF] ^ (table[j - 1][i] >> 8);
+				}
 			}
 		}
-	} CRC32_TABLE;
-
-	uint32_t update(const void* buf, size_t len, uint32_t initial) {
-		uint32_t c = initial ^ 0xFFFFFFFF;
+	} CRC32_TABLE;
+
+	// All of these work on the inverted CRC
+	static uint32_t updateBytes(uint32_t c, const uint8_t* u, size_t len) {
+		for (size_t i = 0; i < len; ++i) {
+			c = CRC32_TABLE.table[0][(c ^ u[i]) & 0xFF] ^ (c >> 8);
+		}
+
+		return c;
+	}
+
+	static uint32_t updateSlicing(uint32_t c, const uint8_t* u, size_t len) {
+		const auto& t = CRC32_TABLE.table;
+		while (len >= 8) {
+			uint32_t lo, hi;
+			memcpy(&lo, u, 4);
+			memcpy(&hi, u + 4, 4);
+			lo ^= c;
+
+			c = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+				t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+
+			u += 8;
+			len -= 8;
+		}
+
+		return updateBytes(c, u, len);
+	}
+
+#ifdef CRC32_X86
+	// Folds 64 bytes at a time with carry-less multiplies, then reduces what is
+	// left with a Barrett reduction.  len must be a multiple of 16 and at least 64.
+	// See "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ" (Intel).
+	CRC32_TARGET_CLMUL static uint32_t updateClmul(uint32_t c, const uint8_t* u, size_t len) {
+		const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+		const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+		const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+		const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+		const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+		__m128i x1 = _mm_loadu_si128((const __m128i*)(u + 0x00));
+		__m128i x2 = _mm_loadu_si128((const __m128i*)(u + 0x10));
+		__m128i x3 = _mm_loadu_si128((const __m128i*)(u + 0x20));
+		__m128i x4 = _mm_loadu_si128((const __m128i*)(u + 0x30));
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+
+		u += 64;
+		len -= 64;
+
+		while (len >= 64) {
+			__m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+			__m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+			__m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+			__m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+			x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+			x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+			x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+			x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(u + 0x00)));
+			x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(u + 0x10)));
+			x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(u + 0x20)));
+			x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(u + 0x30)));
+
+			u += 64;
+			len -= 64;
+		}
+
+		// Fold the four lanes in to one
+		for (__m128i next : { x2, x3, x4 }) {
+			__m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+		}
+
+		while (len >= 16) {
+			__m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)u)), x5);
+
+			u += 16;
+			len -= 16;
+		}
+
+		// 128 bits down to 64
+		__m128i x2r = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2r);
+
+		x2r = _mm_srli_si128(x1, 4);
+		x1 = _mm_and_si128(x1, mask);
+		x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+		x1 = _mm_xor_si128(x1, x2r);
+
+		// Barrett reduction down to 32
+		x2r = _mm_and_si128(x1, mask);
+		x2r = _mm_clmulepi64_si128(x2r, poly, 0x10);
+		x2r = _mm_and_si128(x2r, mask);
+		x2r = _mm_clmulepi64_si128(x2r, poly, 0x00);
+		x1 = _mm_xor_si128(x1, x2r);
+
+		return (uint32_t)_mm_extract_epi32(x1, 1);
+	}
+
+	static bool hasClmul() {
+		int info[4] = { 0 };
+#ifdef _MSC_VER
+		__cpuid(info, 1);
+#else
+		unsigned int a, b, c, d;
+		if (!__get_cpuid(1, &a, &b, &c, &d)) {
+			return false;
+		}
+
+		info[2] = (int)c;
+#endif
+		// PCLMULQDQ and SSE4.1
+		return (info[2] & (1 << 1)) && (info[2] & (1 << 19));
+	}
+
+	static uint32_t updateX86(uint32_t c, const uint8_t* u, size_t len) {
+		size_t folded = len & ~(size_t)15;
+		if (folded >= 64) {
+			c = updateClmul(c, u, folded);
+			u += folded;
+			len -= folded;
+		}
+
+		return updateSlicing(c, u, len);
+	}
+#endif
+
+#ifdef CRC32_ARM
+	static uint32_t updateArm(uint32_t c, const uint8_t* u, size_t len) {
+		while (len >= 8) {
+			uint64_t v;
+			memcpy(&v, u, 8);
+			c = __crc32d(c, v);
+			u += 8;
+			len -= 8;
+		}
+
+		while (len--) {
+			c = __crc32b(c, *u++);
+		}
+
+		return c;
+	}
+#endif
+
+	static Implementation detect() {
+#if defined(CRC32_X86)
+		if (hasClmul()) {
+			return Implementation::Clmul;
+		}
+#elif defined(CRC32_ARM)
+		return Implementation::Arm;
+#endif
+		return Implementation::Slicing8;
+	}
+
+	Implementation implementation() {
+		// Worked out on first use, so hashing from other static constructors is safe
+		static const Implementation impl = detect();
+		return impl;
+	}
+
+	uint32_t update(const void* buf, size_t len, uint32_t initial, Implementation impl) {
 		const uint8_t* u = static_cast<const uint8_t*>(buf);
-		for (size_t i = 0; i < len; ++i)
-		{
-			c = CRC32_TABLE.table[(c ^ u[i]) & 0xFF] ^ (c >> 8);
+		uint32_t c = initial ^ 0xFFFFFFFF;
+
+		switch (impl) {
+#ifdef CRC32_X86
+		case Implementation::Clmul: c = updateX86(c, u, len); break;
+#endif
+#ifdef CRC32_ARM
+		case Implementation::Arm: c = updateArm(c, u, len); break;
+#endif
+		case Implementation::Slicing8: c = updateSlicing(c, u, len); break;
+		default: c = updateBytes(c, u, len); break;
 		}
+
 		return c ^ 0xFFFFFFFF;
-	}
-}
\ No newline at end of file
+	}
+
+	uint32_t update(const void* buf, size_t len, uint32_t initial) {
+		return update(buf, len, initial, implementation());
+	}
+}
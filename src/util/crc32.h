@@ -1,11 +1,25 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <vector>
 
 namespace crc32 {
+	enum class Implementation {
+		Bytewise,
+		Slicing8,
+		Clmul, // x86 PCLMULQDQ
+		Arm // ARMv8 CRC32 instructions
+	};
+
+	// The fastest implementation the CPU supports, chosen at runtime
+	Implementation implementation();
+
 	uint32_t update(const void* buf, size_t len, uint32_t initial = 0);
 
+	// Forces a particular implementation, for testing.  The CPU must support it.
+	uint32_t update(const void* buf, size_t len, uint32_t initial, Implementation impl);
+
 	inline uint32_t update(const std::vector<std::byte>& data) {
 		return update(data.data(), data.size());
 	}
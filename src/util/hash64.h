@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// A fast 64 bit non-cryptographic hash (XXH64) for telling blobs apart by their
+// contents.  Collisions are far less likely than with crc32, but it still isn't a
+// substitute for comparing the data when that matters.
+namespace hash64 {
+	uint64_t compute(const void* buf, size_t len, uint64_t seed = 0);
+
+	inline uint64_t compute(const std::vector<std::byte>& data) {
+		return compute(data.data(), data.size());
+	}
+}
@@ -0,0 +1,57 @@
+// Measures base64 encoding and decoding throughput for each path the CPU supports,
+// on a buffer of random data about the size of a save state
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "util/base64.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+const size_t BUFFER_SIZE = 8 * 1024 * 1024;
+const int ITERATIONS = 20;
+
+template <typename Func>
+static double measure(Func&& func) {
+	func();
+	auto start = Clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		func();
+	}
+
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	return (double)BUFFER_SIZE * ITERATIONS / (1024.0 * 1024.0) / seconds;
+}
+
+int main() {
+	std::vector<unsigned char> data(BUFFER_SIZE);
+	std::mt19937 rng(1234);
+	for (auto& b : data) {
+		b = (unsigned char)rng();
+	}
+
+	std::string encoded(base64_encoded_size(data.size()), '\0');
+	std::vector<std::byte> decoded(data.size());
+
+	const std::pair<Base64Simd, const char*> levels[] = {
+		{ Base64Simd::None, "scalar" },
+		{ Base64Simd::Ssse3, "ssse3" },
+		{ Base64Simd::Avx2, "avx2" }
+	};
+
+	for (auto& level : levels) {
+		if (level.first > base64_simd_level()) {
+			break;
+		}
+
+		Base64Simd simd = level.first;
+		double encode = measure([&]() { base64_encode(data.data(), data.size(), encoded.data(), simd); });
+		double decode = measure([&]() { base64_decode(encoded.data(), encoded.size(), decoded.data(), simd); });
+		printf("%-8s encode %8.1f MB/s  decode %8.1f MB/s\n", level.second, encode, decode);
+	}
+
+	return 0;
+}
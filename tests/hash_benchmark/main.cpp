@@ -0,0 +1,53 @@
+// Measures the throughput of each crc32 implementation the CPU supports, and of
+// hash64, over a buffer the size of a ROM
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "util/crc32.h"
+#include "util/hash64.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+const size_t BUFFER_SIZE = 1024 * 1024;
+const int ITERATIONS = 200;
+
+template <typename Func>
+static void measure(const char* name, Func&& func) {
+	volatile uint64_t sink = func();
+	auto start = Clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		sink = sink + func();
+	}
+
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	double mbs = (double)BUFFER_SIZE * ITERATIONS / (1024.0 * 1024.0) / seconds;
+	printf("%-10s %8.1f MB/s\n", name, mbs);
+}
+
+int main() {
+	std::vector<uint8_t> data(BUFFER_SIZE);
+	std::mt19937 rng(1234);
+	for (auto& b : data) {
+		b = (uint8_t)rng();
+	}
+
+	auto crc = [&](crc32::Implementation impl) {
+		return [&data, impl]() -> uint64_t { return crc32::update(data.data(), data.size(), 0, impl); };
+	};
+
+	measure("bytewise", crc(crc32::Implementation::Bytewise));
+	measure("slicing8", crc(crc32::Implementation::Slicing8));
+
+	switch (crc32::implementation()) {
+		case crc32::Implementation::Clmul: measure("clmul", crc(crc32::Implementation::Clmul)); break;
+		case crc32::Implementation::Arm: measure("arm", crc(crc32::Implementation::Arm)); break;
+		default: break;
+	}
+
+	measure("hash64", [&]() { return hash64::compute(data.data(), data.size()); });
+
+	return 0;
+}
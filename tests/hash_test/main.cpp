@@ -0,0 +1,187 @@
+// Checks crc32 and hash64 against known answers, checks that every crc32
+// implementation the CPU supports agrees with the bytewise one on random input, and
+// optionally checks the kit banks of an LSDj ROM against LsdjKitHashes:
+//   hash-test [lsdj.gb]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "roms/Lsdj.h"
+#include "util/crc32.h"
+#include "util/hash64.h"
+
+const size_t BANK_SIZE = 0x4000;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+	if (!ok) {
+		printf("FAILED: %s\n", what.c_str());
+		failures++;
+	}
+}
+
+static const char* implementationName(crc32::Implementation impl) {
+	switch (impl) {
+		case crc32::Implementation::Bytewise: return "bytewise";
+		case crc32::Implementation::Slicing8: return "slicing8";
+		case crc32::Implementation::Clmul: return "clmul";
+		case crc32::Implementation::Arm: return "arm";
+	}
+
+	return "unknown";
+}
+
+static std::vector<crc32::Implementation> supportedImplementations() {
+	std::vector<crc32::Implementation> impls = { crc32::Implementation::Bytewise, crc32::Implementation::Slicing8 };
+	if (crc32::implementation() != crc32::Implementation::Slicing8) {
+		impls.push_back(crc32::implementation());
+	}
+
+	return impls;
+}
+
+// The same pattern the known answers below were generated from
+static std::vector<uint8_t> pattern(size_t size) {
+	std::vector<uint8_t> data(size);
+	for (size_t i = 0; i < size; i++) {
+		data[i] = (uint8_t)((i * 31 + 7) & 255);
+	}
+
+	return data;
+}
+
+static void testCrc32KnownAnswers() {
+	struct Answer { std::string input; uint32_t initial; uint32_t crc; };
+	std::vector<uint8_t> p = pattern(1000);
+	std::string patternStr(p.begin(), p.end());
+
+	Answer answers[] = {
+		{ "", 0, 0 },
+		{ "a", 0, 0xE8B7BE43 },
+		{ "123456789", 0, 0xCBF43926 },
+		{ "The quick brown fox jumps over the lazy dog", 0, 0x414FA339 },
+		{ patternStr, 0, 0x8902161E },
+		{ patternStr, 0x12345678, 0x2DD2DD2B },
+	};
+
+	for (auto impl : supportedImplementations()) {
+		for (const Answer& a : answers) {
+			uint32_t crc = crc32::update(a.input.data(), a.input.size(), a.initial, impl);
+			check(crc == a.crc, std::string("crc32 ") + implementationName(impl) + " of a " + std::to_string(a.input.size()) + " byte string");
+		}
+
+		// Feeding the data in pieces must give the same result as feeding it at once
+		uint32_t crc = 0;
+		for (size_t offset = 0; offset < p.size(); offset += 77) {
+			crc = crc32::update(p.data() + offset, std::min<size_t>(77, p.size() - offset), crc, impl);
+		}
+
+		check(crc == 0x8902161E, std::string("crc32 ") + implementationName(impl) + " chained");
+	}
+
+	check(crc32::update(p.data(), p.size()) == 0x8902161E, "crc32 default implementation");
+}
+
+static void testCrc32Equivalence() {
+	std::mt19937_64 rng(0x5EED);
+	std::vector<uint8_t> data(70000);
+	for (auto& b : data) {
+		b = (uint8_t)rng();
+	}
+
+	auto impls = supportedImplementations();
+	for (int i = 0; i < 20000; i++) {
+		// Mostly short lengths, where the head/tail handling lives, with some long ones
+		size_t len = (i % 10 == 0) ? rng() % 65536 : rng() % 300;
+		size_t offset = rng() % (data.size() - len);
+		uint32_t initial = (i % 2) ? (uint32_t)rng() : 0;
+
+		uint32_t expected = crc32::update(data.data() + offset, len, initial, crc32::Implementation::Bytewise);
+		for (auto impl : impls) {
+			uint32_t crc = crc32::update(data.data() + offset, len, initial, impl);
+			if (crc != expected) {
+				check(false, std::string("crc32 ") + implementationName(impl) + " disagrees at offset "
+					+ std::to_string(offset) + " length " + std::to_string(len));
+				return;
+			}
+		}
+	}
+}
+
+static void testHash64KnownAnswers() {
+	struct Answer { std::string input; uint64_t seed; uint64_t hash; };
+	std::vector<uint8_t> p = pattern(1000);
+	std::string patternStr(p.begin(), p.end());
+
+	Answer answers[] = {
+		{ "", 0, 0xEF46DB3751D8E999ULL },
+		{ "", 1, 0xD5AFBA1336A3BE4BULL },
+		{ "a", 0, 0xD24EC4F1A98C6E5BULL },
+		{ "abc", 0, 0x44BC2CF5AD770999ULL },
+		{ "123456789", 0, 0x8CB841DB40E6AE83ULL },
+		{ "Nobody inspects the spammish repetition", 0, 0xFBCEA83C8A378BF1ULL },
+		{ "The quick brown fox jumps over the lazy dog", 0, 0x0B242D361FDA71BCULL },
+		{ "The quick brown fox jumps over the lazy dog", 1, 0xDF5091B6DAD2C6DBULL },
+		{ patternStr, 0, 0x99594F4828043D35ULL },
+		{ patternStr, 0x9E3779B97F4A7C15ULL, 0xDA717F741F399F3FULL },
+	};
+
+	for (const Answer& a : answers) {
+		uint64_t hash = hash64::compute(a.input.data(), a.input.size(), a.seed);
+		check(hash == a.hash, "hash64 of a " + std::to_string(a.input.size()) + " byte string");
+	}
+
+	// Unaligned input must hash the same as aligned input
+	std::vector<uint8_t> shifted(p.size() + 1);
+	memcpy(shifted.data() + 1, p.data(), p.size());
+	check(hash64::compute(shifted.data() + 1, p.size()) == 0x99594F4828043D35ULL, "hash64 of unaligned input");
+}
+
+// Every kit bank in an unmodified ROM should be one of the built in kits
+static void testLsdjKitHashes(const char* path) {
+	std::ifstream f(path, std::ios::binary);
+	std::vector<char> rom((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	if (rom.empty() || rom.size() % BANK_SIZE != 0) {
+		check(false, std::string("couldn't read a ROM from ") + path);
+		return;
+	}
+
+	int kits = 0;
+	for (size_t offset = 0; offset < rom.size(); offset += BANK_SIZE) {
+		if (rom[offset] == 0x60 && rom[offset + 1] == 0x40) {
+			uint32_t hash = crc32::update(rom.data() + offset, BANK_SIZE);
+			check(isBuiltInKit(hash), "kit in bank " + std::to_string(offset / BANK_SIZE) + " has unknown hash " + std::to_string(hash));
+			kits++;
+		}
+	}
+
+	check(kits > 0, std::string("no kits found in ") + path);
+	printf("Checked %d kits\n", kits);
+}
+
+int main(int argc, char** argv) {
+	printf("crc32 implementation: %s\n", implementationName(crc32::implementation()));
+
+	testCrc32KnownAnswers();
+	testCrc32Equivalence();
+	testHash64KnownAnswers();
+
+	if (argc > 1) {
+		testLsdjKitHashes(argv[1]);
+	}
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+
+	printf("All passed\n");
+	return 0;
+}
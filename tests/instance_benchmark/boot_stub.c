@@ -0,0 +1,25 @@
+// Stand ins for the boot ROMs that retroplug/Makefile assembles with rgbds.  Each
+// one waits a little, then jumps to 0xFC where it unmaps itself, like the real ones.
+#define BOOT { \
+    [0x00] = 0x01, [0x01] = 0x00, [0x02] = 0x40, /* ld bc, $4000 */ \
+    [0x03] = 0x0B,                               /* dec bc */ \
+    [0x04] = 0x78, [0x05] = 0xB1,                /* ld a, b; or c */ \
+    [0x06] = 0x20, [0x07] = 0xFB,                /* jr nz, -5 */ \
+    [0x08] = 0xC3, [0x09] = 0xFC, [0x0A] = 0x00, /* jp $00FC */ \
+    [0xFC] = 0x3E, [0xFD] = 0x01,                /* ld a, 1 */ \
+    [0xFE] = 0xE0, [0xFF] = 0x50                 /* ldh [$FF50], a */ \
+}
+
+const unsigned char dmg_boot[0x100] = BOOT;
+const unsigned char sgb_boot[0x100] = BOOT;
+const unsigned char sgb2_boot[0x100] = BOOT;
+const unsigned char cgb_boot[0x900] = BOOT;
+const unsigned char cgb_fast_boot[0x900] = BOOT;
+const unsigned char agb_boot[0x900] = BOOT;
+
+const unsigned dmg_boot_length = 0x100;
+const unsigned sgb_boot_length = 0x100;
+const unsigned sgb2_boot_length = 0x100;
+const unsigned cgb_boot_length = 0x900;
+const unsigned cgb_fast_boot_length = 0x900;
+const unsigned agb_boot_length = 0x900;
@@ -0,0 +1,98 @@
+// Measures how the cost of a processing block grows with the number of instances,
+// from 1 to MAX_INSTANCES, both unlinked and with every instance linked to the
+// others.  Each instance runs a ROM that keeps a square channel playing, so the
+// APU is never idle.
+//   instance-benchmark [seconds of audio per measurement]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "retroplug/libretro.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+const size_t MAX_INSTANCES = 16;
+const size_t BLOCK_SIZE = 256;
+const double SAMPLE_RATE = 48000;
+const int MODEL_CGB_E = 0x205;
+
+static std::vector<char> createRom() {
+	std::vector<char> rom(0x8000);
+	memcpy(rom.data() + 0x134, "TESTROM", 7);
+	rom[0x147] = 0x03; // MBC1 + RAM + battery
+	rom[0x149] = 0x02; // 8 KB RAM
+
+	const unsigned char code[] = {
+		0x3E, 0x80, 0xE0, 0x26, // Sound on
+		0x3E, 0x77, 0xE0, 0x24, // Full volume
+		0x3E, 0xFF, 0xE0, 0x25, // Every channel to both sides
+		0x3E, 0xF0, 0xE0, 0x12, // Square 1 envelope
+		0x3E, 0x87, 0xE0, 0x14, // Trigger square 1
+		0x18, 0xFE // Loop forever
+	};
+
+	memcpy(rom.data() + 0x100, code, sizeof(code));
+	return rom;
+}
+
+int main(int argc, char** argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+	int blocks = (int)(seconds * SAMPLE_RATE / BLOCK_SIZE);
+	double blockMs = BLOCK_SIZE * 1000.0 / SAMPLE_RATE;
+
+	std::vector<char> rom = createRom();
+	std::vector<int16_t> audio(BLOCK_SIZE * 2 * 4);
+
+	void* instances[MAX_INSTANCES];
+	for (size_t i = 0; i < MAX_INSTANCES; i++) {
+		instances[i] = sameboy_init(nullptr, rom.data(), rom.size(), MODEL_CGB_E, true, true);
+		sameboy_run_boot_rom(instances[i]);
+		sameboy_set_sample_rate(instances[i], SAMPLE_RATE);
+	}
+
+	printf("%d blocks of %zu frames at %.0f Hz (%.2f ms per block)\n", blocks, BLOCK_SIZE, SAMPLE_RATE, blockMs);
+
+	for (int linked = 0; linked < 2; linked++) {
+		for (size_t count = 1; count <= MAX_INSTANCES; count++) {
+			for (size_t i = 0; i < count; i++) {
+				void* targets[MAX_INSTANCES];
+				size_t targetCount = 0;
+				for (size_t j = 0; linked && j < count; j++) {
+					if (j != i) {
+						targets[targetCount++] = instances[j];
+					}
+				}
+
+				sameboy_set_link_targets(instances[i], targets, targetCount);
+			}
+
+			auto start = Clock::now();
+			for (int b = 0; b < blocks; b++) {
+				if (linked) {
+					sameboy_update_multiple(instances, count, BLOCK_SIZE);
+				} else {
+					for (size_t i = 0; i < count; i++) {
+						sameboy_update(instances[i], BLOCK_SIZE);
+					}
+				}
+
+				for (size_t i = 0; i < count; i++) {
+					sameboy_fetch_audio(instances[i], audio.data());
+				}
+			}
+
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / blocks;
+			printf("%s %2zu instances: %6.3f ms per block (%5.1f%% of the block)\n",
+				linked ? "linked  " : "unlinked", count, ms, ms / blockMs * 100);
+		}
+	}
+
+	for (size_t i = 0; i < MAX_INSTANCES; i++) {
+		sameboy_free(instances[i]);
+	}
+
+	return 0;
+}
@@ -118,8 +118,83 @@ static double smooth(double x)
     return 3*x*x - 2*x*x*x;
 }
 
+static void dc_offset_volume(GB_gameboy_t *gb, unsigned *left, unsigned *right)
+{
+    unsigned mask = gb->io_registers[GB_IO_NR51];
+    unsigned left_volume = 0;
+    unsigned right_volume = 0;
+    UNROLL
+    for (unsigned i = GB_N_CHANNELS; i--;) {
+        if (gb->apu.is_active[i]) {
+            if (mask & 1) {
+                left_volume += (gb->io_registers[GB_IO_NR50] & 7) * CH_STEP * 0xF;
+            }
+            if (mask & 0x10) {
+                right_volume += ((gb->io_registers[GB_IO_NR50] >> 4) & 7) * CH_STEP * 0xF;
+            }
+        }
+        else {
+            left_volume += gb->apu_output.current_sample[i].left * CH_STEP;
+            right_volume += gb->apu_output.current_sample[i].right * CH_STEP;
+        }
+        mask >>= 1;
+    }
+    *left = left_volume;
+    *right = right_volume;
+}
+
+/* Does the part of render() that reads the emulated state, and leaves the rest
+   to GB_apu_render_captured */
+static void capture_sample(GB_gameboy_t *gb)
+{
+    if (gb->apu_output.capture_count == gb->apu_output.capture_size) {
+        GB_apu_render_captured(&gb, 1);
+    }
+
+    GB_apu_captured_sample_t *sample = &gb->apu_output.capture[gb->apu_output.capture_count++];
+    sample->dac_enabled = 0;
+
+    UNROLL
+    for (unsigned i = 0; i < GB_N_CHANNELS; i++) {
+        if (GB_apu_is_DAC_enabled(gb, i)) {
+            sample->dac_enabled |= 1 << i;
+        }
+
+        if (likely(gb->apu_output.last_update[i] == 0)) {
+            sample->left[i] = gb->apu_output.current_sample[i].left;
+            sample->right[i] = gb->apu_output.current_sample[i].right;
+            sample->divisor[i] = 1;
+        }
+        else {
+            refresh_channel(gb, i, 0);
+            sample->left[i] = gb->apu_output.summed_samples[i].left;
+            sample->right[i] = gb->apu_output.summed_samples[i].right;
+            sample->divisor[i] = gb->apu_output.cycles_since_render;
+            gb->apu_output.summed_samples[i] = (GB_sample_t){0, 0};
+        }
+        gb->apu_output.last_update[i] = 0;
+    }
+    gb->apu_output.cycles_since_render = 0;
+
+    if (gb->apu_output.highpass_mode == GB_HIGHPASS_REMOVE_DC_OFFSET) {
+        unsigned left_volume;
+        unsigned right_volume;
+        dc_offset_volume(gb, &left_volume, &right_volume);
+        sample->dc_offset_left = left_volume;
+        sample->dc_offset_right = right_volume;
+    }
+    else {
+        sample->dc_offset_left = sample->dc_offset_right = 0;
+    }
+}
+
 static void render(GB_gameboy_t *gb)
 {
+    if (gb->apu_output.capture) {
+        capture_sample(gb);
+        return;
+    }
+
     GB_sample_t output = {0,0};
 
     UNROLL
@@ -179,25 +254,9 @@ static void render(GB_gameboy_t *gb)
                     output.right - filtered_output.right * gb->apu_output.highpass_rate};
             break;
         case GB_HIGHPASS_REMOVE_DC_OFFSET: {
-            unsigned mask = gb->io_registers[GB_IO_NR51];
-            unsigned left_volume = 0;
-            unsigned right_volume = 0;
-            UNROLL
-            for (unsigned i = GB_N_CHANNELS; i--;) {
-                if (gb->apu.is_active[i]) {
-                    if (mask & 1) {
-                        left_volume += (gb->io_registers[GB_IO_NR50] & 7) * CH_STEP * 0xF;
-                    }
-                    if (mask & 0x10) {
-                        right_volume += ((gb->io_registers[GB_IO_NR50] >> 4) & 7) * CH_STEP * 0xF;
-                    }
-                }
-                else {
-                    left_volume += gb->apu_output.current_sample[i].left * CH_STEP;
-                    right_volume += gb->apu_output.current_sample[i].right * CH_STEP;
-                }
-                mask >>= 1;
-            }
+            unsigned left_volume;
+            unsigned right_volume;
+            dc_offset_volume(gb, &left_volume, &right_volume);
             gb->apu_output.highpass_diff = (GB_double_sample_t)
             {left_volume * (1 - gb->apu_output.highpass_rate) + gb->apu_output.highpass_diff.left * gb->apu_output.highpass_rate,
                 right_volume * (1 - gb->apu_output.highpass_rate) + gb->apu_output.highpass_diff.right * gb->apu_output.highpass_rate};
@@ -211,6 +270,145 @@ static void render(GB_gameboy_t *gb)
     gb->apu_output.sample_callback(gb, &filtered_output);
 }
 
+#define CAPTURE_LANES 16
+
+/* The same math as render(), laid out with one lane per instance so the compiler
+   can vectorize across instances.  Produces identical output. */
+static void render_captured_lanes(GB_gameboy_t **gbs, size_t lanes, size_t start, size_t end)
+{
+    double dac_discharge[GB_N_CHANNELS][CAPTURE_LANES];
+    double attack[CAPTURE_LANES];
+    double decay[CAPTURE_LANES];
+    double smoothing[CAPTURE_LANES];
+    double rate[CAPTURE_LANES];
+    double accurate[CAPTURE_LANES];
+    double dc_offset[CAPTURE_LANES];
+    double filtered[CAPTURE_LANES];
+    double diff_left[CAPTURE_LANES];
+    double diff_right[CAPTURE_LANES];
+
+    /* Inputs for the current sample */
+    double left[GB_N_CHANNELS][CAPTURE_LANES];
+    double right[GB_N_CHANNELS][CAPTURE_LANES];
+    double divisor[GB_N_CHANNELS][CAPTURE_LANES];
+    double enabled[GB_N_CHANNELS][CAPTURE_LANES];
+    double dc_left[CAPTURE_LANES];
+    double dc_right[CAPTURE_LANES];
+
+    double output_left[CAPTURE_LANES];
+    double output_right[CAPTURE_LANES];
+    GB_sample_t filtered_output[CAPTURE_LANES];
+
+    for (size_t l = 0; l < lanes; l++) {
+        GB_apu_output_t *apu_output = &gbs[l]->apu_output;
+        for (unsigned i = 0; i < GB_N_CHANNELS; i++) {
+            dac_discharge[i][l] = apu_output->dac_discharge[i];
+        }
+        attack[l] = ((double) DAC_ATTACK_SPEED) / apu_output->sample_rate;
+        decay[l] = ((double) DAC_DECAY_SPEED) / apu_output->sample_rate;
+        smoothing[l] = gbs[l]->model < GB_MODEL_AGB;
+        rate[l] = apu_output->highpass_rate;
+        filtered[l] = apu_output->highpass_mode != GB_HIGHPASS_OFF;
+        accurate[l] = apu_output->highpass_mode == GB_HIGHPASS_ACCURATE;
+        dc_offset[l] = apu_output->highpass_mode == GB_HIGHPASS_REMOVE_DC_OFFSET;
+        diff_left[l] = apu_output->highpass_diff.left;
+        diff_right[l] = apu_output->highpass_diff.right;
+    }
+
+    for (size_t s = start; s < end; s++) {
+        for (size_t l = 0; l < lanes; l++) {
+            const GB_apu_captured_sample_t *sample = &gbs[l]->apu_output.capture[s];
+            UNROLL
+            for (unsigned i = 0; i < GB_N_CHANNELS; i++) {
+                left[i][l] = sample->left[i];
+                right[i][l] = sample->right[i];
+                divisor[i][l] = sample->divisor[i];
+                enabled[i][l] = (sample->dac_enabled >> i) & 1;
+            }
+            dc_left[l] = sample->dc_offset_left;
+            dc_right[l] = sample->dc_offset_right;
+            output_left[l] = output_right[l] = 0;
+        }
+
+        /* Lane flags are 0 or 1 and mixed in arithmetically rather than branched
+           on, which keeps the loops vectorizable without changing any results */
+        UNROLL
+        for (unsigned i = 0; i < GB_N_CHANNELS; i++) {
+            for (size_t l = 0; l < lanes; l++) {
+                /* Clamping to 0 and 1 gives the same multipliers as render() */
+                double discharge = dac_discharge[i][l] + (enabled[i][l] * attack[l] - (1 - enabled[i][l]) * decay[l]);
+                discharge = discharge < 0 ? 0 : discharge;
+                discharge = discharge > 1 ? 1 : discharge;
+                dac_discharge[i][l] = smoothing[l] * discharge + (1 - smoothing[l]) * dac_discharge[i][l];
+
+                double multiplier = CH_STEP * (smoothing[l] * smooth(discharge) + (1 - smoothing[l]));
+                output_left[l] = (int) (output_left[l] + left[i][l] * multiplier / divisor[i][l]);
+                output_right[l] = (int) (output_right[l] + right[i][l] * multiplier / divisor[i][l]);
+            }
+        }
+
+        for (size_t l = 0; l < lanes; l++) {
+            double out_left = (int) (output_left[l] - filtered[l] * diff_left[l]);
+            double out_right = (int) (output_right[l] - filtered[l] * diff_right[l]);
+            double keep = filtered[l] - accurate[l] - dc_offset[l];
+
+            diff_left[l] = accurate[l] * (output_left[l] - out_left * rate[l]) +
+                           dc_offset[l] * (dc_left[l] * (1 - rate[l]) + diff_left[l] * rate[l]) +
+                           keep * diff_left[l];
+            diff_right[l] = accurate[l] * (output_right[l] - out_right * rate[l]) +
+                            dc_offset[l] * (dc_right[l] * (1 - rate[l]) + diff_right[l] * rate[l]) +
+                            keep * diff_right[l];
+            filtered_output[l] = (GB_sample_t) {out_left, out_right};
+        }
+
+        for (size_t l = 0; l < lanes; l++) {
+            gbs[l]->apu_output.sample_callback(gbs[l], &filtered_output[l]);
+        }
+    }
+
+    for (size_t l = 0; l < lanes; l++) {
+        GB_apu_output_t *apu_output = &gbs[l]->apu_output;
+        for (unsigned i = 0; i < GB_N_CHANNELS; i++) {
+            apu_output->dac_discharge[i] = dac_discharge[i][l];
+        }
+        apu_output->highpass_diff = (GB_double_sample_t) {diff_left[l], diff_right[l]};
+    }
+}
+
+void GB_apu_render_captured(GB_gameboy_t **gbs, size_t count)
+{
+    for (size_t first = 0; first < count; first += CAPTURE_LANES) {
+        GB_gameboy_t **group = gbs + first;
+        size_t lanes = count - first < CAPTURE_LANES ? count - first : CAPTURE_LANES;
+
+        /* Samples that every instance has are done together, the rest one instance at a time */
+        size_t common = SIZE_MAX;
+        for (size_t l = 0; l < lanes; l++) {
+            if (group[l]->apu_output.capture_count < common) {
+                common = group[l]->apu_output.capture_count;
+            }
+        }
+
+        render_captured_lanes(group, lanes, 0, common);
+
+        for (size_t l = 0; l < lanes; l++) {
+            if (group[l]->apu_output.capture_count > common) {
+                render_captured_lanes(group + l, 1, common, group[l]->apu_output.capture_count);
+            }
+            group[l]->apu_output.capture_count = 0;
+        }
+    }
+}
+
+void GB_apu_set_capture(GB_gameboy_t *gb, GB_apu_captured_sample_t *buffer, size_t size)
+{
+    if (gb->apu_output.capture_count) {
+        GB_apu_render_captured(&gb, 1);
+    }
+    gb->apu_output.capture = buffer;
+    gb->apu_output.capture_size = size;
+}
+
 static uint16_t new_sweep_sample_legnth(GB_gameboy_t *gb)
 {
     uint16_t delta = gb->apu.shadow_sweep_sample_legnth >> (gb->io_registers[GB_IO_NR10] & 7);
@@ -125,6 +125,17 @@ typedef enum {
     GB_HIGHPASS_MAX
 } GB_highpass_mode_t;
 
+/* The inputs of the output stage for one sample, before DAC smoothing, mixing
+   and the highpass filter.  Each channel is left / divisor and right / divisor. */
+typedef struct {
+    int16_t left[GB_N_CHANNELS];
+    int16_t right[GB_N_CHANNELS];
+    uint32_t divisor[GB_N_CHANNELS];
+    uint32_t dc_offset_left;
+    uint32_t dc_offset_right;
+    uint8_t dac_enabled; /* Bit per channel */
+} GB_apu_captured_sample_t;
+
 typedef struct {
     unsigned sample_rate;
 
@@ -143,11 +154,24 @@ typedef struct {
     GB_double_sample_t highpass_diff;
     
     GB_sample_callback_t sample_callback;
+
+    /* When set, samples are captured here instead of being sent to the callback */
+    GB_apu_captured_sample_t *capture;
+    size_t capture_count;
+    size_t capture_size;
 } GB_apu_output_t;
 
 void GB_set_sample_rate(GB_gameboy_t *gb, unsigned sample_rate);
 void GB_set_highpass_filter_mode(GB_gameboy_t *gb, GB_highpass_mode_t mode);
 void GB_apu_set_sample_callback(GB_gameboy_t *gb, GB_sample_callback_t callback);
+
+/* Captures samples in to buffer rather than finishing them, so the output stage
+   can be run for many instances at once by GB_apu_render_captured.  Passing
+   NULL finishes any captured samples and goes back to rendering immediately. */
+void GB_apu_set_capture(GB_gameboy_t *gb, GB_apu_captured_sample_t *buffer, size_t size);
+/* Finishes every captured sample of each instance and sends them to its sample
+   callback, in order */
+void GB_apu_render_captured(GB_gameboy_t **gbs, size_t count);
 #ifdef GB_INTERNAL
 bool GB_apu_is_DAC_enabled(GB_gameboy_t *gb, unsigned index);
 void GB_apu_write(GB_gameboy_t *gb, uint8_t reg, uint8_t value);
@@ -136,6 +136,8 @@ static void display_vblank(GB_gameboy_t *gb)
     
     if (!gb->disable_rendering && ((!(gb->io_registers[GB_IO_LCDC] & 0x80) || gb->stopped) || gb->frame_skip_state == GB_FRAMESKIP_LCD_TURNED_ON)) {
         /* LCD is off, set screen to white or black (if LCD is on in stop mode) */
+        /* Only the RGB screen is filled, so don't let this frame be drawn from the indexed one */
+        gb->indexed_palette_changed = true;
         if (gb->sgb) {
             for (unsigned i = 0; i < WIDTH * LINES; i++) {
                 gb->sgb->screen_buffer[i] = 0x0;
@@ -219,6 +221,11 @@ void GB_palette_changed(GB_gameboy_t *gb, bool background_palette, uint8_t index
     uint16_t color = palette_data[index & ~1] | (palette_data[index | 1] << 8);
 
     (background_palette? gb->background_palettes_rgb : gb->sprite_palettes_rgb)[index / 2] = GB_convert_rgb15(gb, color);
+
+    /* Indexed output can only represent one palette per frame */
+    if (gb->indexed_screen && (gb->io_registers[GB_IO_LCDC] & 0x80) && gb->current_line < LINES) {
+        gb->indexed_palette_changed = true;
+    }
 }
 
 void GB_set_color_correction_mode(GB_gameboy_t *gb, GB_color_correction_mode_t mode)
@@ -397,6 +404,9 @@ static void render_pixel_if_possible(GB_gameboy_t *gb)
         }
         else {
             gb->screen[gb->position_in_line + gb->current_line * WIDTH] = gb->background_palettes_rgb[fifo_item->palette * 4 + pixel];
+            if (gb->indexed_screen) {
+                gb->indexed_screen[gb->position_in_line + gb->current_line * WIDTH] = fifo_item->palette * 4 + pixel;
+            }
         }
     }
     
@@ -419,6 +429,9 @@ static void render_pixel_if_possible(GB_gameboy_t *gb)
         }
         else {
             gb->screen[gb->position_in_line + gb->current_line * WIDTH] = gb->sprite_palettes_rgb[oam_fifo_item->palette * 4 + pixel];
+            if (gb->indexed_screen) {
+                gb->indexed_screen[gb->position_in_line + gb->current_line * WIDTH] = 0x20 + oam_fifo_item->palette * 4 + pixel;
+            }
         }
     }
 	
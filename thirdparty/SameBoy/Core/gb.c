@@ -137,7 +137,7 @@ void GB_free(GB_gameboy_t *gb)
     if (gb->mbc_ram) {
         free(gb->mbc_ram);
     }
-    if (gb->rom) {
+    if (gb->rom && !gb->rom_is_shared) {
         free(gb->rom);
     }
     if (gb->breakpoints) {
@@ -193,9 +193,10 @@ int GB_load_rom(GB_gameboy_t *gb, const char *path)
         gb->rom_size++;
     }
     fseek(f, 0, SEEK_SET);
-    if (gb->rom) {
+    if (gb->rom && !gb->rom_is_shared) {
         free(gb->rom);
     }
+    gb->rom_is_shared = false;
     gb->rom = malloc(gb->rom_size);
     memset(gb->rom, 0xFF, gb->rom_size); /* Pad with 0xFFs */
     fread(gb->rom, 1, gb->rom_size, f);
@@ -212,15 +213,41 @@ void GB_load_rom_from_buffer(GB_gameboy_t *gb, const uint8_t *buffer, size_t siz
         gb->rom_size |= gb->rom_size >> 1;
         gb->rom_size++;
     }
-    if (gb->rom) {
+    if (gb->rom && !gb->rom_is_shared) {
         free(gb->rom);
     }
+    gb->rom_is_shared = false;
     gb->rom = malloc(gb->rom_size);
     memset(gb->rom, 0xff, gb->rom_size);
     memcpy(gb->rom, buffer, size);
     GB_configure_cart(gb);
 }
 
+void GB_load_rom_shared(GB_gameboy_t *gb, const uint8_t *buffer, size_t size)
+{
+    /* Reads are masked with rom_size - 1, so anything that would need padding has to be copied */
+    if (size < 0x4000 || (size & (size - 1))) {
+        GB_load_rom_from_buffer(gb, buffer, size);
+        return;
+    }
+    if (gb->rom && !gb->rom_is_shared) {
+        free(gb->rom);
+    }
+    gb->rom_size = (uint32_t)size;
+    gb->rom = (uint8_t *)buffer;
+    gb->rom_is_shared = true;
+    GB_configure_cart(gb);
+}
+
+void GB_unshare_rom(GB_gameboy_t *gb)
+{
+    if (!gb->rom_is_shared) return;
+    uint8_t *rom = malloc(gb->rom_size);
+    memcpy(rom, gb->rom, gb->rom_size);
+    gb->rom = rom;
+    gb->rom_is_shared = false;
+}
+
 typedef struct {
     uint8_t seconds;
     uint8_t padding1[3];
@@ -489,6 +516,13 @@ void GB_set_pixels_output(GB_gameboy_t *gb, uint32_t *output)
     gb->screen = output;
 }
 
+/* Optional second output holding palette indices (palette * 4 + color, plus 0x20 for sprites) in to
+   background_palettes_rgb/sprite_palettes_rgb, so palette lookup can be done by the frontend. */
+void GB_set_indexed_pixels_output(GB_gameboy_t *gb, uint8_t *output)
+{
+    gb->indexed_screen = output;
+}
+
 void GB_set_vblank_callback(GB_gameboy_t *gb, GB_vblank_callback_t callback)
 {
     gb->vblank_callback = callback;
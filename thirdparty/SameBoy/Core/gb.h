@@ -497,6 +497,7 @@ struct GB_gameboy_internal_s {
         /* ROM */
         uint8_t *rom;
         uint32_t rom_size;
+        bool rom_is_shared; /* rom is owned by the frontend and must not be written to or freed */
         const GB_cartridge_t *cartridge_type;
         enum {
             GB_STANDARD_MBC1_WIRING,
@@ -505,6 +506,15 @@ struct GB_gameboy_internal_s {
 
         unsigned pending_cycles;
 
+        /* Misc - read by every GB_run, so kept with the rest of the frequently used
+           fields rather than after the debugger and rewind state */
+        bool turbo;
+        bool turbo_dont_skip;
+        bool disable_rendering;
+        bool vblank_just_occured; // For slow operations involving syscalls; these should only run once per vblank
+        uint8_t cycles_since_run; // How many cycles have passed since the last call to GB_run(), in 8MHz units
+        double clock_multiplier;
+
         /* Various RAMs */
         uint8_t *ram;
         uint8_t *vram;
@@ -512,6 +522,8 @@ struct GB_gameboy_internal_s {
 
         /* I/O */
         uint32_t *screen;
+        uint8_t *indexed_screen;
+        bool indexed_palette_changed;
         uint32_t background_palettes_rgb[0x20];
         uint32_t sprite_palettes_rgb[0x20];
         GB_color_correction_mode_t color_correction_mode;
@@ -603,13 +615,7 @@ struct GB_gameboy_internal_s {
         double sgb_intro_sweep_previous_sample;
 
         /* Misc */
-        bool turbo;
-        bool turbo_dont_skip;
-        bool disable_rendering;
         uint8_t boot_rom[0x900];
-        bool vblank_just_occured; // For slow operations involving syscalls; these should only run once per vblank
-        uint8_t cycles_since_run; // How many cycles have passed since the last call to GB_run(), in 8MHz units
-        double clock_multiplier;
    );
 };
 
@@ -668,6 +674,11 @@ int GB_load_boot_rom(GB_gameboy_t *gb, const char *path);
 void GB_load_boot_rom_from_buffer(GB_gameboy_t *gb, const unsigned char *buffer, size_t size);
 int GB_load_rom(GB_gameboy_t *gb, const char *path);
 void GB_load_rom_from_buffer(GB_gameboy_t *gb, const uint8_t *buffer, size_t size);
+/* Uses the buffer directly rather than copying it, if it is already a valid ROM size. The buffer
+   must stay alive until another ROM is loaded or GB_free is called. */
+void GB_load_rom_shared(GB_gameboy_t *gb, const uint8_t *buffer, size_t size);
+/* Replaces a shared ROM with a private copy, so it can be written to */
+void GB_unshare_rom(GB_gameboy_t *gb);
 
 size_t GB_battery_size(GB_gameboy_t *gb);
 int GB_save_battery_to_buffer(GB_gameboy_t *gb, unsigned char *buffer, size_t size);
@@ -682,6 +693,7 @@ void GB_log(GB_gameboy_t *gb, const char *fmt, ...) __printflike(2, 3);
 void GB_attributed_log(GB_gameboy_t *gb, GB_log_attributes attributes, const char *fmt, ...) __printflike(3, 4);
 
 void GB_set_pixels_output(GB_gameboy_t *gb, uint32_t *output);
+void GB_set_indexed_pixels_output(GB_gameboy_t *gb, uint8_t *output);
 
 void GB_set_infrared_input(GB_gameboy_t *gb, bool state);
 void GB_queue_infrared_input(GB_gameboy_t *gb, bool state, long cycles_after_previous_change); /* In 8MHz units*/
@@ -2,13 +2,18 @@
 #include "queue.h"
 
 #include <Core/gb.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 //#include <windows.h>
 
 extern const unsigned char dmg_boot[], cgb_boot[], cgb_fast_boot[], agb_boot[], sgb_boot[], sgb2_boot[];
 extern const unsigned dmg_boot_length, cgb_boot_length, cgb_fast_boot_length, agb_boot_length, sgb_boot_length, sgb2_boot_length;
 
+// Pixels are encoded straight in to the RGBA8 layout expected by the UI texture
+// upload, so frames can be handed over without any further conversion.
 static uint32_t rgbEncode(GB_gameboy_t* gb, uint8_t r, uint8_t g, uint8_t b) {
-  return r << 16 | g << 8 | b;
+  return 0xFFu << 24 | b << 16 | g << 8 | r;
 }
 
 int vasprintf(char **str, const char *fmt, va_list args)
@@ -29,10 +34,21 @@ int vasprintf(char **str, const char *fmt, va_list args)
 #define PIXEL_HEIGHT 144
 #define PIXEL_COUNT (PIXEL_WIDTH * PIXEL_HEIGHT)
 #define FRAME_BUFFER_SIZE (PIXEL_COUNT * 4)
+#define PALETTE_SIZE 0x40
 
 #define LINK_TICKS_MAX 3907
 
-#define MAX_INSTANCES 4
+// Longest block that can be captured for batched rendering.  Longer blocks are
+// rendered in pieces as the buffer fills up.
+#define CAPTURE_BUFFER_SIZE 2048
+
+// Grown by sameboy_set_block_size for hosts that use longer blocks
+#define AUDIO_BUFFER_SIZE (1024 * 8)
+
+#define CACHE_LINE_SIZE 64
+
+// About 10 seconds, the slowest boot ROM finishes in less than 3
+#define BOOT_CYCLES_MAX (8388608ull * 10)
 
 typedef struct boot_rom_t {
     const unsigned char* data;
@@ -68,29 +84,75 @@ boot_rom_t find_boot_rom(int model) {
 }
 
 typedef struct sameboy_state_t {
+    // Has to come first, see sameboy_render_captured_audio
     GB_gameboy_t gb;
-    char frameBuffer[FRAME_BUFFER_SIZE];
-    GB_sample_t audioBuffer[1024 * 8];
-    size_t currentAudioFrames;
-    Queue midiQueue;
-    bool vblankOccurred;
-    int linkTicksRemain;
 
+    // Everything touched while running is kept together straight after the core
+    size_t currentAudioFrames;
     int processTicks;
+    int linkTicksRemain;
+    bool vblankOccurred;
+    bool bit_to_send;
 
-    struct sameboy_state_t* linkTargets[MAX_INSTANCES];
+    struct sameboy_state_t** linkTargets;
     size_t linkTargetCount;
-    bool bit_to_send;
+    size_t linkTargetCapacity;
+
+    // Buffers live in allocations of their own, so they don't spread the state
+    // above over more pages than it needs
+    GB_sample_t* audioBuffer;
+    size_t audioBufferSize;
+    GB_apu_captured_sample_t* captureBuffer;
+    char* frameBuffer;
+    uint8_t* indexBuffer;
+
+    Queue midiQueue;
+
+    // Only used when a frame is fetched
+    uint32_t framePalette[PALETTE_SIZE];
+    bool frameIndexable;
+    uint64_t lastFrameHash;
 } sameboy_state_t;
 
 static void vblankHandler(GB_gameboy_t* gb) {
     sameboy_state_t* state = (sameboy_state_t*)GB_get_user_data(gb);
     state->vblankOccurred = true;
+
+    // Latch the palettes used for the frame that just finished, so the indexed
+    // output can be resolved by the UI
+    memcpy(state->framePalette, gb->background_palettes_rgb, sizeof(gb->background_palettes_rgb));
+    memcpy(state->framePalette + 0x20, gb->sprite_palettes_rgb, sizeof(gb->sprite_palettes_rgb));
+    state->frameIndexable = !gb->indexed_palette_changed;
+    gb->indexed_palette_changed = false;
+}
+
+static void* aligned_malloc(size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, CACHE_LINE_SIZE);
+#else
+    void* ptr = NULL;
+    return posix_memalign(&ptr, CACHE_LINE_SIZE, size) == 0 ? ptr : NULL;
+#endif
+}
+
+static void aligned_free(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// Finished frames plus frames that are waiting for sameboy_render_captured_audio
+static size_t audio_frames(sameboy_state_t* s) {
+    return s->currentAudioFrames + s->gb.apu_output.capture_count;
 }
 
 static void audioHandler(GB_gameboy_t* gb, GB_sample_t* sample) {
     sameboy_state_t* s = (sameboy_state_t*)GB_get_user_data(gb);
-    s->audioBuffer[s->currentAudioFrames++] = *sample;
+    if (s->currentAudioFrames < s->audioBufferSize) {
+        s->audioBuffer[s->currentAudioFrames++] = *sample;
+    }
 }
 
 static void serial_start(GB_gameboy_t* gb, bool bit_received) {
@@ -109,14 +171,23 @@ static bool serial_end(GB_gameboy_t* gb) {
     return ret;
 }
 
-void* sameboy_init(void* user_data, const char* rom_data, size_t rom_size, int model, bool fast_boot) {
-    sameboy_state_t* state = malloc(sizeof(sameboy_state_t));
+void* sameboy_init(void* user_data, const char* rom_data, size_t rom_size, int model, bool fast_boot, bool share_rom) {
+    sameboy_state_t* state = aligned_malloc(sizeof(sameboy_state_t));
 
     state->vblankOccurred = false;
+    state->lastFrameHash = 0;
+    state->frameIndexable = false;
     state->currentAudioFrames = 0;
+    state->audioBuffer = aligned_malloc(AUDIO_BUFFER_SIZE * sizeof(GB_sample_t));
+    state->audioBufferSize = AUDIO_BUFFER_SIZE;
+    state->captureBuffer = aligned_malloc(CAPTURE_BUFFER_SIZE * sizeof(GB_apu_captured_sample_t));
+    state->frameBuffer = aligned_malloc(FRAME_BUFFER_SIZE);
+    state->indexBuffer = aligned_malloc(PIXEL_COUNT);
     state->linkTicksRemain = 0;
     state->bit_to_send = true;
+    state->linkTargets = NULL;
     state->linkTargetCount = 0;
+    state->linkTargetCapacity = 0;
     state->processTicks = 0;
 
     GB_init(&state->gb, model);
@@ -129,6 +200,7 @@ void* sameboy_init(void* user_data, const char* rom_data, size_t rom_size, int m
     }
 
     GB_set_pixels_output(&state->gb, state->frameBuffer);
+    GB_set_indexed_pixels_output(&state->gb, state->indexBuffer);
     GB_set_sample_rate(&state->gb, 48000);
     GB_set_user_data(&state->gb, state);
 
@@ -144,7 +216,11 @@ void* sameboy_init(void* user_data, const char* rom_data, size_t rom_size, int m
 
     GB_set_rendering_disabled(&state->gb, true);
 
-    GB_load_rom_from_buffer(&state->gb, rom_data, rom_size);
+    if (share_rom) {
+        GB_load_rom_shared(&state->gb, (const uint8_t*)rom_data, rom_size);
+    } else {
+        GB_load_rom_from_buffer(&state->gb, (const uint8_t*)rom_data, rom_size);
+    }
 
     queue_init(&state->midiQueue);
 
@@ -154,6 +230,9 @@ void* sameboy_init(void* user_data, const char* rom_data, size_t rom_size, int m
 void sameboy_update_rom(void* state, const char* rom_data, size_t rom_size) {
     sameboy_state_t* s = (sameboy_state_t*)state;
 
+    // A shared ROM may be in use by other instances, so patches go in to a copy
+    GB_unshare_rom(&s->gb);
+
     size_t size;
     uint16_t bank;
     void* rom = GB_get_direct_access(&s->gb, GB_DIRECT_ACCESS_ROM, &size, &bank);
@@ -163,6 +242,20 @@ void sameboy_update_rom(void* state, const char* rom_data, size_t rom_size) {
     }
 }
 
+void sameboy_patch_rom(void* state, size_t offset, const char* data, size_t data_size) {
+    sameboy_state_t* s = (sameboy_state_t*)state;
+
+    GB_unshare_rom(&s->gb);
+
+    size_t size;
+    uint16_t bank;
+    char* rom = GB_get_direct_access(&s->gb, GB_DIRECT_ACCESS_ROM, &size, &bank);
+
+    if (offset + data_size <= size) {
+        memcpy(rom + offset, data, data_size);
+    }
+}
+
 void sameboy_disable_rendering(void* state, bool disabled) {
     sameboy_state_t* s = (sameboy_state_t*)state;
     GB_set_rendering_disabled(&s->gb, disabled);
@@ -181,9 +274,56 @@ void sameboy_reset(void* state, int model, bool fast_boot) {
     GB_switch_model_and_reset(&s->gb, model);
 }
 
+bool sameboy_run_boot_rom(void* state) {
+    sameboy_state_t* s = (sameboy_state_t*)state;
+
+    uint64_t cycles = 0;
+    while (!s->gb.boot_rom_finished && cycles < BOOT_CYCLES_MAX) {
+        cycles += GB_run(&s->gb);
+        s->currentAudioFrames = 0;
+        s->gb.apu_output.capture_count = 0;
+    }
+
+    s->vblankOccurred = false;
+    return s->gb.boot_rom_finished;
+}
+
+void sameboy_load_boot_state(void* state, const char* source, size_t size) {
+    sameboy_state_t* s = (sameboy_state_t*)state;
+
+    // The state holds whatever the cartridge RAM contained when it was saved
+    size_t ram_size = s->gb.mbc_ram_size;
+    uint8_t* ram = ram_size ? malloc(ram_size) : NULL;
+    if (ram) {
+        memcpy(ram, s->gb.mbc_ram, ram_size);
+    }
+
+    GB_load_state_from_buffer(&s->gb, (const uint8_t*)source, size);
+
+    if (ram) {
+        memcpy(s->gb.mbc_ram, ram, ram_size);
+        free(ram);
+    }
+
+    s->currentAudioFrames = 0;
+    s->gb.apu_output.capture_count = 0;
+}
+
 void sameboy_set_link_targets(void* state, void** linkTargets, size_t count) {
     sameboy_state_t* s = (sameboy_state_t*)state;
 
+    // Only grows, so linking and unlinking the same instances doesn't allocate
+    if (count > s->linkTargetCapacity) {
+        sameboy_state_t** targets = realloc(s->linkTargets, count * sizeof(sameboy_state_t*));
+        if (!targets) {
+            s->linkTargetCount = 0;
+            return;
+        }
+
+        s->linkTargets = targets;
+        s->linkTargetCapacity = count;
+    }
+
     for (size_t i = 0; i < count; i++) {
         s->linkTargets[i] = (sameboy_state_t*)(linkTargets[i]);
     }
@@ -243,6 +383,35 @@ size_t sameboy_save_battery(void* state, const char* target, size_t size) {
     return GB_save_battery_to_buffer(&s->gb, target, size) == 0;
 }
 
+// Copies part of the cartridge RAM without serializing the rest of it (or the RTC)
+size_t sameboy_read_battery(void* state, size_t offset, char* target, size_t size) {
+    sameboy_state_t* s = (sameboy_state_t*)state;
+    if (!s->gb.mbc_ram || offset >= s->gb.mbc_ram_size) {
+        return 0;
+    }
+
+    if (size > s->gb.mbc_ram_size - offset) {
+        size = s->gb.mbc_ram_size - offset;
+    }
+
+    memcpy(target, s->gb.mbc_ram + offset, size);
+    return size;
+}
+
+size_t sameboy_write_battery(void* state, size_t offset, const char* source, size_t size) {
+    sameboy_state_t* s = (sameboy_state_t*)state;
+    if (!s->gb.mbc_ram || offset >= s->gb.mbc_ram_size) {
+        return 0;
+    }
+
+    if (size > s->gb.mbc_ram_size - offset) {
+        size = s->gb.mbc_ram_size - offset;
+    }
+
+    memcpy(s->gb.mbc_ram + offset, source, size);
+    return size;
+}
+
 void sameboy_load_battery(void* state, const char* source, size_t size) {
     sameboy_state_t* s = (sameboy_state_t*)state;
     GB_load_battery_from_buffer(&s->gb, source, size);
@@ -262,8 +431,53 @@ void sameboy_load_state(void* state, const char* source, size_t size) {
     GB_load_state_from_buffer(&s->gb, source, size);
 }
 
+void sameboy_set_audio_capture(void* state, bool enabled) {
+    sameboy_state_t* s = (sameboy_state_t*)state;
+    if (enabled) {
+        GB_apu_set_capture(&s->gb, s->captureBuffer, CAPTURE_BUFFER_SIZE);
+    } else {
+        GB_apu_set_capture(&s->gb, NULL, 0);
+    }
+}
+
+// gb is the first member of the state, so the state pointers can be handed
+// straight to the core
+_Static_assert(offsetof(sameboy_state_t, gb) == 0, "The core state has to come first");
+
+void sameboy_set_block_size(void* state, size_t frames) {
+    sameboy_state_t* s = (sameboy_state_t*)state;
+
+    // sameboy_update can overshoot the frames it was asked for a little, so
+    // there's room for twice that.  Only grows.
+    size_t size = frames * 2;
+    if (size <= s->audioBufferSize) {
+        return;
+    }
+
+    GB_sample_t* buffer = aligned_malloc(size * sizeof(GB_sample_t));
+    if (!buffer) {
+        return;
+    }
+
+    memcpy(buffer, s->audioBuffer, s->currentAudioFrames * sizeof(GB_sample_t));
+    aligned_free(s->audioBuffer);
+    s->audioBuffer = buffer;
+    s->audioBufferSize = size;
+}
+
+void sameboy_render_captured_audio(void** states, size_t count) {
+    GB_apu_render_captured((GB_gameboy_t**)states, count);
+}
+
 size_t sameboy_fetch_audio(void* state, int16_t* audio) {
     sameboy_state_t* s = (sameboy_state_t*)state;
+
+    // Anything that wasn't rendered as part of a batch is finished on its own
+    if (s->gb.apu_output.capture_count) {
+        GB_gameboy_t* gb = &s->gb;
+        GB_apu_render_captured(&gb, 1);
+    }
+
     size_t size = s->currentAudioFrames;
     if (size > 0) {
         memcpy(audio, s->audioBuffer, s->currentAudioFrames * sizeof(GB_sample_t));
@@ -273,9 +487,34 @@ size_t sameboy_fetch_audio(void* state, int16_t* audio) {
     return size;
 }
 
-size_t sameboy_fetch_video(void* state, uint32_t* video) {
+// FNV-1a over 64 bit words.  This is only used to detect whether the frame has
+// changed since it was last fetched, so it doesn't need to be particularly strong.
+// Words are copied out rather than read through a cast, since the buffers are
+// only byte aligned; compilers turn the memcpy in to a plain load.
+static uint64_t hash_frame(const void* data, size_t size, uint64_t hash) {
+    const char* bytes = (const char*)data;
+    for (size_t i = 0; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+#define FRAME_HASH_SEED 0xCBF29CE484222325ull
+
+size_t sameboy_fetch_video(void* state, uint32_t* video, bool force) {
     sameboy_state_t* s = (sameboy_state_t*)state;
     if (s->vblankOccurred) {
+        // Static screens are very common (LSDj spends most of its time on them),
+        // so skip the copy entirely if nothing has changed since the last fetch.
+        uint64_t hash = hash_frame(s->frameBuffer, FRAME_BUFFER_SIZE, FRAME_HASH_SEED);
+        if (!force && hash == s->lastFrameHash) {
+            return 0;
+        }
+
+        s->lastFrameHash = hash;
         memcpy(video, s->frameBuffer, FRAME_BUFFER_SIZE);
         return FRAME_BUFFER_SIZE;
     }
@@ -283,8 +522,30 @@ size_t sameboy_fetch_video(void* state, uint32_t* video) {
     return 0;
 }
 
+int sameboy_fetch_indexed_video(void* state, uint8_t* indices, uint32_t* palette, bool force) {
+    sameboy_state_t* s = (sameboy_state_t*)state;
+    if (s->vblankOccurred) {
+        if (!s->frameIndexable) {
+            return -1;
+        }
+
+        uint64_t hash = hash_frame(s->indexBuffer, PIXEL_COUNT, FRAME_HASH_SEED);
+        hash = hash_frame(s->framePalette, sizeof(s->framePalette), hash);
+        if (!force && hash == s->lastFrameHash) {
+            return 0;
+        }
+
+        s->lastFrameHash = hash;
+        memcpy(indices, s->indexBuffer, PIXEL_COUNT);
+        memcpy(palette, s->framePalette, sizeof(s->framePalette));
+        return PIXEL_COUNT;
+    }
+
+    return 0;
+}
+
 int update_first_instance(sameboy_state_t* s, int targetAudioFrames) {
-    if (s->currentAudioFrames < targetAudioFrames) {
+    if (audio_frames(s) < targetAudioFrames) {
         s->processTicks += GB_run(&s->gb);
         return 0;
     }
@@ -293,8 +554,8 @@ int update_first_instance(sameboy_state_t* s, int targetAudioFrames) {
 }
 
 int update_instance(sameboy_state_t* s, int targetAudioFrames, int targetTicks) {
-    if (s->currentAudioFrames < targetAudioFrames) {
-        while (s->currentAudioFrames < targetAudioFrames && s->processTicks < targetTicks) {
+    if (audio_frames(s) < targetAudioFrames) {
+        while (audio_frames(s) < targetAudioFrames && s->processTicks < targetTicks) {
             s->processTicks += GB_run(&s->gb);
         }
 
@@ -305,9 +566,8 @@ int update_instance(sameboy_state_t* s, int targetAudioFrames, int targetTicks)
 }
 
 void sameboy_update_multiple(void** states, size_t stateCount, size_t requiredAudioFrames) {
-    sameboy_state_t* st[MAX_INSTANCES];
+    sameboy_state_t** st = (sameboy_state_t**)states;
     for (size_t i = 0; i < stateCount; i++) {
-        st[i] = (sameboy_state_t*)states[i];
         st[i]->vblankOccurred = false;
     }
 
@@ -316,7 +576,7 @@ void sameboy_update_multiple(void** states, size_t stateCount, size_t requiredAu
         complete = 0;
         for (size_t i = 0; i < stateCount; i++) {
             sameboy_state_t* s = st[i];
-            if (s->currentAudioFrames < requiredAudioFrames) {
+            if (audio_frames(s) < requiredAudioFrames) {
                 GB_run(&s->gb);
             } else {
                 complete++;
@@ -331,9 +591,9 @@ void sameboy_update(void* state, size_t requiredAudioFrames) {
     s->vblankOccurred = false;
 
     int delta = 0;
-    while (s->currentAudioFrames < requiredAudioFrames) {
+    while (audio_frames(s) < requiredAudioFrames) {
         if (s->linkTicksRemain <= 0) {
-            if (length(&s->midiQueue) && peek(&s->midiQueue).offset <= s->currentAudioFrames) {
+            if (length(&s->midiQueue) && peek(&s->midiQueue).offset <= audio_frames(s)) {
                 offset_byte_t b = dequeue(&s->midiQueue);
                 for (int i = b.bitCount - 1; i >= 0; i--) {
                     bool bit = (bool)((b.byte & (1 << i)) >> i);
@@ -366,5 +626,10 @@ const char* sameboy_get_rom_name(void* state) {
 void sameboy_free(void* state) {
     sameboy_state_t* s = (sameboy_state_t*)state;
     GB_free(&s->gb);
-    free(state);
+    aligned_free(s->audioBuffer);
+    aligned_free(s->captureBuffer);
+    aligned_free(s->frameBuffer);
+    aligned_free(s->indexBuffer);
+    free(s->linkTargets);
+    aligned_free(state);
 }
@@ -58,10 +58,19 @@ extern "C" {
 //#undef RETRO_API
 //#define RETRO_API
 
-RETRO_API void* sameboy_init(void* user_data, const char* rom_data, size_t rom_size, int model, bool fast_boot);
+// If share_rom is set the core reads rom_data in place, and it must outlive the instance
+RETRO_API void* sameboy_init(void* user_data, const char* rom_data, size_t rom_size, int model, bool fast_boot, bool share_rom);
 RETRO_API void sameboy_update_rom(void* state, const char* rom_data, size_t rom_size);
+// Overwrites part of the ROM, without touching the rest of it
+RETRO_API void sameboy_patch_rom(void* state, size_t offset, const char* data, size_t data_size);
 RETRO_API void sameboy_free(void* state);
 RETRO_API void sameboy_reset(void* state, int model, bool fast_boot);
+// Runs the boot ROM to completion without producing any audio.  Returns false if
+// it doesn't hand over to the cartridge in a reasonable amount of time.
+RETRO_API bool sameboy_run_boot_rom(void* state);
+// Loads a state saved straight after the boot ROM finished, keeping the current
+// cartridge RAM
+RETRO_API void sameboy_load_boot_state(void* state, const char* source, size_t size);
 RETRO_API void sameboy_update(void* state, size_t requiredAudioFrames);
 
 RETRO_API void sameboy_update_multiple(void** states, size_t stateCount, size_t requiredAudioFrames);
@@ -76,6 +85,9 @@ RETRO_API void sameboy_set_button(void* state, int buttonId, bool down);
 
 RETRO_API size_t sameboy_battery_size(void* state);
 RETRO_API size_t sameboy_save_battery(void* state, const char* target, size_t size);
+RETRO_API size_t sameboy_read_battery(void* state, size_t offset, char* target, size_t size);
+// Overwrites part of the SRAM, leaving the rest (and the running game) alone
+RETRO_API size_t sameboy_write_battery(void* state, size_t offset, const char* source, size_t size);
 RETRO_API void sameboy_load_battery(void* state, const char* source, size_t size);
 
 RETRO_API void sameboy_set_link_targets(void* state, void** linkTargets, size_t count);
@@ -84,8 +96,23 @@ RETRO_API size_t sameboy_save_state_size(void* state);
 RETRO_API void sameboy_save_state(void* state, char* target, size_t size);
 RETRO_API void sameboy_load_state(void* state, const char* source, size_t size);
 
+// While enabled, sameboy_update only runs the emulation side of audio output.  The
+// samples are finished by sameboy_render_captured_audio, which does a whole group of
+// instances in one pass, or by the next call to sameboy_fetch_audio.
+RETRO_API void sameboy_set_audio_capture(void* state, bool enabled);
+RETRO_API void sameboy_render_captured_audio(void** states, size_t count);
+
+// The longest block sameboy_update will be asked for.  sameboy_fetch_audio can
+// return up to twice as many frames.
+RETRO_API void sameboy_set_block_size(void* state, size_t frames);
+
 RETRO_API size_t sameboy_fetch_audio(void* state, int16_t* audio);
-RETRO_API size_t sameboy_fetch_video(void* state, uint32_t* video);
+RETRO_API size_t sameboy_fetch_video(void* state, uint32_t* video, bool force);
+
+// Fetches the frame as palette indices plus the 64 entry palette they refer to.  Returns -1
+// if the palette changed part way through the frame, in which case sameboy_fetch_video
+// has to be used instead.
+RETRO_API int sameboy_fetch_indexed_video(void* state, uint8_t* indices, uint32_t* palette, bool force);
 
 RETRO_API const char* sameboy_get_rom_name(void* state);
 
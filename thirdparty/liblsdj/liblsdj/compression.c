@@ -482,3 +482,238 @@ unsigned int lsdj_compress_to_file(const unsigned char* data, unsigned int block
     
     return result;
 }
+
+void lsdj_decompress_span(const unsigned char* data, size_t size, size_t position, long firstBlockOffset, size_t blockSize, unsigned char* song, lsdj_error_t** error)
+{
+    if (data == NULL || song == NULL)
+        return lsdj_error_new(error, "data is NULL");
+    
+    const unsigned char* read = data + position;
+    const unsigned char* end = data + size;
+    
+    unsigned char* write = song;
+    unsigned char* const writeEnd = song + LSDJ_SONG_DECOMPRESSED_SIZE;
+    
+    size_t currentBlockPosition = position;
+    
+    int reading = 1;
+    while (reading == 1)
+    {
+        if (read >= end)
+            return lsdj_error_new(error, "could not read byte for decompression");
+        
+        const unsigned char byte = *read++;
+        switch (byte)
+        {
+            case RUN_LENGTH_ENCODING_BYTE:
+            {
+                if (read >= end)
+                    return lsdj_error_new(error, "could not read RLE byte");
+                
+                const unsigned char value = *read++;
+                if (value == RUN_LENGTH_ENCODING_BYTE)
+                {
+                    if (write >= writeEnd)
+                        return lsdj_error_new(error, "could not write RLE byte");
+                    
+                    *write++ = value;
+                } else {
+                    if (read >= end)
+                        return lsdj_error_new(error, "could not read RLE count byte");
+                    
+                    const unsigned char count = *read++;
+                    if (count > writeEnd - write)
+                        return lsdj_error_new(error, "could not write byte for RLE expansion");
+                    
+                    memset(write, value, count);
+                    write += count;
+                }
+                break;
+            }
+            case SPECIAL_ACTION_BYTE:
+            {
+                if (read >= end)
+                    return lsdj_error_new(error, "could not read SA byte");
+                
+                const unsigned char action = *read++;
+                switch (action)
+                {
+                    case SPECIAL_ACTION_BYTE:
+                        if (write >= writeEnd)
+                            return lsdj_error_new(error, "could not write SA byte");
+                        
+                        *write++ = action;
+                        break;
+                    case LSDJ_DEFAULT_WAVE_BYTE:
+                    case LSDJ_DEFAULT_INSTRUMENT_BYTE:
+                    {
+                        if (read >= end)
+                            return lsdj_error_new(error, "could not read default wave/instrument count byte");
+                        
+                        const unsigned char count = *read++;
+                        const unsigned char* pattern = action == LSDJ_DEFAULT_WAVE_BYTE ? LSDJ_DEFAULT_WAVE : LSDJ_DEFAULT_INSTRUMENT_COMPRESSION;
+                        const size_t patternSize = action == LSDJ_DEFAULT_WAVE_BYTE ? sizeof(LSDJ_DEFAULT_WAVE) : sizeof(LSDJ_DEFAULT_INSTRUMENT_COMPRESSION);
+                        
+                        if (count * patternSize > (size_t)(writeEnd - write))
+                            return lsdj_error_new(error, "could not write default wave/instrument byte");
+                        
+                        for (int i = 0; i < count; ++i)
+                        {
+                            memcpy(write, pattern, patternSize);
+                            write += patternSize;
+                        }
+                        break;
+                    }
+                    case END_OF_FILE_BYTE:
+                        reading = 0;
+                        break;
+                    default:
+                        if (firstBlockOffset >= 0)
+                            currentBlockPosition = (size_t)firstBlockOffset + (size_t)(action - 1) * blockSize;
+                        else
+                            currentBlockPosition += blockSize;
+                        
+                        if (currentBlockPosition > size)
+                            return lsdj_error_new(error, "could not seek to new block position");
+                        
+                        read = data + currentBlockPosition;
+                        break;
+                }
+                break;
+            }
+            default:
+                if (write >= writeEnd)
+                    return lsdj_error_new(error, "could not write decompression byte");
+                
+                *write++ = byte;
+                break;
+        }
+    }
+    
+    if (write != writeEnd)
+    {
+        char buffer[100];
+        memset(buffer, '\0', sizeof(buffer));
+        snprintf(buffer, sizeof(buffer), "decompressed size does not line up with 0x8000 bytes (but 0x%lx)", (long)(write - song));
+        return lsdj_error_new(error, buffer);
+    }
+}
+
+unsigned int lsdj_compress_span(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, unsigned char* blocks, size_t size, lsdj_error_t** error)
+{
+    if (startBlock == blockCount + 1)
+        return 0;
+    
+    if (data == NULL || blocks == NULL)
+    {
+        lsdj_error_new(error, "data is NULL");
+        return 0;
+    }
+    
+    // Clamp to the blocks that are actually available
+    const size_t available = (blockCount + 1 - startBlock) * blockSize;
+    unsigned char* const blocksEnd = blocks + (size < available ? size : available);
+    if ((size_t)(blocksEnd - blocks) < blockSize)
+    {
+        lsdj_error_new(error, "not enough room for a single block");
+        return 0;
+    }
+    
+    unsigned char nextEvent[3] = { 0, 0, 0 };
+    unsigned short eventSize = 0;
+    
+    unsigned char currentBlock = startBlock;
+    unsigned char* write = blocks;
+    unsigned char* blockEnd = blocks + blockSize;
+    
+    const unsigned char* end = data + LSDJ_SONG_DECOMPRESSED_SIZE;
+    for (const unsigned char* read = data; read < end; )
+    {
+        // Are we reading a default wave? If so, we can compress these!
+        unsigned char defaultWaveLengthCount = 0;
+        while (read + LSDJ_WAVE_LENGTH < end && memcmp(read, LSDJ_DEFAULT_WAVE, LSDJ_WAVE_LENGTH) == 0 && defaultWaveLengthCount != 0xFF)
+        {
+            read += LSDJ_WAVE_LENGTH;
+            ++defaultWaveLengthCount;
+        }
+        
+        if (defaultWaveLengthCount > 0)
+        {
+            nextEvent[0] = SPECIAL_ACTION_BYTE;
+            nextEvent[1] = LSDJ_DEFAULT_WAVE_BYTE;
+            nextEvent[2] = defaultWaveLengthCount;
+            eventSize = 3;
+        } else {
+            // Are we reading a default instrument? If so, we can compress these!
+            unsigned char defaultInstrumentLengthCount = 0;
+            while (read + LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH < end && memcmp(read, LSDJ_DEFAULT_INSTRUMENT_COMPRESSION, LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH) == 0 && defaultInstrumentLengthCount != 0xFF)
+            {
+                read += LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH;
+                ++defaultInstrumentLengthCount;
+            }
+            
+            if (defaultInstrumentLengthCount > 0)
+            {
+                nextEvent[0] = SPECIAL_ACTION_BYTE;
+                nextEvent[1] = LSDJ_DEFAULT_INSTRUMENT_BYTE;
+                nextEvent[2] = defaultInstrumentLengthCount;
+                eventSize = 3;
+            } else if (*read == RUN_LENGTH_ENCODING_BYTE || *read == SPECIAL_ACTION_BYTE) {
+                // Escape the bytes that would otherwise start a command
+                nextEvent[0] = *read;
+                nextEvent[1] = *read;
+                eventSize = 2;
+                read++;
+            } else {
+                // See if we can do run-length encoding
+                const unsigned char c = *read;
+                if (read + 3 < end && read[1] == c && read[2] == c && read[3] == c)
+                {
+                    const size_t remaining = (size_t)(end - read);
+                    size_t count = 4;
+                    while (count < remaining && count < 0xFF && read[count] == c)
+                        ++count;
+                    
+                    nextEvent[0] = RUN_LENGTH_ENCODING_BYTE;
+                    nextEvent[1] = c;
+                    nextEvent[2] = (unsigned char)count;
+                    eventSize = 3;
+                    read += count;
+                } else {
+                    nextEvent[0] = *read++;
+                    eventSize = 1;
+                }
+            }
+        }
+        
+        // See if the event would still fit in this block
+        // If not, move to a new block
+        if ((size_t)(write - (blockEnd - blockSize)) + eventSize + 2 >= blockSize)
+        {
+            // Have we reached the maximum block count? If so, roll back
+            if (currentBlock + 1 == blockCount + 1 || blockEnd + blockSize > blocksEnd)
+            {
+                memset(blocks, 0, (size_t)(blockEnd - blocks));
+                return 0;
+            }
+            
+            // Write the "next block" command and fill the rest of the block with 0's
+            *write++ = SPECIAL_ACTION_BYTE;
+            *write++ = currentBlock + 1;
+            memset(write, 0, (size_t)(blockEnd - write));
+            
+            currentBlock += 1;
+            write = blockEnd;
+            blockEnd += blockSize;
+        }
+        
+        memcpy(write, nextEvent, eventSize);
+        write += eventSize;
+    }
+    
+    *write++ = SPECIAL_ACTION_BYTE;
+    *write++ = END_OF_FILE_BYTE;
+    memset(write, 0, (size_t)(blockEnd - write));
+    
+    return currentBlock - startBlock + 1;
+}
@@ -54,6 +54,16 @@ void lsdj_decompress_from_file(const char* path, lsdj_vio_t* wvio, long* firstBl
 /*! Returns the amount of blocks written */
 unsigned int lsdj_compress(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, lsdj_vio_t* wvio, lsdj_error_t** error);
 unsigned int lsdj_compress_to_file(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, const char* path, lsdj_error_t** error);
+
+// Span based versions of the above, which work directly on memory without going through a vio
+/*! Decompresses straight in to song, which must hold LSDJ_SONG_DECOMPRESSED_SIZE bytes.
+    Reading starts at data + position. If firstBlockOffset is negative, blocks are expected to
+    follow each other (as in .lsdsng files), otherwise jumps are relative to it (as in .sav files). */
+void lsdj_decompress_span(const unsigned char* data, size_t size, size_t position, long firstBlockOffset, size_t blockSize, unsigned char* song, lsdj_error_t** error);
+
+/*! Compresses in to blocks, which should have room for the blocks from startBlock up to blockCount.
+    Returns the amount of blocks written, or 0 if the song didn't fit (in which case blocks is left zeroed) */
+unsigned int lsdj_compress_span(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, unsigned char* blocks, size_t size, lsdj_error_t** error);
     
 #ifdef __cplusplus
 }
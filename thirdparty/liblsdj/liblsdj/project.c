@@ -84,7 +84,9 @@ void lsdj_project_free(lsdj_project_t* project)
     free(project);
 }
 
-lsdj_project_t* lsdj_project_read_lsdsng(lsdj_vio_t* vio, lsdj_error_t** error)
+// Reads a project from the vio.  mem is only set by the memory entry point, and
+// lets the song be decompressed straight from the buffer the vio reads from.
+static lsdj_project_t* read_lsdsng(lsdj_vio_t* vio, const lsdj_memory_data_t* mem, lsdj_error_t** error)
 {
     lsdj_project_t* project = alloc_project(error);
     
@@ -106,19 +108,28 @@ lsdj_project_t* lsdj_project_read_lsdsng(lsdj_vio_t* vio, lsdj_error_t** error)
     unsigned char decompressed[LSDJ_SONG_DECOMPRESSED_SIZE];
     memset(decompressed, 0, sizeof(decompressed));
     
-    lsdj_memory_data_t mem;
-    mem.begin = mem.cur = decompressed;
-    mem.size = sizeof(decompressed);
-    
-    lsdj_vio_t wvio;
-    wvio.write = lsdj_mwrite;
-    wvio.tell = lsdj_mtell;
-    wvio.seek = lsdj_mseek;
-    wvio.user_data = &mem;
+    if (mem != NULL)
+    {
+        lsdj_decompress_span(mem->begin, mem->size, (size_t)(mem->cur - mem->begin), -1, BLOCK_SIZE, decompressed, error);
+    } else {
+        lsdj_memory_data_t wmem;
+        wmem.begin = wmem.cur = decompressed;
+        wmem.size = sizeof(decompressed);
+        
+        lsdj_vio_t wvio;
+        wvio.write = lsdj_mwrite;
+        wvio.tell = lsdj_mtell;
+        wvio.seek = lsdj_mseek;
+        wvio.user_data = &wmem;
+        
+        lsdj_decompress(vio, &wvio, NULL, BLOCK_SIZE, error);
+    }
     
-    lsdj_decompress(vio, &wvio, NULL, BLOCK_SIZE, error);
     if (error && *error)
+    {
+        lsdj_project_free(project);
         return NULL;
+    }
     
     // Read in the song
     if (project->song == NULL)
@@ -127,6 +138,11 @@ lsdj_project_t* lsdj_project_read_lsdsng(lsdj_vio_t* vio, lsdj_error_t** error)
     return project;
 }
 
+lsdj_project_t* lsdj_project_read_lsdsng(lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    return read_lsdsng(vio, NULL, error);
+}
+
 lsdj_project_t* lsdj_project_read_lsdsng_from_file(const char* path, lsdj_error_t** error)
 {
     if (path == NULL)
@@ -176,10 +192,12 @@ lsdj_project_t* lsdj_project_read_lsdsng_from_memory(const unsigned char* data,
     vio.seek = lsdj_mseek;
     vio.user_data = &mem;
     
-    return lsdj_project_read_lsdsng(&vio, error);
+    return read_lsdsng(&vio, &mem, error);
 }
 
-size_t lsdj_project_write_lsdsng(const lsdj_project_t* project, lsdj_vio_t* vio, lsdj_error_t** error)
+// Writes a project to the vio.  mem is only set by the memory entry point, and lets
+// the song be compressed straight in to the buffer the vio writes to.
+static size_t write_lsdsng(const lsdj_project_t* project, lsdj_vio_t* vio, lsdj_memory_data_t* mem, lsdj_error_t** error)
 {
     size_t write_size = 0;
 
@@ -211,13 +229,26 @@ size_t lsdj_project_write_lsdsng(const lsdj_project_t* project, lsdj_vio_t* vio,
         return write_size;
     
     // Compress the song
-    const size_t block_count = lsdj_compress(decompressed, BLOCK_SIZE, 1, BLOCK_COUNT, vio, error);
+    size_t block_count = 0;
+    if (mem != NULL)
+    {
+        const size_t available = mem->size - (size_t)(mem->cur - mem->begin);
+        block_count = lsdj_compress_span(decompressed, BLOCK_SIZE, 1, BLOCK_COUNT, mem->cur, available, error);
+        mem->cur += block_count * BLOCK_SIZE;
+    } else {
+        block_count = lsdj_compress(decompressed, BLOCK_SIZE, 1, BLOCK_COUNT, vio, error);
+    }
     write_size += block_count * BLOCK_SIZE;
 
     assert(write_size <= LSDSNG_MAX_SIZE);
     return write_size;
 }
 
+size_t lsdj_project_write_lsdsng(const lsdj_project_t* project, lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    return write_lsdsng(project, vio, NULL, error);
+}
+
 size_t lsdj_project_write_lsdsng_to_file(const lsdj_project_t* project, const char* path, lsdj_error_t** error)
 {
     if (path == NULL)
@@ -279,7 +310,7 @@ size_t lsdj_project_write_lsdsng_to_memory(const lsdj_project_t* project, unsign
     vio.seek = lsdj_mseek;
     vio.user_data = &mem;
     
-    return lsdj_project_write_lsdsng(project, &vio, error);
+    return write_lsdsng(project, &vio, &mem, error);
 }
 
 void lsdj_clear_project(lsdj_project_t* project)
@@ -219,8 +219,9 @@ lsdj_project_t* lsdj_sav_get_project(const lsdj_sav_t* sav, unsigned char projec
     return sav->projects[project];
 }
 
-// Read compressed project data from memory sav file
-void read_compressed_blocks(lsdj_vio_t* vio, lsdj_project_t** projects, lsdj_error_t** error)
+// Read compressed project data from memory sav file.  mem is only set when the
+// whole sav is in memory, in which case the blocks are decompressed straight from it.
+void read_compressed_blocks(lsdj_vio_t* vio, const lsdj_memory_data_t* mem, lsdj_project_t** projects, lsdj_error_t** error)
 {
     // Read the block allocation table
     unsigned char blocks_alloc_table[BLOCK_COUNT];
@@ -242,20 +243,26 @@ void read_compressed_blocks(lsdj_vio_t* vio, lsdj_project_t** projects, lsdj_err
         unsigned char data[LSDJ_SONG_DECOMPRESSED_SIZE];
         memset(data, 0x00, sizeof(data));
         
-        vio->seek(HEADER_START + (i + 1) * BLOCK_SIZE, SEEK_SET, vio->user_data);
-                
-        lsdj_memory_data_t mem;
-        mem.cur = mem.begin = data;
-        mem.size = sizeof(data);
-        
         long block1position = HEADER_START + BLOCK_SIZE;
         
-        lsdj_vio_t wvio;
-        wvio.write = lsdj_mwrite;
-        wvio.tell = lsdj_mtell;
-        wvio.seek = lsdj_mseek;
-        wvio.user_data = &mem;
-        lsdj_decompress(vio, &wvio, &block1position, BLOCK_SIZE, error);
+        if (mem != NULL)
+        {
+            lsdj_decompress_span(mem->begin, mem->size, HEADER_START + (i + 1) * BLOCK_SIZE, block1position, BLOCK_SIZE, data, error);
+        } else {
+            vio->seek(HEADER_START + (i + 1) * BLOCK_SIZE, SEEK_SET, vio->user_data);
+            
+            lsdj_memory_data_t wmem;
+            wmem.cur = wmem.begin = data;
+            wmem.size = sizeof(data);
+            
+            lsdj_vio_t wvio;
+            wvio.write = lsdj_mwrite;
+            wvio.tell = lsdj_mtell;
+            wvio.seek = lsdj_mseek;
+            wvio.user_data = &wmem;
+            lsdj_decompress(vio, &wvio, &block1position, BLOCK_SIZE, error);
+        }
+        
         if (error && *error)
             return;
         
@@ -271,7 +278,7 @@ void read_compressed_blocks(lsdj_vio_t* vio, lsdj_project_t** projects, lsdj_err
     }
 }
 
-lsdj_sav_t* lsdj_sav_read(lsdj_vio_t* vio, lsdj_error_t** error)
+static lsdj_sav_t* read_sav(lsdj_vio_t* vio, const lsdj_memory_data_t* mem, lsdj_error_t** error)
 {
     // Check for incorrect input
     if (vio->read == NULL)
@@ -337,7 +344,7 @@ lsdj_sav_t* lsdj_sav_read(lsdj_vio_t* vio, lsdj_error_t** error)
     memcpy(sav->reserved8120, header.empty, sizeof(sav->reserved8120));
     
     // Read the compressed projects
-    read_compressed_blocks(vio, sav->projects, error);
+    read_compressed_blocks(vio, mem, sav->projects, error);
     if (error && *error)
     {
         lsdj_sav_free(sav);
@@ -376,6 +383,11 @@ lsdj_sav_t* lsdj_sav_read(lsdj_vio_t* vio, lsdj_error_t** error)
     return sav;
 }
 
+lsdj_sav_t* lsdj_sav_read(lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    return read_sav(vio, NULL, error);
+}
+
 lsdj_sav_t* lsdj_sav_read_from_file(const char* path, lsdj_error_t** error)
 {
     if (path == NULL)
@@ -424,7 +436,7 @@ lsdj_sav_t* lsdj_sav_read_from_memory(const unsigned char* data, size_t size, ls
     vio.seek = lsdj_mseek;
     vio.user_data = &mem;
     
-    return lsdj_sav_read(&vio, error);
+    return read_sav(&vio, &mem, error);
 }
 
 void lsdj_sav_write(const lsdj_sav_t* sav, lsdj_vio_t* vio, lsdj_error_t** error)
@@ -472,18 +484,8 @@ void lsdj_sav_write(const lsdj_sav_t* sav, lsdj_vio_t* vio, lsdj_error_t** error
             unsigned char song_data[LSDJ_SONG_DECOMPRESSED_SIZE];
             lsdj_song_write_to_memory(song, song_data, LSDJ_SONG_DECOMPRESSED_SIZE, error);
             
-            lsdj_memory_data_t mem;
-            mem.cur = mem.begin = blocks[current_block - 1];
-            mem.size = sizeof(blocks);
-            
-            lsdj_vio_t wvio;
-            wvio.write = lsdj_mwrite;
-            wvio.seek = lsdj_mseek;
-            wvio.tell = lsdj_mtell;
-            wvio.user_data = &mem;
-            
-//            unsigned int written_block_count = lsdj_compress(song_data, &blocks[0][0], BLOCK_SIZE, current_block, BLOCK_COUNT);
-            unsigned int written_block_count = lsdj_compress(song_data, BLOCK_SIZE, current_block, BLOCK_COUNT, &wvio, error);
+            const size_t available = sizeof(blocks) - (current_block - 1) * BLOCK_SIZE;
+            unsigned int written_block_count = lsdj_compress_span(song_data, BLOCK_SIZE, current_block, BLOCK_COUNT, blocks[current_block - 1], available, error);
             if (error && *error)
                 return;
             
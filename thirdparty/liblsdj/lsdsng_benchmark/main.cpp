@@ -0,0 +1,255 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+// Measures decompressing and compressing a bulk of .lsdsng's through the vio
+// functions versus the span based ones, and checks that both produce the same data
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../liblsdj/compression.h"
+#include "../liblsdj/project.h"
+#include "../liblsdj/song.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+struct Song
+{
+    std::vector<unsigned char> decompressed;
+    std::vector<unsigned char> lsdsng;
+};
+
+double milliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool check(lsdj_error_t* error)
+{
+    if (error == nullptr)
+        return true;
+    
+    std::cerr << "ERROR: " << lsdj_error_get_c_str(error) << std::endl;
+    lsdj_error_free(error);
+    return false;
+}
+
+// Creates songs from an empty song, with random runs of bytes scattered through
+// the phrase data so every song compresses differently
+bool generateSongs(std::vector<Song>& songs, size_t count, unsigned int seed)
+{
+    lsdj_error_t* error = nullptr;
+    lsdj_song_t* song = lsdj_song_new(&error);
+    if (!check(error))
+        return false;
+    
+    std::vector<unsigned char> empty(LSDJ_SONG_DECOMPRESSED_SIZE, 0);
+    lsdj_song_write_to_memory(song, empty.data(), empty.size(), &error);
+    lsdj_song_free(song);
+    if (!check(error))
+        return false;
+    
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<size_t> phraseOffset(0, 0x0FF0 - 16);
+    std::uniform_int_distribution<size_t> runLength(1, 16);
+    std::uniform_int_distribution<int> value(0, 0xFF);
+    
+    songs.resize(count);
+    for (Song& target : songs)
+    {
+        target.decompressed = empty;
+        for (int i = 0; i < 400; ++i)
+        {
+            const size_t offset = phraseOffset(random);
+            memset(target.decompressed.data() + offset, value(random), runLength(random));
+        }
+        
+        target.lsdsng.assign(LSDSNG_MAX_SIZE, 0);
+        memcpy(target.lsdsng.data(), "BENCH", 5);
+        
+        const unsigned int blocks = lsdj_compress_span(target.decompressed.data(), BLOCK_SIZE, 1, BLOCK_COUNT, target.lsdsng.data() + LSDJ_PROJECT_NAME_LENGTH + 1, target.lsdsng.size() - LSDJ_PROJECT_NAME_LENGTH - 1, &error);
+        if (!check(error) || blocks == 0)
+            return false;
+        
+        target.lsdsng.resize(LSDJ_PROJECT_NAME_LENGTH + 1 + blocks * BLOCK_SIZE);
+    }
+    
+    return true;
+}
+
+bool decompressVio(const Song& song, unsigned char* target)
+{
+    lsdj_memory_data_t rmem;
+    rmem.begin = (unsigned char*)song.lsdsng.data();
+    rmem.cur = rmem.begin + LSDJ_PROJECT_NAME_LENGTH + 1;
+    rmem.size = song.lsdsng.size();
+    
+    lsdj_vio_t rvio;
+    rvio.read = lsdj_mread;
+    rvio.tell = lsdj_mtell;
+    rvio.seek = lsdj_mseek;
+    rvio.user_data = &rmem;
+    
+    lsdj_memory_data_t wmem;
+    wmem.begin = wmem.cur = target;
+    wmem.size = LSDJ_SONG_DECOMPRESSED_SIZE;
+    
+    lsdj_vio_t wvio;
+    wvio.write = lsdj_mwrite;
+    wvio.tell = lsdj_mtell;
+    wvio.seek = lsdj_mseek;
+    wvio.user_data = &wmem;
+    
+    lsdj_error_t* error = nullptr;
+    lsdj_decompress(&rvio, &wvio, NULL, BLOCK_SIZE, &error);
+    return check(error);
+}
+
+bool decompressSpan(const Song& song, unsigned char* target)
+{
+    lsdj_error_t* error = nullptr;
+    lsdj_decompress_span(song.lsdsng.data(), song.lsdsng.size(), LSDJ_PROJECT_NAME_LENGTH + 1, -1, BLOCK_SIZE, target, &error);
+    return check(error);
+}
+
+unsigned int compressVio(const Song& song, unsigned char* target, size_t size)
+{
+    lsdj_memory_data_t wmem;
+    wmem.begin = wmem.cur = target;
+    wmem.size = size;
+    
+    lsdj_vio_t wvio;
+    wvio.write = lsdj_mwrite;
+    wvio.tell = lsdj_mtell;
+    wvio.seek = lsdj_mseek;
+    wvio.user_data = &wmem;
+    
+    lsdj_error_t* error = nullptr;
+    const unsigned int blocks = lsdj_compress(song.decompressed.data(), BLOCK_SIZE, 1, BLOCK_COUNT, &wvio, &error);
+    return check(error) ? blocks : 0;
+}
+
+unsigned int compressSpan(const Song& song, unsigned char* target, size_t size)
+{
+    lsdj_error_t* error = nullptr;
+    const unsigned int blocks = lsdj_compress_span(song.decompressed.data(), BLOCK_SIZE, 1, BLOCK_COUNT, target, size, &error);
+    return check(error) ? blocks : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 1000;
+    
+    std::vector<Song> songs;
+    if (!generateSongs(songs, count, 0x15D1))
+    {
+        std::cerr << "ERROR: could not generate songs" << std::endl;
+        return 1;
+    }
+    
+    std::vector<unsigned char> vioOutput(LSDJ_SONG_DECOMPRESSED_SIZE);
+    std::vector<unsigned char> spanOutput(LSDJ_SONG_DECOMPRESSED_SIZE);
+    
+    // Check both versions agree before timing anything
+    for (const Song& song : songs)
+    {
+        if (!decompressVio(song, vioOutput.data()) || !decompressSpan(song, spanOutput.data()))
+            return 1;
+        
+        if (vioOutput != spanOutput || spanOutput != song.decompressed)
+        {
+            std::cerr << "ERROR: decompressed songs differ" << std::endl;
+            return 1;
+        }
+        
+        std::fill(vioOutput.begin(), vioOutput.end(), 0);
+        std::fill(spanOutput.begin(), spanOutput.end(), 0);
+        const unsigned int vioBlocks = compressVio(song, vioOutput.data(), vioOutput.size());
+        const unsigned int spanBlocks = compressSpan(song, spanOutput.data(), spanOutput.size());
+        
+        if (vioBlocks != spanBlocks || vioOutput != spanOutput)
+        {
+            std::cerr << "ERROR: compressed songs differ" << std::endl;
+            return 1;
+        }
+    }
+    
+    auto start = Clock::now();
+    for (const Song& song : songs)
+        decompressVio(song, vioOutput.data());
+    const double vioDecompress = milliseconds(start);
+    
+    start = Clock::now();
+    for (const Song& song : songs)
+        decompressSpan(song, spanOutput.data());
+    const double spanDecompress = milliseconds(start);
+    
+    start = Clock::now();
+    for (const Song& song : songs)
+        compressVio(song, vioOutput.data(), vioOutput.size());
+    const double vioCompress = milliseconds(start);
+    
+    start = Clock::now();
+    for (const Song& song : songs)
+        compressSpan(song, spanOutput.data(), spanOutput.size());
+    const double spanCompress = milliseconds(start);
+    
+    // The full import path, which goes through the span functions for memory
+    start = Clock::now();
+    for (const Song& song : songs)
+    {
+        lsdj_error_t* error = nullptr;
+        lsdj_project_t* project = lsdj_project_read_lsdsng_from_memory(song.lsdsng.data(), song.lsdsng.size(), &error);
+        if (!check(error))
+            return 1;
+        
+        lsdj_song_free(lsdj_project_get_song(project));
+        lsdj_project_free(project);
+    }
+    const double import = milliseconds(start);
+    
+    std::cout << count << " songs" << std::endl;
+    std::cout << "decompress (vio):  " << vioDecompress << " ms" << std::endl;
+    std::cout << "decompress (span): " << spanDecompress << " ms" << std::endl;
+    std::cout << "compress (vio):    " << vioCompress << " ms" << std::endl;
+    std::cout << "compress (span):   " << spanCompress << " ms" << std::endl;
+    std::cout << "import lsdsng:     " << import << " ms" << std::endl;
+    
+    return 0;
+}